@@ -891,6 +891,76 @@ static int analyze_blame(sd_bus *bus) {
         return 0;
 }
 
+static int analyze_generators(sd_bus *bus) {
+        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
+        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct unit_times *times = NULL;
+        size_t size = 0;
+        const char *name;
+        usec_t start, finish;
+        unsigned i, n = 0;
+        int r;
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimings",
+                        &error,
+                        &reply,
+                        "a(stt)");
+        if (r < 0) {
+                log_error("Failed to get generator timings: %s", bus_error_message(&error, -r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stt)", &name, &start, &finish)) > 0) {
+                struct unit_times *t;
+
+                if (!GREEDY_REALLOC0(times, size, n+1)) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                t = times+n;
+                t->activating = start;
+                t->activated = finish;
+                t->time = finish > start ? finish - start : 0;
+
+                t->name = strdup(name);
+                if (!t->name) {
+                        r = log_oom();
+                        goto finish;
+                }
+                n++;
+        }
+        if (r < 0) {
+                bus_log_parse_error(r);
+                goto finish;
+        }
+
+        qsort(times, n, sizeof(struct unit_times), compare_unit_time);
+
+        pager_open_if_enabled();
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %s\n", format_timespan(ts, sizeof(ts), times[i].time, USEC_PER_MSEC), times[i].name);
+        }
+
+        r = 0;
+
+finish:
+        free_unit_times(times, n);
+        return r;
+}
+
 static int analyze_time(sd_bus *bus) {
         _cleanup_free_ char *buf = NULL;
         int r;
@@ -1139,6 +1209,7 @@ static int help(void) {
                "Commands:\n"
                "  time                    Print time spent in the kernel before reaching userspace\n"
                "  blame                   Print list of running units ordered by time to init\n"
+               "  generators              Print list of generators ordered by run time\n"
                "  critical-chain          Print a tree of the time critical chain of units\n"
                "  plot                    Output SVG graphic showing service initialization\n"
                "  dot                     Output dependency graph in dot(1) format\n"
@@ -1281,6 +1352,8 @@ int main(int argc, char *argv[]) {
                 r = analyze_time(bus);
         else if (streq(argv[optind], "blame"))
                 r = analyze_blame(bus);
+        else if (streq(argv[optind], "generators"))
+                r = analyze_generators(bus);
         else if (streq(argv[optind], "critical-chain"))
                 r = analyze_critical_chain(bus, argv+optind+1);
         else if (streq(argv[optind], "plot"))
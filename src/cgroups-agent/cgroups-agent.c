@@ -20,11 +20,39 @@
 ***/
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "sd-bus.h"
 #include "log.h"
+#include "util.h"
+#include "def.h"
 #include "bus-util.h"
 
+static int send_datagram(const char *cgroup) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_un un;
+        } sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = CGROUPS_AGENT_SOCKET,
+        };
+        _cleanup_close_ int fd = -1;
+        ssize_t n;
+
+        fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        n = sendto(fd, cgroup, strlen(cgroup), MSG_NOSIGNAL,
+                   &sa.sa, offsetof(struct sockaddr_un, sun_path) + strlen(sa.un.sun_path));
+        if (n < 0)
+                return -errno;
+
+        return 0;
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_bus_unref_ sd_bus *bus = NULL;
         int r;
@@ -34,10 +62,19 @@ int main(int argc, char *argv[]) {
                 return EXIT_FAILURE;
         }
 
+        /* A single datagram to the manager is a lot cheaper than a
+         * D-Bus connection, we are run once for every released
+         * cgroup. */
+        r = send_datagram(argv[1]);
+        if (r >= 0)
+                return EXIT_SUCCESS;
+
         log_set_target(LOG_TARGET_AUTO);
         log_parse_environment();
         log_open();
 
+        log_debug("Failed to send datagram to %s, falling back to D-Bus: %s", CGROUPS_AGENT_SOCKET, strerror(-r));
+
         /* We send this event to the private D-Bus socket and then the
          * system instance will forward this to the system bus. We do
          * this to avoid an activation loop when we start dbus when we
@@ -338,7 +338,7 @@ static void busname_enter_running(BusName *n) {
 
         /* If there's already a start pending don't bother to do
          * anything */
-        SET_FOREACH(other, UNIT(n)->dependencies[UNIT_TRIGGERS], i)
+        PTRSET_FOREACH(other, UNIT(n)->dependencies[UNIT_TRIGGERS], i)
                 if (unit_active_or_pending(other)) {
                         pending = true;
                         break;
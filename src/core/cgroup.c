@@ -20,11 +20,15 @@
 ***/
 
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "path-util.h"
 #include "special.h"
 #include "cgroup-util.h"
 #include "cgroup.h"
+#include "mkdir.h"
+#include "dbus.h"
 
 void cgroup_context_init(CGroupContext *c) {
         assert(c);
@@ -512,7 +516,7 @@ static void unit_queue_siblings(Unit *u) {
                 Iterator i;
                 Unit *m;
 
-                SET_FOREACH(m, slice->dependencies[UNIT_BEFORE], i) {
+                PTRSET_FOREACH(m, slice->dependencies[UNIT_BEFORE], i) {
                         if (m == u)
                                 continue;
 
@@ -627,6 +631,101 @@ pid_t unit_search_main_pid(Unit *u) {
         return pid;
 }
 
+static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(m->cgroups_agent_fd == fd);
+
+        /* Read everything that queued up, the units are put in the
+         * cgroup empty queue, so that each of them is checked only
+         * once, however often its cgroup was released */
+
+        for (;;) {
+                char buf[PATH_MAX+1];
+                ssize_t n;
+
+                n = recv(fd, buf, sizeof(buf)-1, MSG_DONTWAIT);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        if (errno == EAGAIN)
+                                break;
+
+                        log_error("Failed to read cgroups agent message: %m");
+                        return -errno;
+                }
+
+                if (n == 0)
+                        continue;
+
+                buf[n] = 0;
+
+                manager_notify_cgroup_empty(m, buf);
+
+                /* User instances still expect this on the system
+                 * bus */
+                bus_forward_agent_released(m, buf);
+        }
+
+        return 0;
+}
+
+static int manager_setup_cgroups_agent(Manager *m) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_un un;
+        } sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = CGROUPS_AGENT_SOCKET,
+        };
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(m);
+
+        /* The release agent hands empty cgroups to us with a single
+         * datagram instead of a D-Bus signal, which is a lot cheaper
+         * when thousands of cgroups are released at once */
+
+        if (m->cgroups_agent_fd >= 0)
+                return 0;
+
+        fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+                log_error("Failed to allocate cgroups agent socket: %m");
+                return -errno;
+        }
+
+        mkdir_parents_label(CGROUPS_AGENT_SOCKET, 0755);
+        unlink(CGROUPS_AGENT_SOCKET);
+
+        /* Only root may tell us about released cgroups */
+        RUN_WITH_UMASK(0077)
+                r = bind(fd, &sa.sa, offsetof(struct sockaddr_un, sun_path) + strlen(sa.un.sun_path));
+        if (r < 0) {
+                log_error("bind() on %s failed: %m", CGROUPS_AGENT_SOCKET);
+                return -errno;
+        }
+
+        /* Bursts of released cgroups should not be dropped */
+        fd_inc_rcvbuf(fd, 8*1024*1024);
+
+        r = sd_event_add_io(m->event, fd, EPOLLIN, manager_dispatch_cgroups_agent_fd, m, &m->cgroups_agent_event_source);
+        if (r < 0) {
+                log_error("Failed to allocate cgroups agent event source: %s", strerror(-r));
+                return r;
+        }
+
+        m->cgroups_agent_fd = fd;
+        fd = -1;
+
+        log_debug("Listening for released cgroups on %s.", CGROUPS_AGENT_SOCKET);
+
+        return 0;
+}
+
 int manager_setup_cgroup(Manager *m) {
         _cleanup_free_ char *path = NULL;
         char *e;
@@ -685,6 +784,14 @@ int manager_setup_cgroup(Manager *m) {
                         log_debug("Installed release agent.");
                 else
                         log_debug("Release agent already installed.");
+
+                /* Test runs of the system manager must not take
+                 * the socket away from the running PID 1 */
+                if (getpid() == 1) {
+                        r = manager_setup_cgroups_agent(m);
+                        if (r < 0)
+                                log_warning("Failed to listen for the release agent, falling back to D-Bus: %s", strerror(-r));
+                }
         }
 
         /* 4. Make sure we are in the root cgroup */
@@ -726,6 +833,13 @@ void manager_shutdown_cgroup(Manager *m, bool delete) {
                 m->pin_cgroupfs_fd = -1;
         }
 
+        m->cgroups_agent_event_source = sd_event_source_unref(m->cgroups_agent_event_source);
+
+        if (m->cgroups_agent_fd >= 0) {
+                close_nointr_nofail(m->cgroups_agent_fd);
+                m->cgroups_agent_fd = -1;
+        }
+
         free(m->cgroup_root);
         m->cgroup_root = NULL;
 }
@@ -773,15 +887,34 @@ Unit *manager_get_unit_by_pid(Manager *m, pid_t pid) {
         return manager_get_unit_by_cgroup(m, cgroup);
 }
 
-int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
+void unit_add_to_cgroup_empty_queue(Unit *u) {
+        assert(u);
+
+        if (u->in_cgroup_empty_queue || !u->cgroup_path)
+                return;
+
+        LIST_PREPEND(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
+        u->in_cgroup_empty_queue = true;
+}
+
+unsigned manager_dispatch_cgroup_empty_queue(Manager *m) {
         Unit *u;
+        unsigned n = 0;
         int r;
 
         assert(m);
-        assert(cgroup);
 
-        u = manager_get_unit_by_cgroup(m, cgroup);
-        if (u) {
+        while ((u = m->cgroup_empty_queue)) {
+                assert(u->in_cgroup_empty_queue);
+
+                LIST_REMOVE(cgroup_empty_queue, m->cgroup_empty_queue, u);
+                u->in_cgroup_empty_queue = false;
+
+                n++;
+
+                if (!u->cgroup_path)
+                        continue;
+
                 r = cg_is_empty_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, true);
                 if (r > 0) {
                         if (UNIT_VTABLE(u)->notify_cgroup_empty)
@@ -791,6 +924,19 @@ int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
                 }
         }
 
+        return n;
+}
+
+int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
+        Unit *u;
+
+        assert(m);
+        assert(cgroup);
+
+        u = manager_get_unit_by_cgroup(m, cgroup);
+        if (u)
+                unit_add_to_cgroup_empty_queue(u);
+
         return 0;
 }
 
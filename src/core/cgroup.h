@@ -109,6 +109,8 @@ Unit* manager_get_unit_by_pid(Manager *m, pid_t pid);
 
 pid_t unit_search_main_pid(Unit *u);
 
+void unit_add_to_cgroup_empty_queue(Unit *u);
+unsigned manager_dispatch_cgroup_empty_queue(Manager *m);
 int manager_notify_cgroup_empty(Manager *m, const char *group);
 
 const char* cgroup_device_policy_to_string(CGroupDevicePolicy i) _const_;
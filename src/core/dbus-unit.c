@@ -93,7 +93,7 @@ static int property_get_dependencies(
                 void *userdata,
                 sd_bus_error *error) {
 
-        Set *s = *(Set**) userdata;
+        PtrSet *s = *(PtrSet**) userdata;
         Iterator j;
         Unit *u;
         int r;
@@ -105,7 +105,7 @@ static int property_get_dependencies(
         if (r < 0)
                 return r;
 
-        SET_FOREACH(u, s, j) {
+        PTRSET_FOREACH(u, s, j) {
                 r = sd_bus_message_append(reply, "s", u->id);
                 if (r < 0)
                         return r;
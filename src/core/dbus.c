@@ -102,6 +102,31 @@ static int signal_agent_released(sd_bus *bus, sd_bus_message *message, void *use
         return 0;
 }
 
+int bus_forward_agent_released(Manager *m, const char *cgroup) {
+        int r;
+
+        assert(m);
+        assert(cgroup);
+
+        /* Messages from the cgroups agent that did not come in via
+         * D-Bus are passed on to the system bus just the same */
+
+        if (m->running_as != SYSTEMD_SYSTEM || !m->system_bus)
+                return 0;
+
+        r = sd_bus_emit_signal(m->system_bus,
+                               "/org/freedesktop/systemd1/agent",
+                               "org.freedesktop.systemd1.Agent",
+                               "Released",
+                               "s", cgroup);
+        if (r < 0) {
+                log_warning("Failed to send Released message: %s", strerror(-r));
+                return r;
+        }
+
+        return 0;
+}
+
 static int signal_disconnected(sd_bus *bus, sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
 
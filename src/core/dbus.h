@@ -24,6 +24,7 @@
 #include "manager.h"
 
 int bus_send_queued_message(Manager *m);
+int bus_forward_agent_released(Manager *m, const char *cgroup);
 
 int bus_init(Manager *m, bool try_bus_connect);
 void bus_done(Manager *m);
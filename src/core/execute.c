@@ -41,6 +41,9 @@
 #include <linux/seccomp-bpf.h>
 #include <glob.h>
 #include <libgen.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <link.h>
 
 #ifdef HAVE_PAM
 #include <security/pam_appl.h>
@@ -74,6 +77,21 @@
 /* This assumes there is a 'tty' group */
 #define TTY_MODE 0620
 
+/* The stack of children that share our memory. Pages never touched
+ * are never allocated. */
+#define EXEC_SHARED_STACK_SIZE (1024*1024)
+
+/* How many symlinks and interpreters we follow when checking the paths
+ * such a child looks up */
+#define EXEC_SHARED_PATH_DEPTH_MAX 8
+
+/* Mount points below which a path lookup might wait for somebody else:
+ * automount points, which are possibly served by ourselves, and
+ * network and FUSE file systems, which might hang. Kept up to date with
+ * /proc/self/mountinfo. */
+static FILE *exec_mountinfo = NULL;
+static char **exec_blocking_mounts = NULL;
+
 static int shift_fds(int fds[], unsigned n_fds) {
         int start, restart_from;
 
@@ -193,57 +211,99 @@ static int open_null_as(int flags, int nfd) {
         return r;
 }
 
-static int connect_logger_as(const ExecContext *context, ExecOutput output, const char *ident, const char *unit_id, int nfd) {
+/* Connects to the journal's stdout stream and sends the header
+ * describing the stream. With nonblock set, fails with -EAGAIN instead
+ * of waiting for the journal to catch up. */
+static int connect_logger(const ExecContext *context, ExecOutput output, const char *ident, const char *unit_id, bool nonblock) {
         int fd, r;
         union sockaddr_union sa = {
                 .un.sun_family = AF_UNIX,
                 .un.sun_path = "/run/systemd/journal/stdout",
         };
+        _cleanup_free_ char *header = NULL;
+        ssize_t n;
 
         assert(context);
         assert(output < _EXEC_OUTPUT_MAX);
         assert(ident);
-        assert(nfd >= 0);
 
-        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        r = asprintf(&header,
+                     "%s\n"
+                     "%s\n"
+                     "%i\n"
+                     "%i\n"
+                     "%i\n"
+                     "%i\n"
+                     "%i\n",
+                     context->syslog_identifier ? context->syslog_identifier : ident,
+                     unit_id,
+                     context->syslog_priority,
+                     !!context->syslog_level_prefix,
+                     output == EXEC_OUTPUT_SYSLOG || output == EXEC_OUTPUT_SYSLOG_AND_CONSOLE,
+                     output == EXEC_OUTPUT_KMSG || output == EXEC_OUTPUT_KMSG_AND_CONSOLE,
+                     is_terminal_output(output));
+        if (r < 0)
+                return -ENOMEM;
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|(nonblock ? SOCK_NONBLOCK : 0), 0);
         if (fd < 0)
                 return -errno;
 
         r = connect(fd, &sa.sa, offsetof(struct sockaddr_un, sun_path) + strlen(sa.un.sun_path));
         if (r < 0) {
-                close_nointr_nofail(fd);
-                return -errno;
+                r = errno == EINPROGRESS ? -EAGAIN : -errno;
+                goto fail;
         }
 
         if (shutdown(fd, SHUT_RD) < 0) {
-                close_nointr_nofail(fd);
-                return -errno;
+                r = -errno;
+                goto fail;
         }
 
-        dprintf(fd,
-                "%s\n"
-                "%s\n"
-                "%i\n"
-                "%i\n"
-                "%i\n"
-                "%i\n"
-                "%i\n",
-                context->syslog_identifier ? context->syslog_identifier : ident,
-                unit_id,
-                context->syslog_priority,
-                !!context->syslog_level_prefix,
-                output == EXEC_OUTPUT_SYSLOG || output == EXEC_OUTPUT_SYSLOG_AND_CONSOLE,
-                output == EXEC_OUTPUT_KMSG || output == EXEC_OUTPUT_KMSG_AND_CONSOLE,
-                is_terminal_output(output));
+        n = write(fd, header, strlen(header));
+        if (n < 0) {
+                r = -errno;
+                goto fail;
+        }
+        if ((size_t) n != strlen(header)) {
+                r = -EAGAIN;
+                goto fail;
+        }
+
+        if (nonblock) {
+                r = fd_nonblock(fd, false);
+                if (r < 0)
+                        goto fail;
+        }
+
+        return fd;
+
+fail:
+        close_nointr_nofail(fd);
+        return r;
+}
+
+static int connect_logger_as(const ExecContext *context, ExecOutput output, const char *ident, const char *unit_id, int nfd) {
+        int fd, r;
+
+        assert(nfd >= 0);
+
+        fd = connect_logger(context, output, ident, unit_id, false);
+        if (fd < 0)
+                return fd;
 
         if (fd != nfd) {
                 r = dup2(fd, nfd) < 0 ? -errno : nfd;
                 close_nointr_nofail(fd);
-        } else
-                r = nfd;
+        } else {
+                r = fd_cloexec(fd, false);
+                if (r >= 0)
+                        r = nfd;
+        }
 
         return r;
 }
+
 static int open_terminal_as(const char *path, mode_t mode, int nfd) {
         int fd, r;
 
@@ -330,7 +390,7 @@ static int setup_input(const ExecContext *context, int socket_fd, bool apply_tty
         }
 }
 
-static int setup_output(const ExecContext *context, int fileno, int socket_fd, const char *ident, const char *unit_id, bool apply_tty_stdin) {
+static int setup_output(const ExecContext *context, int fileno, int socket_fd, int logger_fd, const char *ident, const char *unit_id, bool apply_tty_stdin) {
         ExecOutput o;
         ExecInput i;
         int r;
@@ -397,6 +457,10 @@ static int setup_output(const ExecContext *context, int fileno, int socket_fd, c
         case EXEC_OUTPUT_KMSG_AND_CONSOLE:
         case EXEC_OUTPUT_JOURNAL:
         case EXEC_OUTPUT_JOURNAL_AND_CONSOLE:
+                /* Already connected for us by our parent */
+                if (logger_fd >= 0)
+                        return dup2(logger_fd, fileno) < 0 ? -errno : fileno;
+
                 r = connect_logger_as(context, o, ident, unit_id, fileno);
                 if (r < 0) {
                         log_struct_unit(LOG_CRIT, unit_id,
@@ -1012,553 +1076,1090 @@ static void do_idle_pipe_dance(int idle_pipe[4]) {
                 close_nointr_nofail(idle_pipe[3]);
 }
 
-int exec_spawn(ExecCommand *command,
-               char **argv,
-               ExecContext *context,
-               int fds[], unsigned n_fds,
-               char **environment,
-               bool apply_permissions,
-               bool apply_chroot,
-               bool apply_tty_stdin,
-               bool confirm_spawn,
-               CGroupControllerMask cgroup_supported,
-               const char *cgroup_path,
-               const char *unit_id,
-               int idle_pipe[4],
-               ExecRuntime *runtime,
-               pid_t *ret) {
+/* A child that shares our memory gets everything that needs to be
+ * allocated prepared by us. */
+typedef struct ExecShared {
+        char **argv;
+        char **env;
+        char *listen_pid;  /* Entry of env the child fills in */
+        int stdout_fd;     /* Connections to the journal, or -1 */
+        int stderr_fd;
+} ExecShared;
+
+/* glibc might cache the PID in memory we share with the parent */
+static pid_t shared_getpid(void) {
+        return (pid_t) syscall(SYS_getpid);
+}
 
-        _cleanup_strv_free_ char **files_env = NULL;
-        int socket_fd;
+static void log_spawn_failure(ExecCommand *command, int r, int err) {
+        log_struct(LOG_ERR, MESSAGE_ID(SD_MESSAGE_SPAWN_FAILED),
+                   "EXECUTABLE=%s", command->path,
+                   "MESSAGE=Failed at step %s spawning %s: %s",
+                          exit_status_to_string(r, EXIT_STATUS_SYSTEMD),
+                          command->path, strerror(-err),
+                   "ERRNO=%d", -err,
+                   NULL);
+}
+
+static int exec_child(ExecCommand *command,
+                      char **argv,
+                      ExecContext *context,
+                      int fds[], unsigned n_fds,
+                      int socket_fd,
+                      char **environment,
+                      char **files_env,
+                      bool apply_permissions,
+                      bool apply_chroot,
+                      bool apply_tty_stdin,
+                      bool confirm_spawn,
+                      CGroupControllerMask cgroup_supported,
+                      const char *cgroup_path,
+                      const char *unit_id,
+                      int idle_pipe[4],
+                      ExecRuntime *runtime,
+                      ExecShared *shared,
+                      int *error) {
+
+        _cleanup_strv_free_ char **our_env = NULL, **pam_env = NULL, **final_env = NULL, **final_argv = NULL;
+        const char *username = NULL, *home = NULL, *shell = NULL;
+        unsigned n_dont_close = 0, n_env = 0;
+        int dont_close[n_fds + 5];
+        uid_t uid = (uid_t) -1;
+        gid_t gid = (gid_t) -1;
+        sigset_t ss;
         char *line;
-        pid_t pid;
-        int r;
+        int i, r, err;
 
-        assert(command);
-        assert(context);
-        assert(ret);
-        assert(fds || n_fds <= 0);
+        /* If we share our parent's memory, we must not touch any of
+         * its global state, nor allocate memory that we do not free
+         * again before execve(). */
 
-        if (context->std_input == EXEC_INPUT_SOCKET ||
-            context->std_output == EXEC_OUTPUT_SOCKET ||
-            context->std_error == EXEC_OUTPUT_SOCKET) {
+        if (!shared)
+                rename_process_from_path(command->path);
 
-                if (n_fds != 1)
-                        return -EINVAL;
+        /* We reset exactly these signals, since they are the
+         * only ones we set to SIG_IGN in the main daemon. All
+         * others we leave untouched because we set them to
+         * SIG_DFL or a valid handler initially, both of which
+         * will be demoted to SIG_DFL. */
+        default_signals(SIGNALS_CRASH_HANDLER,
+                        SIGNALS_IGNORE, -1);
 
-                socket_fd = fds[0];
+        if (context->ignore_sigpipe)
+                ignore_signals(SIGPIPE, -1);
 
-                fds = NULL;
-                n_fds = 0;
-        } else
-                socket_fd = -1;
-
-        r = exec_context_load_environment(context, &files_env);
-        if (r < 0) {
-                log_struct_unit(LOG_ERR,
-                           unit_id,
-                           "MESSAGE=Failed to load environment files: %s", strerror(-r),
-                           "ERRNO=%d", -r,
-                           NULL);
-                return r;
+        assert_se(sigemptyset(&ss) == 0);
+        if (sigprocmask(SIG_SETMASK, &ss, NULL) < 0) {
+                err = -errno;
+                r = EXIT_SIGNAL_MASK;
+                goto fail;
         }
 
-        if (!argv)
-                argv = command->argv;
+        if (idle_pipe)
+                do_idle_pipe_dance(idle_pipe);
 
-        line = exec_command_line(argv);
-        if (!line)
-                return log_oom();
+        /* Close sockets very early to make sure we don't
+         * block init reexecution because it cannot bind its
+         * sockets */
+        if (!shared)
+                log_forget_fds();
 
-        log_struct_unit(LOG_DEBUG,
-                        unit_id,
-                        "EXECUTABLE=%s", command->path,
-                        "MESSAGE=About to execute: %s", line,
-                        NULL);
-        free(line);
+        if (socket_fd >= 0)
+                dont_close[n_dont_close++] = socket_fd;
+        if (n_fds > 0) {
+                memcpy(dont_close + n_dont_close, fds, sizeof(int) * n_fds);
+                n_dont_close += n_fds;
+        }
+        if (runtime) {
+                if (runtime->netns_storage_socket[0] >= 0)
+                        dont_close[n_dont_close++] = runtime->netns_storage_socket[0];
+                if (runtime->netns_storage_socket[1] >= 0)
+                        dont_close[n_dont_close++] = runtime->netns_storage_socket[1];
+        }
+        if (shared) {
+                if (shared->stdout_fd >= 0)
+                        dont_close[n_dont_close++] = shared->stdout_fd;
+                if (shared->stderr_fd >= 0)
+                        dont_close[n_dont_close++] = shared->stderr_fd;
+        }
 
-        pid = fork();
-        if (pid < 0)
-                return -errno;
+        err = close_all_fds(dont_close, n_dont_close);
+        if (err < 0) {
+                r = EXIT_FDS;
+                goto fail;
+        }
 
-        if (pid == 0) {
-                _cleanup_strv_free_ char **our_env = NULL, **pam_env = NULL, **final_env = NULL, **final_argv = NULL;
-                const char *username = NULL, *home = NULL, *shell = NULL;
-                unsigned n_dont_close = 0, n_env = 0;
-                int dont_close[n_fds + 3];
-                uid_t uid = (uid_t) -1;
-                gid_t gid = (gid_t) -1;
-                sigset_t ss;
-                int i, err;
+        if (!context->same_pgrp)
+                if (setsid() < 0) {
+                        err = -errno;
+                        r = EXIT_SETSID;
+                        goto fail;
+                }
 
-                /* child */
+        if (context->tcpwrap_name) {
+                if (socket_fd >= 0)
+                        if (!socket_tcpwrap(socket_fd, context->tcpwrap_name)) {
+                                err = -EACCES;
+                                r = EXIT_TCPWRAP;
+                                goto fail;
+                        }
 
-                rename_process_from_path(command->path);
+                for (i = 0; i < (int) n_fds; i++) {
+                        if (!socket_tcpwrap(fds[i], context->tcpwrap_name)) {
+                                err = -EACCES;
+                                r = EXIT_TCPWRAP;
+                                goto fail;
+                        }
+                }
+        }
 
-                /* We reset exactly these signals, since they are the
-                 * only ones we set to SIG_IGN in the main daemon. All
-                 * others we leave untouched because we set them to
-                 * SIG_DFL or a valid handler initially, both of which
-                 * will be demoted to SIG_DFL. */
-                default_signals(SIGNALS_CRASH_HANDLER,
-                                SIGNALS_IGNORE, -1);
+        exec_context_tty_reset(context);
 
-                if (context->ignore_sigpipe)
-                        ignore_signals(SIGPIPE, -1);
+        if (confirm_spawn) {
+                char response;
 
-                assert_se(sigemptyset(&ss) == 0);
-                if (sigprocmask(SIG_SETMASK, &ss, NULL) < 0) {
-                        err = -errno;
-                        r = EXIT_SIGNAL_MASK;
-                        goto fail_child;
+                err = ask_for_confirmation(&response, argv);
+                if (err == -ETIMEDOUT)
+                        write_confirm_message("Confirmation question timed out, assuming positive response.\n");
+                else if (err < 0)
+                        write_confirm_message("Couldn't ask confirmation question, assuming positive response: %s\n", strerror(-err));
+                else if (response == 's') {
+                        write_confirm_message("Skipping execution.\n");
+                        err = -ECANCELED;
+                        r = EXIT_CONFIRM;
+                        goto fail;
+                } else if (response == 'n') {
+                        write_confirm_message("Failing execution.\n");
+                        err = r = 0;
+                        goto fail;
                 }
+        }
 
-                if (idle_pipe)
-                        do_idle_pipe_dance(idle_pipe);
+        /* If a socket is connected to STDIN/STDOUT/STDERR, we
+         * must sure to drop O_NONBLOCK */
+        if (socket_fd >= 0)
+                fd_nonblock(socket_fd, false);
 
-                /* Close sockets very early to make sure we don't
-                 * block init reexecution because it cannot bind its
-                 * sockets */
-                log_forget_fds();
+        err = setup_input(context, socket_fd, apply_tty_stdin);
+        if (err < 0) {
+                r = EXIT_STDIN;
+                goto fail;
+        }
 
-                if (socket_fd >= 0)
-                        dont_close[n_dont_close++] = socket_fd;
-                if (n_fds > 0) {
-                        memcpy(dont_close + n_dont_close, fds, sizeof(int) * n_fds);
-                        n_dont_close += n_fds;
-                }
-                if (runtime) {
-                        if (runtime->netns_storage_socket[0] >= 0)
-                                dont_close[n_dont_close++] = runtime->netns_storage_socket[0];
-                        if (runtime->netns_storage_socket[1] >= 0)
-                                dont_close[n_dont_close++] = runtime->netns_storage_socket[1];
-                }
+        err = setup_output(context, STDOUT_FILENO, socket_fd, shared ? shared->stdout_fd : -1, path_get_file_name(command->path), unit_id, apply_tty_stdin);
+        if (err < 0) {
+                r = EXIT_STDOUT;
+                goto fail;
+        }
+
+        err = setup_output(context, STDERR_FILENO, socket_fd, shared ? shared->stderr_fd : -1, path_get_file_name(command->path), unit_id, apply_tty_stdin);
+        if (err < 0) {
+                r = EXIT_STDERR;
+                goto fail;
+        }
 
-                err = close_all_fds(dont_close, n_dont_close);
+        if (cgroup_path) {
+                err = cg_attach_everywhere(cgroup_supported, cgroup_path, shared ? shared_getpid() : 0);
                 if (err < 0) {
-                        r = EXIT_FDS;
-                        goto fail_child;
+                        r = EXIT_CGROUP;
+                        goto fail;
                 }
+        }
 
-                if (!context->same_pgrp)
-                        if (setsid() < 0) {
-                                err = -errno;
-                                r = EXIT_SETSID;
-                                goto fail_child;
-                        }
+        if (context->oom_score_adjust_set) {
+                char t[16];
 
-                if (context->tcpwrap_name) {
-                        if (socket_fd >= 0)
-                                if (!socket_tcpwrap(socket_fd, context->tcpwrap_name)) {
-                                        err = -EACCES;
-                                        r = EXIT_TCPWRAP;
-                                        goto fail_child;
-                                }
+                snprintf(t, sizeof(t), "%i", context->oom_score_adjust);
+                char_array_0(t);
 
-                        for (i = 0; i < (int) n_fds; i++) {
-                                if (!socket_tcpwrap(fds[i], context->tcpwrap_name)) {
-                                        err = -EACCES;
-                                        r = EXIT_TCPWRAP;
-                                        goto fail_child;
-                                }
-                        }
+                if (write_string_file("/proc/self/oom_score_adj", t) < 0) {
+                        err = -errno;
+                        r = EXIT_OOM_ADJUST;
+                        goto fail;
                 }
+        }
 
-                exec_context_tty_reset(context);
+        if (context->nice_set)
+                if (setpriority(PRIO_PROCESS, 0, context->nice) < 0) {
+                        err = -errno;
+                        r = EXIT_NICE;
+                        goto fail;
+                }
 
-                if (confirm_spawn) {
-                        char response;
-
-                        err = ask_for_confirmation(&response, argv);
-                        if (err == -ETIMEDOUT)
-                                write_confirm_message("Confirmation question timed out, assuming positive response.\n");
-                        else if (err < 0)
-                                write_confirm_message("Couldn't ask confirmation question, assuming positive response: %s\n", strerror(-err));
-                        else if (response == 's') {
-                                write_confirm_message("Skipping execution.\n");
-                                err = -ECANCELED;
-                                r = EXIT_CONFIRM;
-                                goto fail_child;
-                        } else if (response == 'n') {
-                                write_confirm_message("Failing execution.\n");
-                                err = r = 0;
-                                goto fail_child;
-                        }
+        if (context->cpu_sched_set) {
+                struct sched_param param = {
+                        .sched_priority = context->cpu_sched_priority,
+                };
+
+                r = sched_setscheduler(0,
+                                       context->cpu_sched_policy |
+                                       (context->cpu_sched_reset_on_fork ?
+                                        SCHED_RESET_ON_FORK : 0),
+                                       &param);
+                if (r < 0) {
+                        err = -errno;
+                        r = EXIT_SETSCHEDULER;
+                        goto fail;
                 }
+        }
 
-                /* If a socket is connected to STDIN/STDOUT/STDERR, we
-                 * must sure to drop O_NONBLOCK */
-                if (socket_fd >= 0)
-                        fd_nonblock(socket_fd, false);
+        if (context->cpuset)
+                if (sched_setaffinity(0, CPU_ALLOC_SIZE(context->cpuset_ncpus), context->cpuset) < 0) {
+                        err = -errno;
+                        r = EXIT_CPUAFFINITY;
+                        goto fail;
+                }
 
-                err = setup_input(context, socket_fd, apply_tty_stdin);
-                if (err < 0) {
-                        r = EXIT_STDIN;
-                        goto fail_child;
+        if (context->ioprio_set)
+                if (ioprio_set(IOPRIO_WHO_PROCESS, 0, context->ioprio) < 0) {
+                        err = -errno;
+                        r = EXIT_IOPRIO;
+                        goto fail;
                 }
 
-                err = setup_output(context, STDOUT_FILENO, socket_fd, path_get_file_name(command->path), unit_id, apply_tty_stdin);
-                if (err < 0) {
-                        r = EXIT_STDOUT;
-                        goto fail_child;
+        if (context->timer_slack_nsec != (nsec_t) -1)
+                if (prctl(PR_SET_TIMERSLACK, context->timer_slack_nsec) < 0) {
+                        err = -errno;
+                        r = EXIT_TIMERSLACK;
+                        goto fail;
                 }
 
-                err = setup_output(context, STDERR_FILENO, socket_fd, path_get_file_name(command->path), unit_id, apply_tty_stdin);
+        if (context->utmp_id)
+                utmp_put_init_process(context->utmp_id, getpid(), getsid(0), context->tty_path);
+
+        if (context->user) {
+                username = context->user;
+                err = get_user_creds(&username, &uid, &gid, &home, &shell);
                 if (err < 0) {
-                        r = EXIT_STDERR;
-                        goto fail_child;
+                        r = EXIT_USER;
+                        goto fail;
                 }
 
-                if (cgroup_path) {
-                        err = cg_attach_everywhere(cgroup_supported, cgroup_path, 0);
+                if (is_terminal_input(context->std_input)) {
+                        err = chown_terminal(STDIN_FILENO, uid);
                         if (err < 0) {
-                                r = EXIT_CGROUP;
-                                goto fail_child;
+                                r = EXIT_STDIN;
+                                goto fail;
                         }
                 }
+        }
 
-                if (context->oom_score_adjust_set) {
-                        char t[16];
+#ifdef HAVE_PAM
+        if (cgroup_path && context->user && context->pam_name) {
+                err = cg_set_task_access(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, 0644, uid, gid);
+                if (err < 0) {
+                        r = EXIT_CGROUP;
+                        goto fail;
+                }
 
-                        snprintf(t, sizeof(t), "%i", context->oom_score_adjust);
-                        char_array_0(t);
 
-                        if (write_string_file("/proc/self/oom_score_adj", t) < 0) {
-                                err = -errno;
-                                r = EXIT_OOM_ADJUST;
-                                goto fail_child;
-                        }
+                err = cg_set_group_access(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, 0755, uid, gid);
+                if (err < 0) {
+                        r = EXIT_CGROUP;
+                        goto fail;
                 }
+        }
+#endif
 
-                if (context->nice_set)
-                        if (setpriority(PRIO_PROCESS, 0, context->nice) < 0) {
-                                err = -errno;
-                                r = EXIT_NICE;
-                                goto fail_child;
-                        }
+        if (apply_permissions) {
+                err = enforce_groups(context, username, gid);
+                if (err < 0) {
+                        r = EXIT_GROUP;
+                        goto fail;
+                }
+        }
 
-                if (context->cpu_sched_set) {
-                        struct sched_param param = {
-                                .sched_priority = context->cpu_sched_priority,
-                        };
+        umask(context->umask);
 
-                        r = sched_setscheduler(0,
-                                               context->cpu_sched_policy |
-                                               (context->cpu_sched_reset_on_fork ?
-                                                SCHED_RESET_ON_FORK : 0),
-                                               &param);
-                        if (r < 0) {
-                                err = -errno;
-                                r = EXIT_SETSCHEDULER;
-                                goto fail_child;
-                        }
+#ifdef HAVE_PAM
+        if (apply_permissions && context->pam_name && username) {
+                err = setup_pam(context->pam_name, username, uid, context->tty_path, &pam_env, fds, n_fds);
+                if (err < 0) {
+                        r = EXIT_PAM;
+                        goto fail;
+                }
+        }
+#endif
+        if (context->private_network && runtime && runtime->netns_storage_socket[0] >= 0) {
+                err = setup_netns(runtime->netns_storage_socket);
+                if (err < 0) {
+                        r = EXIT_NETWORK;
+                        goto fail;
                 }
+        }
 
-                if (context->cpuset)
-                        if (sched_setaffinity(0, CPU_ALLOC_SIZE(context->cpuset_ncpus), context->cpuset) < 0) {
-                                err = -errno;
-                                r = EXIT_CPUAFFINITY;
-                                goto fail_child;
-                        }
+        if (!strv_isempty(context->read_write_dirs) ||
+            !strv_isempty(context->read_only_dirs) ||
+            !strv_isempty(context->inaccessible_dirs) ||
+            context->mount_flags != 0 ||
+            (context->private_tmp && runtime && (runtime->tmp_dir || runtime->var_tmp_dir))) {
+
+                char *tmp = NULL, *var = NULL;
+
+                /* The runtime struct only contains the parent
+                 * of the private /tmp, which is
+                 * non-accessible to world users. Inside of it
+                 * there's a /tmp that is sticky, and that's
+                 * the one we want to use here. */
+
+                if (context->private_tmp && runtime) {
+                        if (runtime->tmp_dir)
+                                tmp = strappenda(runtime->tmp_dir, "/tmp");
+                        if (runtime->var_tmp_dir)
+                                var = strappenda(runtime->var_tmp_dir, "/tmp");
+                }
 
-                if (context->ioprio_set)
-                        if (ioprio_set(IOPRIO_WHO_PROCESS, 0, context->ioprio) < 0) {
-                                err = -errno;
-                                r = EXIT_IOPRIO;
-                                goto fail_child;
-                        }
+                err = setup_namespace(
+                                context->read_write_dirs,
+                                context->read_only_dirs,
+                                context->inaccessible_dirs,
+                                tmp,
+                                var,
+                                context->mount_flags);
 
-                if (context->timer_slack_nsec != (nsec_t) -1)
-                        if (prctl(PR_SET_TIMERSLACK, context->timer_slack_nsec) < 0) {
+                if (err < 0) {
+                        r = EXIT_NAMESPACE;
+                        goto fail;
+                }
+        }
+
+        if (apply_chroot) {
+                if (context->root_directory)
+                        if (chroot(context->root_directory) < 0) {
                                 err = -errno;
-                                r = EXIT_TIMERSLACK;
-                                goto fail_child;
+                                r = EXIT_CHROOT;
+                                goto fail;
                         }
 
-                if (context->utmp_id)
-                        utmp_put_init_process(context->utmp_id, getpid(), getsid(0), context->tty_path);
+                if (chdir(context->working_directory ? context->working_directory : "/") < 0) {
+                        err = -errno;
+                        r = EXIT_CHDIR;
+                        goto fail;
+                }
+        } else {
+                _cleanup_free_ char *d = NULL;
 
-                if (context->user) {
-                        username = context->user;
-                        err = get_user_creds(&username, &uid, &gid, &home, &shell);
-                        if (err < 0) {
-                                r = EXIT_USER;
-                                goto fail_child;
-                        }
+                if (asprintf(&d, "%s/%s",
+                             context->root_directory ? context->root_directory : "",
+                             context->working_directory ? context->working_directory : "") < 0) {
+                        err = -ENOMEM;
+                        r = EXIT_MEMORY;
+                        goto fail;
+                }
 
-                        if (is_terminal_input(context->std_input)) {
-                                err = chown_terminal(STDIN_FILENO, uid);
-                                if (err < 0) {
-                                        r = EXIT_STDIN;
-                                        goto fail_child;
-                                }
-                        }
+                if (chdir(d) < 0) {
+                        err = -errno;
+                        r = EXIT_CHDIR;
+                        goto fail;
                 }
+        }
 
-#ifdef HAVE_PAM
-                if (cgroup_path && context->user && context->pam_name) {
-                        err = cg_set_task_access(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, 0644, uid, gid);
-                        if (err < 0) {
-                                r = EXIT_CGROUP;
-                                goto fail_child;
-                        }
+        /* We repeat the fd closing here, to make sure that
+         * nothing is leaked from the PAM modules */
+        err = close_all_fds(fds, n_fds);
+        if (err >= 0)
+                err = shift_fds(fds, n_fds);
+        if (err >= 0)
+                err = flags_fds(fds, n_fds, context->non_blocking);
+        if (err < 0) {
+                r = EXIT_FDS;
+                goto fail;
+        }
 
+        if (apply_permissions) {
 
-                        err = cg_set_group_access(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, 0755, uid, gid);
-                        if (err < 0) {
-                                r = EXIT_CGROUP;
-                                goto fail_child;
+                for (i = 0; i < RLIMIT_NLIMITS; i++) {
+                        if (!context->rlimit[i])
+                                continue;
+
+                        if (setrlimit_closest(i, context->rlimit[i]) < 0) {
+                                err = -errno;
+                                r = EXIT_LIMITS;
+                                goto fail;
                         }
                 }
-#endif
 
-                if (apply_permissions) {
-                        err = enforce_groups(context, username, gid);
+                if (context->capability_bounding_set_drop) {
+                        err = capability_bounding_set_drop(context->capability_bounding_set_drop, false);
                         if (err < 0) {
-                                r = EXIT_GROUP;
-                                goto fail_child;
+                                r = EXIT_CAPABILITIES;
+                                goto fail;
                         }
                 }
 
-                umask(context->umask);
-
-#ifdef HAVE_PAM
-                if (apply_permissions && context->pam_name && username) {
-                        err = setup_pam(context->pam_name, username, uid, context->tty_path, &pam_env, fds, n_fds);
+                if (context->user) {
+                        err = enforce_user(context, uid);
                         if (err < 0) {
-                                r = EXIT_PAM;
-                                goto fail_child;
+                                r = EXIT_USER;
+                                goto fail;
                         }
                 }
-#endif
-                if (context->private_network && runtime && runtime->netns_storage_socket[0] >= 0) {
-                        err = setup_netns(runtime->netns_storage_socket);
-                        if (err < 0) {
-                                r = EXIT_NETWORK;
-                                goto fail_child;
+
+                /* PR_GET_SECUREBITS is not privileged, while
+                 * PR_SET_SECUREBITS is. So to suppress
+                 * potential EPERMs we'll try not to call
+                 * PR_SET_SECUREBITS unless necessary. */
+                if (prctl(PR_GET_SECUREBITS) != context->secure_bits)
+                        if (prctl(PR_SET_SECUREBITS, context->secure_bits) < 0) {
+                                err = -errno;
+                                r = EXIT_SECUREBITS;
+                                goto fail;
                         }
-                }
 
-                if (!strv_isempty(context->read_write_dirs) ||
-                    !strv_isempty(context->read_only_dirs) ||
-                    !strv_isempty(context->inaccessible_dirs) ||
-                    context->mount_flags != 0 ||
-                    (context->private_tmp && runtime && (runtime->tmp_dir || runtime->var_tmp_dir))) {
-
-                        char *tmp = NULL, *var = NULL;
-
-                        /* The runtime struct only contains the parent
-                         * of the private /tmp, which is
-                         * non-accessible to world users. Inside of it
-                         * there's a /tmp that is sticky, and that's
-                         * the one we want to use here. */
-
-                        if (context->private_tmp && runtime) {
-                                if (runtime->tmp_dir)
-                                        tmp = strappenda(runtime->tmp_dir, "/tmp");
-                                if (runtime->var_tmp_dir)
-                                        var = strappenda(runtime->var_tmp_dir, "/tmp");
+                if (context->capabilities)
+                        if (cap_set_proc(context->capabilities) < 0) {
+                                err = -errno;
+                                r = EXIT_CAPABILITIES;
+                                goto fail;
                         }
 
-                        err = setup_namespace(
-                                        context->read_write_dirs,
-                                        context->read_only_dirs,
-                                        context->inaccessible_dirs,
-                                        tmp,
-                                        var,
-                                        context->mount_flags);
+                if (context->no_new_privileges)
+                        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+                                err = -errno;
+                                r = EXIT_NO_NEW_PRIVILEGES;
+                                goto fail;
+                        }
 
+                if (context->syscall_filter) {
+                        err = apply_seccomp(context->syscall_filter);
                         if (err < 0) {
-                                r = EXIT_NAMESPACE;
-                                goto fail_child;
+                                r = EXIT_SECCOMP;
+                                goto fail;
                         }
                 }
+        }
 
-                if (apply_chroot) {
-                        if (context->root_directory)
-                                if (chroot(context->root_directory) < 0) {
-                                        err = -errno;
-                                        r = EXIT_CHROOT;
-                                        goto fail_child;
-                                }
+        if (shared) {
+                /* Our parent prepared the environment, only the PID
+                 * is left to fill in */
+                if (shared->listen_pid)
+                        snprintf(shared->listen_pid, strlen(shared->listen_pid) + 1,
+                                 "LISTEN_PID=%lu", (unsigned long) shared_getpid());
 
-                        if (chdir(context->working_directory ? context->working_directory : "/") < 0) {
-                                err = -errno;
-                                r = EXIT_CHDIR;
-                                goto fail_child;
-                        }
-                } else {
-                        _cleanup_free_ char *d = NULL;
-
-                        if (asprintf(&d, "%s/%s",
-                                     context->root_directory ? context->root_directory : "",
-                                     context->working_directory ? context->working_directory : "") < 0) {
-                                err = -ENOMEM;
-                                r = EXIT_MEMORY;
-                                goto fail_child;
-                        }
+                execve(command->path, shared->argv, shared->env);
+                err = -errno;
+                r = EXIT_EXEC;
+                goto fail;
+        }
 
-                        if (chdir(d) < 0) {
-                                err = -errno;
-                                r = EXIT_CHDIR;
-                                goto fail_child;
-                        }
-                }
+        our_env = new(char*, 8);
+        if (!our_env ||
+            (n_fds > 0 && (
+                    asprintf(our_env + n_env++, "LISTEN_PID=%lu", (unsigned long) getpid()) < 0 ||
+                    asprintf(our_env + n_env++, "LISTEN_FDS=%u", n_fds) < 0)) ||
+            (home && asprintf(our_env + n_env++, "HOME=%s", home) < 0) ||
+            (username && (
+                    asprintf(our_env + n_env++, "LOGNAME=%s", username) < 0 ||
+                    asprintf(our_env + n_env++, "USER=%s", username) < 0)) ||
+            (shell && asprintf(our_env + n_env++, "SHELL=%s", shell) < 0) ||
+            ((is_terminal_input(context->std_input) ||
+              context->std_output == EXEC_OUTPUT_TTY ||
+              context->std_error == EXEC_OUTPUT_TTY) && (
+                      !(our_env[n_env++] = strdup(default_term_for_tty(tty_path(context))))))) {
+
+                err = -ENOMEM;
+                r = EXIT_MEMORY;
+                goto fail;
+        }
 
-                /* We repeat the fd closing here, to make sure that
-                 * nothing is leaked from the PAM modules */
-                err = close_all_fds(fds, n_fds);
-                if (err >= 0)
-                        err = shift_fds(fds, n_fds);
-                if (err >= 0)
-                        err = flags_fds(fds, n_fds, context->non_blocking);
-                if (err < 0) {
-                        r = EXIT_FDS;
-                        goto fail_child;
+        our_env[n_env++] = NULL;
+        assert(n_env <= 8);
+
+        final_env = strv_env_merge(5,
+                                   environment,
+                                   our_env,
+                                   context->environment,
+                                   files_env,
+                                   pam_env,
+                                   NULL);
+        if (!final_env) {
+                err = -ENOMEM;
+                r = EXIT_MEMORY;
+                goto fail;
+        }
+
+        final_argv = replace_env_argv(argv, final_env);
+        if (!final_argv) {
+                err = -ENOMEM;
+                r = EXIT_MEMORY;
+                goto fail;
+        }
+
+        final_env = strv_env_clean(final_env);
+
+        if (_unlikely_(log_get_max_level() >= LOG_PRI(LOG_DEBUG))) {
+                line = exec_command_line(final_argv);
+                if (line) {
+                        log_open();
+                        log_struct_unit(LOG_DEBUG,
+                                        unit_id,
+                                        "EXECUTABLE=%s", command->path,
+                                        "MESSAGE=Executing: %s", line,
+                                        NULL);
+                        log_close();
+                        free(line);
+                        line = NULL;
                 }
+        }
+        execve(command->path, final_argv, final_env);
+        err = -errno;
+        r = EXIT_EXEC;
 
-                if (apply_permissions) {
+fail:
+        *error = err;
 
-                        for (i = 0; i < RLIMIT_NLIMITS; i++) {
-                                if (!context->rlimit[i])
-                                        continue;
+        if (r != 0 && !shared) {
+                log_open();
+                log_spawn_failure(command, r, err);
+                log_close();
+        }
 
-                                if (setrlimit_closest(i, context->rlimit[i]) < 0) {
-                                        err = -errno;
-                                        r = EXIT_LIMITS;
-                                        goto fail_child;
-                                }
-                        }
+        return r;
+}
 
-                        if (context->capability_bounding_set_drop) {
-                                err = capability_bounding_set_drop(context->capability_bounding_set_drop, false);
-                                if (err < 0) {
-                                        r = EXIT_CAPABILITIES;
-                                        goto fail_child;
-                                }
-                        }
+typedef struct ExecChildArgs {
+        ExecCommand *command;
+        ExecContext *context;
+        int *fds;
+        unsigned n_fds;
+        int socket_fd;
+        char **files_env;
+        bool apply_permissions;
+        bool apply_chroot;
+        bool apply_tty_stdin;
+        CGroupControllerMask cgroup_supported;
+        const char *cgroup_path;
+        const char *unit_id;
+        ExecRuntime *runtime;
+        ExecShared shared;
+
+        int exit_status;   /* Set only if the child did not execve() */
+        int error;
+} ExecChildArgs;
+
+static int exec_child_shared(void *userdata) {
+        ExecChildArgs *a = userdata;
+
+        a->exit_status = exec_child(a->command, a->shared.argv, a->context,
+                                    a->fds, a->n_fds, a->socket_fd,
+                                    NULL, a->files_env,
+                                    a->apply_permissions, a->apply_chroot, a->apply_tty_stdin, false,
+                                    a->cgroup_supported, a->cgroup_path, a->unit_id,
+                                    NULL, a->runtime,
+                                    &a->shared, &a->error);
+        _exit(a->exit_status);
+}
 
-                        if (context->user) {
-                                err = enforce_user(context, uid);
-                                if (err < 0) {
-                                        r = EXIT_USER;
-                                        goto fail_child;
-                                }
-                        }
+static bool is_logger_output(ExecOutput o) {
+        return
+                o == EXEC_OUTPUT_SYSLOG ||
+                o == EXEC_OUTPUT_SYSLOG_AND_CONSOLE ||
+                o == EXEC_OUTPUT_KMSG ||
+                o == EXEC_OUTPUT_KMSG_AND_CONSOLE ||
+                o == EXEC_OUTPUT_JOURNAL ||
+                o == EXEC_OUTPUT_JOURNAL_AND_CONSOLE;
+}
 
-                        /* PR_GET_SECUREBITS is not privileged, while
-                         * PR_SET_SECUREBITS is. So to suppress
-                         * potential EPERMs we'll try not to call
-                         * PR_SET_SECUREBITS unless necessary. */
-                        if (prctl(PR_GET_SECUREBITS) != context->secure_bits)
-                                if (prctl(PR_SET_SECUREBITS, context->secure_bits) < 0) {
-                                        err = -errno;
-                                        r = EXIT_SECUREBITS;
-                                        goto fail_child;
-                                }
+static bool fstype_may_block(const char *fstype) {
+        return
+                streq(fstype, "autofs") ||
+                startswith(fstype, "fuse") ||
+                fstype_is_network(fstype);
+}
 
-                        if (context->capabilities)
-                                if (cap_set_proc(context->capabilities) < 0) {
-                                        err = -errno;
-                                        r = EXIT_CAPABILITIES;
-                                        goto fail_child;
-                                }
+static int update_blocking_mounts(void) {
+        _cleanup_strv_free_ char **l = NULL;
+        struct pollfd pollfd = {
+                .events = POLLPRI,
+        };
+        int r;
 
-                        if (context->no_new_privileges)
-                                if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
-                                        err = -errno;
-                                        r = EXIT_NO_NEW_PRIVILEGES;
-                                        goto fail_child;
-                                }
+        if (exec_mountinfo) {
+                /* The mount table signals changes with POLLPRI */
+                pollfd.fd = fileno(exec_mountinfo);
+                r = poll(&pollfd, 1, 0);
+                if (r < 0)
+                        return -errno;
+                if (r == 0)
+                        return 0;
 
-                        if (context->syscall_filter) {
-                                err = apply_seccomp(context->syscall_filter);
-                                if (err < 0) {
-                                        r = EXIT_SECCOMP;
-                                        goto fail_child;
-                                }
-                        }
-                }
+                rewind(exec_mountinfo);
+        } else {
+                exec_mountinfo = fopen("/proc/self/mountinfo", "re");
+                if (!exec_mountinfo)
+                        return -errno;
+        }
 
-                our_env = new(char*, 8);
-                if (!our_env ||
-                    (n_fds > 0 && (
-                            asprintf(our_env + n_env++, "LISTEN_PID=%lu", (unsigned long) getpid()) < 0 ||
-                            asprintf(our_env + n_env++, "LISTEN_FDS=%u", n_fds) < 0)) ||
-                    (home && asprintf(our_env + n_env++, "HOME=%s", home) < 0) ||
-                    (username && (
-                            asprintf(our_env + n_env++, "LOGNAME=%s", username) < 0 ||
-                            asprintf(our_env + n_env++, "USER=%s", username) < 0)) ||
-                    (shell && asprintf(our_env + n_env++, "SHELL=%s", shell) < 0) ||
-                    ((is_terminal_input(context->std_input) ||
-                      context->std_output == EXEC_OUTPUT_TTY ||
-                      context->std_error == EXEC_OUTPUT_TTY) && (
-                              !(our_env[n_env++] = strdup(default_term_for_tty(tty_path(context))))))) {
+        for (;;) {
+                _cleanup_free_ char *path = NULL, *fstype = NULL;
+                char *p;
+                int k;
 
-                        err = -ENOMEM;
-                        r = EXIT_MEMORY;
-                        goto fail_child;
-                }
+                k = fscanf(exec_mountinfo,
+                           "%*s "       /* (1) mount id */
+                           "%*s "       /* (2) parent id */
+                           "%*s "       /* (3) major:minor */
+                           "%*s "       /* (4) root */
+                           "%ms "       /* (5) mount point */
+                           "%*s"        /* (6) mount options */
+                           "%*[^-]"     /* (7) optional fields */
+                           "- "         /* (8) separator */
+                           "%ms"        /* (9) file system type */
+                           "%*[^\n]",   /* some rubbish at the end */
+                           &path,
+                           &fstype);
+                if (k == EOF)
+                        break;
 
-                our_env[n_env++] = NULL;
-                assert(n_env <= 8);
-
-                final_env = strv_env_merge(5,
-                                           environment,
-                                           our_env,
-                                           context->environment,
-                                           files_env,
-                                           pam_env,
-                                           NULL);
-                if (!final_env) {
-                        err = -ENOMEM;
-                        r = EXIT_MEMORY;
-                        goto fail_child;
-                }
+                if (k != 2 || !fstype_may_block(fstype))
+                        continue;
 
-                final_argv = replace_env_argv(argv, final_env);
-                if (!final_argv) {
-                        err = -ENOMEM;
-                        r = EXIT_MEMORY;
-                        goto fail_child;
+                p = cunescape(path);
+                if (!p || strv_push(&l, p) < 0) {
+                        free(p);
+
+                        /* Nothing is known to be safe anymore */
+                        strv_free(exec_blocking_mounts);
+                        exec_blocking_mounts = NULL;
+                        fclose(exec_mountinfo);
+                        exec_mountinfo = NULL;
+                        return -ENOMEM;
                 }
+        }
 
-                final_env = strv_env_clean(final_env);
-
-                if (_unlikely_(log_get_max_level() >= LOG_PRI(LOG_DEBUG))) {
-                        line = exec_command_line(final_argv);
-                        if (line) {
-                                log_open();
-                                log_struct_unit(LOG_DEBUG,
-                                                unit_id,
-                                                "EXECUTABLE=%s", command->path,
-                                                "MESSAGE=Executing: %s", line,
-                                                NULL);
-                                log_close();
-                                free(line);
-                                line = NULL;
-                        }
+        strv_free(exec_blocking_mounts);
+        exec_blocking_mounts = l;
+        l = NULL;
+
+        return 0;
+}
+
+static bool exec_path_is_safe(const char *path, bool executable, unsigned depth);
+
+/* Checks the interpreter the kernel looks up when executing path */
+static bool exec_interpreter_is_safe(const char *path, unsigned depth) {
+        _cleanup_close_ int fd = -1;
+        char buf[128];
+        ElfW(Ehdr) *h = (ElfW(Ehdr)*) buf;
+        struct stat st;
+        ssize_t n;
+        unsigned i;
+
+        assert_cc(sizeof(buf) >= sizeof(ElfW(Ehdr)));
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NONBLOCK);
+        if (fd < 0)
+                /* execve() will fail right away */
+                return errno == ENOENT;
+
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+                return false;
+
+        n = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (n < 0)
+                return false;
+        buf[n] = 0;
+
+        if (n >= 2 && buf[0] == '#' && buf[1] == '!') {
+                char *e;
+
+                e = buf + 2 + strspn(buf + 2, " \t");
+                e[strcspn(e, " \t\n")] = 0;
+
+                return exec_path_is_safe(e, true, depth + 1);
+        }
+
+        /* Anything else but native ELF binaries might be handled by
+         * binfmt_misc, with an interpreter we don't know about */
+        if ((size_t) n < sizeof(ElfW(Ehdr)) ||
+            memcmp(h->e_ident, ELFMAG, SELFMAG) != 0 ||
+            h->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+            h->e_ident[EI_DATA] != (__BYTE_ORDER == __LITTLE_ENDIAN ? ELFDATA2LSB : ELFDATA2MSB) ||
+            h->e_phentsize != sizeof(ElfW(Phdr)))
+                return false;
+
+        for (i = 0; i < h->e_phnum; i++) {
+                ElfW(Phdr) ph;
+                char interp[PATH_MAX];
+
+                if (pread(fd, &ph, sizeof(ph), h->e_phoff + i * sizeof(ph)) != sizeof(ph))
+                        return false;
+
+                if (ph.p_type != PT_INTERP)
+                        continue;
+
+                if (ph.p_filesz <= 1 || ph.p_filesz > sizeof(interp) ||
+                    pread(fd, interp, ph.p_filesz, ph.p_offset) != (ssize_t) ph.p_filesz ||
+                    interp[ph.p_filesz - 1] != 0)
+                        return false;
+
+                return exec_path_is_safe(interp, false, depth + 1);
+        }
+
+        /* Statically linked */
+        return true;
+}
+
+/* Checks whether looking up path, and for an executable, its
+ * interpreter, cannot block. Symlinks are followed by hand, so that we
+ * only look at what is below mounts that don't block. */
+static bool exec_path_is_safe(const char *path, bool executable, unsigned depth) {
+        _cleanup_free_ char *p = NULL;
+        char **m, *slash;
+
+        assert(path);
+
+        if (depth > EXEC_SHARED_PATH_DEPTH_MAX)
+                return false;
+
+        if (!path_is_absolute(path))
+                return false;
+
+        p = strdup(path);
+        if (!p)
+                return false;
+
+        path_kill_slashes(p);
+
+        /* Don't bother with normalizing these */
+        if (strstr(p, "/./") || strstr(p, "/../") || endswith(p, "/.") || endswith(p, "/.."))
+                return false;
+
+        STRV_FOREACH(m, exec_blocking_mounts)
+                if (path_startswith(p, *m))
+                        return false;
+
+        for (slash = strchr(p + 1, '/');; slash = strchr(slash + 1, '/')) {
+                _cleanup_free_ char *target = NULL, *parent = NULL, *resolved = NULL;
+                int r;
+
+                if (slash)
+                        *slash = 0;
+                r = readlink_malloc(p, &target);
+                if (r == -EINVAL) {
+                        /* Not a symlink */
+                        if (!slash)
+                                break;
+
+                        *slash = '/';
+                        continue;
                 }
-                execve(command->path, final_argv, final_env);
-                err = -errno;
-                r = EXIT_EXEC;
+                if (r == -ENOENT)
+                        /* The lookup will fail right away */
+                        return true;
+                if (r < 0)
+                        return false;
 
-        fail_child:
-                if (r != 0) {
-                        log_open();
-                        log_struct(LOG_ERR, MESSAGE_ID(SD_MESSAGE_SPAWN_FAILED),
-                                   "EXECUTABLE=%s", command->path,
-                                   "MESSAGE=Failed at step %s spawning %s: %s",
-                                          exit_status_to_string(r, EXIT_STATUS_SYSTEMD),
-                                          command->path, strerror(-err),
-                                   "ERRNO=%d", -err,
+                if (path_is_absolute(target))
+                        resolved = strjoin(target, "/", slash ? slash + 1 : "", NULL);
+                else if (path_get_parent(p, &parent) >= 0)
+                        resolved = strjoin(parent, "/", target, "/", slash ? slash + 1 : "", NULL);
+                if (!resolved)
+                        return false;
+
+                /* Drop the trailing slash again, the target might
+                 * not be a directory */
+                if (!slash)
+                        resolved[strlen(resolved) - 1] = 0;
+
+                return exec_path_is_safe(resolved, executable, depth + 1);
+        }
+
+        if (executable)
+                return exec_interpreter_is_safe(p, depth);
+
+        return true;
+}
+
+static bool exec_can_share_memory(const ExecCommand *command, const ExecContext *context, char **argv, bool confirm_spawn, int idle_pipe[4]) {
+        char **i;
+
+        assert(command);
+        assert(context);
+
+        /* Everything that looks up users or groups via NSS, talks to
+         * PAM or a terminal, sets up namespaces or might block for
+         * long has to be done in a child of its own. */
+
+        if (confirm_spawn || idle_pipe)
+                return false;
+
+        if (context->user || context->group || !strv_isempty(context->supplementary_groups) ||
+            context->pam_name || context->tcpwrap_name || context->utmp_id)
+                return false;
+
+        if (context->tty_path || context->tty_reset || context->tty_vhangup || context->tty_vt_disallocate ||
+            is_terminal_input(context->std_input) ||
+            context->std_output == EXEC_OUTPUT_TTY ||
+            context->std_error == EXEC_OUTPUT_TTY)
+                return false;
+
+        if (!strv_isempty(context->read_write_dirs) ||
+            !strv_isempty(context->read_only_dirs) ||
+            !strv_isempty(context->inaccessible_dirs) ||
+            context->mount_flags != 0 ||
+            context->private_tmp ||
+            context->private_network)
+                return false;
+
+        /* We only know our PID once we are running */
+        STRV_FOREACH(i, argv)
+                if (strstr(*i, "LISTEN_PID"))
+                        return false;
+
+        /* We are suspended while the child looks up its working
+         * directory and binary. If that triggers an automount, which
+         * we would have to handle, or hangs on a network file system,
+         * so do we. Paths in another root are not checked. */
+        if (context->root_directory)
+                return false;
+
+        if (update_blocking_mounts() < 0)
+                return false;
+
+        if (context->working_directory &&
+            !exec_path_is_safe(context->working_directory, false, 0))
+                return false;
+
+        return exec_path_is_safe(command->path, true, 0);
+}
+
+/* Spawns the child with clone(CLONE_VM|CLONE_VFORK), which does not
+ * copy our page tables as fork() does. We are suspended until the child
+ * called execve() or exited. Returns 0 if the child could not be spawned
+ * this way, and nothing was done yet. */
+static int exec_spawn_shared(ExecCommand *command,
+                             char **argv,
+                             ExecContext *context,
+                             int fds[], unsigned n_fds,
+                             int socket_fd,
+                             char **environment,
+                             char **files_env,
+                             bool apply_permissions,
+                             bool apply_chroot,
+                             bool apply_tty_stdin,
+                             CGroupControllerMask cgroup_supported,
+                             const char *cgroup_path,
+                             const char *unit_id,
+                             ExecRuntime *runtime,
+                             pid_t *ret) {
+
+        _cleanup_strv_free_ char **our_env = NULL, **final_env = NULL, **final_argv = NULL;
+        _cleanup_free_ void *stack = NULL;
+        ExecChildArgs a = {
+                .command = command,
+                .context = context,
+                .fds = fds,
+                .n_fds = n_fds,
+                .socket_fd = socket_fd,
+                .files_env = files_env,
+                .apply_permissions = apply_permissions,
+                .apply_chroot = apply_chroot,
+                .apply_tty_stdin = apply_tty_stdin,
+                .cgroup_supported = cgroup_supported,
+                .cgroup_path = cgroup_path,
+                .unit_id = unit_id,
+                .runtime = runtime,
+                .shared.stdout_fd = -1,
+                .shared.stderr_fd = -1,
+                .exit_status = -1,
+        };
+        ExecOutput o, e;
+        unsigned n_env = 0;
+        char **i;
+        pid_t pid;
+        int r = 0;
+
+        o = fixup_output(context->std_output, socket_fd);
+        e = fixup_output(context->std_error, socket_fd);
+
+        /* Connecting to the journal might block, which the child must
+         * not do while we are suspended, so we do it ourselves, and
+         * leave it to fork() if the journal is not keeping up */
+        if (is_logger_output(o)) {
+                a.shared.stdout_fd = connect_logger(context, o, path_get_file_name(command->path), unit_id, true);
+                if (a.shared.stdout_fd < 0)
+                        goto finish;
+        }
+
+        if (is_logger_output(e) && e != o) {
+                a.shared.stderr_fd = connect_logger(context, e, path_get_file_name(command->path), unit_id, true);
+                if (a.shared.stderr_fd < 0)
+                        goto finish;
+        }
+
+        our_env = new0(char*, 3);
+        if (!our_env ||
+            (n_fds > 0 && (
+                    asprintf(our_env + n_env++, "LISTEN_PID=%0*lu", (int) DECIMAL_STR_MAX(pid_t) - 1, 0UL) < 0 ||
+                    asprintf(our_env + n_env++, "LISTEN_FDS=%u", n_fds) < 0))) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        final_env = strv_env_merge(4,
+                                   environment,
+                                   our_env,
+                                   context->environment,
+                                   files_env,
                                    NULL);
-                        log_close();
-                }
+        if (!final_env) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        final_argv = replace_env_argv(argv, final_env);
+        if (!final_argv) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        final_env = strv_env_clean(final_env);
+
+        if (n_fds > 0)
+                STRV_FOREACH(i, final_env)
+                        if (streq(*i, our_env[0]))
+                                a.shared.listen_pid = *i;
+
+        a.shared.argv = final_argv;
+        a.shared.env = final_env;
+
+        if (_unlikely_(log_get_max_level() >= LOG_PRI(LOG_DEBUG))) {
+                _cleanup_free_ char *line = NULL;
+
+                line = exec_command_line(final_argv);
+                if (line)
+                        log_struct_unit(LOG_DEBUG,
+                                        unit_id,
+                                        "EXECUTABLE=%s", command->path,
+                                        "MESSAGE=Executing: %s", line,
+                                        NULL);
+        }
+
+        stack = malloc(EXEC_SHARED_STACK_SIZE);
+        if (!stack) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        /* The stack grows downwards on all architectures we care
+         * about */
+        pid = clone(exec_child_shared, (uint8_t*) stack + EXEC_SHARED_STACK_SIZE,
+                    CLONE_VM|CLONE_VFORK|SIGCHLD, &a);
+        if (pid < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        if (a.exit_status > 0)
+                log_spawn_failure(command, a.exit_status, a.error);
+
+        *ret = pid;
+        r = 1;
+
+finish:
+        if (a.shared.stdout_fd >= 0)
+                close_nointr_nofail(a.shared.stdout_fd);
+        if (a.shared.stderr_fd >= 0)
+                close_nointr_nofail(a.shared.stderr_fd);
+
+        return r;
+}
+
+int exec_spawn(ExecCommand *command,
+               char **argv,
+               ExecContext *context,
+               int fds[], unsigned n_fds,
+               char **environment,
+               bool apply_permissions,
+               bool apply_chroot,
+               bool apply_tty_stdin,
+               bool confirm_spawn,
+               CGroupControllerMask cgroup_supported,
+               const char *cgroup_path,
+               const char *unit_id,
+               int idle_pipe[4],
+               ExecRuntime *runtime,
+               pid_t *ret) {
+
+        _cleanup_strv_free_ char **files_env = NULL;
+        int socket_fd;
+        char *line;
+        pid_t pid;
+        int r;
+
+        assert(command);
+        assert(context);
+        assert(ret);
+        assert(fds || n_fds <= 0);
 
+        if (context->std_input == EXEC_INPUT_SOCKET ||
+            context->std_output == EXEC_OUTPUT_SOCKET ||
+            context->std_error == EXEC_OUTPUT_SOCKET) {
+
+                if (n_fds != 1)
+                        return -EINVAL;
+
+                socket_fd = fds[0];
+
+                fds = NULL;
+                n_fds = 0;
+        } else
+                socket_fd = -1;
+
+        r = exec_context_load_environment(context, &files_env);
+        if (r < 0) {
+                log_struct_unit(LOG_ERR,
+                           unit_id,
+                           "MESSAGE=Failed to load environment files: %s", strerror(-r),
+                           "ERRNO=%d", -r,
+                           NULL);
+                return r;
+        }
+
+        if (!argv)
+                argv = command->argv;
+
+        line = exec_command_line(argv);
+        if (!line)
+                return log_oom();
+
+        log_struct_unit(LOG_DEBUG,
+                        unit_id,
+                        "EXECUTABLE=%s", command->path,
+                        "MESSAGE=About to execute: %s", line,
+                        NULL);
+        free(line);
+
+        if (exec_can_share_memory(command, context, argv, confirm_spawn, idle_pipe)) {
+                r = exec_spawn_shared(command, argv, context, fds, n_fds, socket_fd,
+                                      environment, files_env,
+                                      apply_permissions, apply_chroot, apply_tty_stdin,
+                                      cgroup_supported, cgroup_path, unit_id, runtime, &pid);
+                if (r > 0)
+                        goto spawned;
+                if (r < 0)
+                        return r;
+        }
+
+        pid = fork();
+        if (pid < 0)
+                return -errno;
+
+        if (pid == 0) {
+                int err;
+
+                r = exec_child(command, argv, context,
+                               fds, n_fds, socket_fd,
+                               environment, files_env,
+                               apply_permissions, apply_chroot, apply_tty_stdin, confirm_spawn,
+                               cgroup_supported, cgroup_path, unit_id,
+                               idle_pipe, runtime,
+                               NULL, &err);
                 _exit(r);
         }
 
+spawned:
         log_struct_unit(LOG_DEBUG,
                         unit_id,
                         "MESSAGE=Forked %s as %lu",
@@ -424,7 +424,7 @@ static bool job_is_runnable(Job *j) {
                  * dependencies, regardless whether they are
                  * starting or stopping something. */
 
-                SET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i)
+                PTRSET_FOREACH(other, j->unit->dependencies[UNIT_AFTER], i)
                         if (other->job)
                                 return false;
         }
@@ -432,7 +432,7 @@ static bool job_is_runnable(Job *j) {
         /* Also, if something else is being stopped and we should
          * change state after it, then lets wait. */
 
-        SET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i)
+        PTRSET_FOREACH(other, j->unit->dependencies[UNIT_BEFORE], i)
                 if (other->job &&
                     (other->job->type == JOB_STOP ||
                      other->job->type == JOB_RESTART))
@@ -778,19 +778,19 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive) {
                 if (t == JOB_START ||
                     t == JOB_VERIFY_ACTIVE) {
 
-                        SET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY], i)
+                        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY], i)
                                 if (other->job &&
                                     (other->job->type == JOB_START ||
                                      other->job->type == JOB_VERIFY_ACTIVE))
                                         job_finish_and_invalidate(other->job, JOB_DEPENDENCY, true);
 
-                        SET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
+                        PTRSET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
                                 if (other->job &&
                                     (other->job->type == JOB_START ||
                                      other->job->type == JOB_VERIFY_ACTIVE))
                                         job_finish_and_invalidate(other->job, JOB_DEPENDENCY, true);
 
-                        SET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY_OVERRIDABLE], i)
+                        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY_OVERRIDABLE], i)
                                 if (other->job &&
                                     !other->job->override &&
                                     (other->job->type == JOB_START ||
@@ -799,7 +799,7 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive) {
 
                 } else if (t == JOB_STOP) {
 
-                        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
+                        PTRSET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
                                 if (other->job &&
                                     (other->job->type == JOB_START ||
                                      other->job->type == JOB_VERIFY_ACTIVE))
@@ -829,10 +829,10 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive) {
 
 finish:
         /* Try to start the next jobs that can be started */
-        SET_FOREACH(other, u->dependencies[UNIT_AFTER], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_AFTER], i)
                 if (other->job)
                         job_add_to_run_queue(other->job);
-        SET_FOREACH(other, u->dependencies[UNIT_BEFORE], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_BEFORE], i)
                 if (other->job)
                         job_add_to_run_queue(other->job);
 
@@ -210,9 +210,14 @@ int unit_load_dropin(Unit *u) {
                 return 0;
 
         STRV_FOREACH(f, u->dropin_paths) {
-                r = config_parse(u->id, *f, NULL,
-                                 UNIT_VTABLE(u)->sections, config_item_perf_lookup,
-                                 (void*) load_fragment_gperf_lookup, false, false, u);
+                if (u->manager->unit_cache)
+                        r = unit_cache_parse(u->manager->unit_cache, u->id, *f, NULL,
+                                             UNIT_VTABLE(u)->sections, config_item_perf_lookup,
+                                             (void*) load_fragment_gperf_lookup, false, u);
+                else
+                        r = config_parse(u->id, *f, NULL,
+                                         UNIT_VTABLE(u)->sections, config_item_perf_lookup,
+                                         (void*) load_fragment_gperf_lookup, false, false, u);
                 if (r < 0)
                         return r;
         }
@@ -1226,7 +1226,7 @@ int config_parse_trigger_unit(
         assert(rvalue);
         assert(data);
 
-        if (!set_isempty(u->dependencies[UNIT_TRIGGERS])) {
+        if (!ptrset_isempty(u->dependencies[UNIT_TRIGGERS])) {
                 log_syntax(unit, LOG_ERR, filename, line, EINVAL,
                            "Multiple units to trigger specified, ignoring: %s", rvalue);
                 return 0;
@@ -2607,10 +2607,16 @@ static int load_from_path(Unit *u, const char *path) {
         else {
                 u->load_state = UNIT_LOADED;
 
-                /* Now, parse the file contents */
-                r = config_parse(u->id, filename, f, UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup,
-                                 (void*) load_fragment_gperf_lookup, false, true, u);
+                /* Now, parse the file contents, or replay them
+                 * from the cache if the file did not change */
+                if (u->manager->unit_cache)
+                        r = unit_cache_parse(u->manager->unit_cache, u->id, filename, f,
+                                             UNIT_VTABLE(u)->sections, config_item_perf_lookup,
+                                             (void*) load_fragment_gperf_lookup, true, u);
+                else
+                        r = config_parse(u->id, filename, f, UNIT_VTABLE(u)->sections,
+                                         config_item_perf_lookup,
+                                         (void*) load_fragment_gperf_lookup, false, true, u);
                 if (r < 0)
                         return r;
         }
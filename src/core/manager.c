@@ -77,6 +77,7 @@
 #include "dbus-job.h"
 #include "dbus-manager.h"
 #include "bus-kernel.h"
+#include "fileio.h"
 
 /* As soon as 5s passed since a unit was added to our GC queue, make sure to run a gc sweep */
 #define GC_QUEUE_USEC_MAX (10*USEC_PER_SEC)
@@ -97,6 +98,7 @@ static int manager_dispatch_time_change_fd(sd_event_source *source, int fd, uint
 static int manager_dispatch_idle_pipe_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_jobs_in_progress(sd_event_source *source, usec_t usec, void *userdata);
 static int manager_dispatch_run_queue(sd_event_source *source, void *userdata);
+static void manager_free_generator_timings(Manager *m);
 
 static int manager_setup_notify(Manager *m) {
         union {
@@ -470,7 +472,7 @@ int manager_new(SystemdRunningAs running_as, Manager **_m) {
 
         m->idle_pipe[0] = m->idle_pipe[1] = m->idle_pipe[2] = m->idle_pipe[3] = -1;
 
-        m->pin_cgroupfs_fd = m->notify_fd = m->signal_fd = m->time_change_fd = m->dev_autofs_fd = m->private_listen_fd = m->kdbus_fd = -1;
+        m->pin_cgroupfs_fd = m->cgroups_agent_fd = m->notify_fd = m->signal_fd = m->time_change_fd = m->dev_autofs_fd = m->private_listen_fd = m->kdbus_fd = -1;
         m->current_job_id = 1; /* start as id #1, so that we can leave #0 around as "null-like" value */
 
         r = manager_default_environment(m);
@@ -545,7 +547,7 @@ fail:
         return r;
 }
 
-static unsigned manager_dispatch_cleanup_queue(Manager *m) {
+unsigned manager_dispatch_cleanup_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
 
@@ -569,6 +571,19 @@ enum {
         _GC_OFFSET_MAX
 };
 
+static void unit_gc_collect(Unit *u, unsigned gc_marker) {
+        assert(u);
+
+        u->gc_marker = gc_marker + GC_OFFSET_BAD;
+
+        if (u->in_cleanup_queue)
+                return;
+
+        log_debug_unit(u->id, "Collecting %s", u->id);
+        unit_add_to_cleanup_queue(u);
+        u->manager->n_gc_collected++;
+}
+
 static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
         Iterator i;
         Unit *other;
@@ -576,11 +591,17 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         assert(u);
 
+        /* Verdicts stay valid for the whole GC run, which may span
+         * several batches. Units whose state changes in between are
+         * put back in the GC queue, which drops their verdict. */
         if (u->gc_marker == gc_marker + GC_OFFSET_GOOD ||
             u->gc_marker == gc_marker + GC_OFFSET_BAD ||
             u->gc_marker == gc_marker + GC_OFFSET_IN_PATH)
                 return;
 
+        u->manager->n_gc_examined++;
+        u->manager->n_gc_batch++;
+
         if (u->in_cleanup_queue)
                 goto bad;
 
@@ -591,7 +612,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        SET_FOREACH(other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REFERENCED_BY], i) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -606,55 +627,72 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         /* We were unable to find anything out about this entry, so
          * let's investigate it later */
-        u->gc_marker = gc_marker + GC_OFFSET_UNSURE;
         unit_add_to_gc_queue(u);
+        u->gc_marker = gc_marker + GC_OFFSET_UNSURE;
         return;
 
 bad:
         /* We definitely know that this one is not useful anymore, so
          * let's mark it for deletion */
-        u->gc_marker = gc_marker + GC_OFFSET_BAD;
-        unit_add_to_cleanup_queue(u);
+        unit_gc_collect(u, gc_marker);
         return;
 
 good:
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 }
 
-static unsigned manager_dispatch_gc_queue(Manager *m) {
+unsigned manager_dispatch_gc_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
         unsigned gc_marker;
 
         assert(m);
 
-        /* log_debug("Running GC..."); */
+        /* Only start a new generation if the previous run is
+         * complete, so that what we learnt in earlier batches is
+         * reused */
+        if (!m->gc_in_progress) {
+                if (!m->gc_queue)
+                        return 0;
+
+                m->gc_marker += _GC_OFFSET_MAX;
+                if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
+                        m->gc_marker = 1;
 
-        m->gc_marker += _GC_OFFSET_MAX;
-        if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
-                m->gc_marker = 1;
+                m->gc_in_progress = true;
+        }
 
         gc_marker = m->gc_marker;
+        m->n_gc_batch = 0;
 
         while ((u = m->gc_queue)) {
                 assert(u->in_gc_queue);
 
+                /* Don't block the event loop for too long during
+                 * mass teardown, continue with the next batch after
+                 * the next iteration */
+                if (m->n_gc_batch >= GC_QUEUE_BATCH_MAX)
+                        return n;
+
                 unit_gc_sweep(u, gc_marker);
 
                 LIST_REMOVE(gc_queue, m->gc_queue, u);
                 u->in_gc_queue = false;
+                m->n_in_gc_queue--;
 
                 n++;
 
                 if (u->gc_marker == gc_marker + GC_OFFSET_BAD ||
-                    u->gc_marker == gc_marker + GC_OFFSET_UNSURE) {
-                        log_debug_unit(u->id, "Collecting %s", u->id);
-                        u->gc_marker = gc_marker + GC_OFFSET_BAD;
-                        unit_add_to_cleanup_queue(u);
-                }
+                    u->gc_marker == gc_marker + GC_OFFSET_UNSURE)
+                        unit_gc_collect(u, gc_marker);
         }
 
-        m->n_in_gc_queue = 0;
+        assert(m->n_in_gc_queue == 0);
+        m->gc_in_progress = false;
+
+        if (n > 0)
+                log_debug("GC run complete, %" PRIu64 " units examined, %" PRIu64 " collected so far.",
+                          m->n_gc_examined, m->n_gc_collected);
 
         return n;
 }
@@ -675,6 +713,7 @@ static void manager_clear_jobs_and_units(Manager *m) {
         assert(!m->dbus_job_queue);
         assert(!m->cleanup_queue);
         assert(!m->gc_queue);
+        m->gc_in_progress = false;
 
         assert(hashmap_isempty(m->jobs));
         assert(hashmap_isempty(m->units));
@@ -700,6 +739,7 @@ void manager_free(Manager *m) {
         manager_shutdown_cgroup(m, m->exit_code != MANAGER_REEXECUTE);
 
         manager_undo_generators(m);
+        manager_free_generator_timings(m);
 
         bus_done(m);
 
@@ -736,6 +776,8 @@ void manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        set_free_free(m->unit_path_snapshot);
+        unit_cache_free(m->unit_cache);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -790,6 +832,53 @@ static int manager_coldplug(Manager *m) {
         return r;
 }
 
+static void manager_open_unit_cache(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->unit_cache || m->running_as != SYSTEMD_SYSTEM)
+                return;
+
+        r = unit_cache_new(&m->unit_cache, "/run/systemd/unit-cache");
+        if (r < 0)
+                log_warning("Failed to allocate unit file cache: %s", strerror(-r));
+}
+
+/* Drop-in, .wants and .requires directories are part of the snapshot
+ * of the unit directories for incremental reloading */
+static int manager_add_unit_path_subdir(Manager *m, const char *path) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        if (!endswith(path, ".wants") &&
+            !endswith(path, ".requires") &&
+            !endswith(path, ".d"))
+                return 0;
+
+        d = opendir(path);
+        if (!d)
+                return errno == ENOTDIR || errno == ENOENT ? 0 : -errno;
+
+        while ((de = readdir(d))) {
+                char *p;
+
+                if (ignore_file(de->d_name))
+                        continue;
+
+                p = strjoin(path, "/", de->d_name, NULL);
+                if (!p)
+                        return -ENOMEM;
+
+                r = set_consume(m->unit_path_cache, p);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static void manager_build_unit_path_cache(Manager *m) {
         char **i;
         _cleanup_free_ DIR *d = NULL;
@@ -833,6 +922,12 @@ static void manager_build_unit_path_cache(Manager *m) {
                         r = set_consume(m->unit_path_cache, p);
                         if (r < 0)
                                 goto fail;
+
+                        if (m->incremental_reload) {
+                                r = manager_add_unit_path_subdir(m, p);
+                                if (r < 0)
+                                        goto fail;
+                        }
                 }
 
                 closedir(d);
@@ -889,6 +984,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                 return r;
 
         manager_build_unit_path_cache(m);
+        manager_open_unit_cache(m);
 
         /* If we will deserialize make sure that during enumeration
          * this is already known, so we increase the counter here
@@ -928,6 +1024,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         if (q < 0)
                 r = q;
 
+        /* Remember what we parsed for the next reload */
+        if (m->unit_cache)
+                unit_cache_flush(m->unit_cache);
+
         if (serialization) {
                 assert(m->n_reloading > 0);
                 m->n_reloading --;
@@ -1393,6 +1493,10 @@ static int manager_dispatch_sigchld(Manager *m) {
 
                 hashmap_remove(m->watch_pids, LONG_TO_PTR(si.si_pid));
                 UNIT_VTABLE(u)->sigchld_event(u, si.si_pid, si.si_code, si.si_status);
+
+                /* Most cgroups run empty when a child of ours dies,
+                 * don't wait for the release agent to tell us */
+                unit_add_to_cgroup_empty_queue(u);
         }
 
         return 0;
@@ -1697,8 +1801,14 @@ int manager_loop(Manager *m) {
         assert(m);
         m->exit_code = MANAGER_RUNNING;
 
-        /* Release the path cache */
-        set_free_free(m->unit_path_cache);
+        /* Release the path cache, or keep it to compare it with the
+         * unit directories on the next reload */
+        set_free_free(m->unit_path_snapshot);
+        m->unit_path_snapshot = NULL;
+        if (m->incremental_reload)
+                m->unit_path_snapshot = m->unit_path_cache;
+        else
+                set_free_free(m->unit_path_cache);
         m->unit_path_cache = NULL;
 
         manager_check_finished(m);
@@ -1725,13 +1835,18 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_load_queue(m) > 0)
                         continue;
 
+                /* GC runs in batches, with the event loop run in
+                 * between. Free what a batch found right away rather
+                 * than starting over. */
                 if (manager_dispatch_gc_queue(m) > 0)
+                        manager_dispatch_cleanup_queue(m);
+                else if (manager_dispatch_cleanup_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_cleanup_queue(m) > 0)
+                if (manager_dispatch_cgroup_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_cgroup_queue(m) > 0)
+                if (manager_dispatch_cgroup_empty_queue(m) > 0)
                         continue;
 
                 if (manager_dispatch_dbus_queue(m) > 0)
@@ -1745,6 +1860,10 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = (usec_t) -1;
 
+                /* Only poll if the GC run isn't complete yet */
+                if (m->gc_queue)
+                        wait_usec = 0;
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0) {
                         log_error("Failed to run event loop: %s", strerror(-r));
@@ -2222,20 +2341,488 @@ finish:
         return r;
 }
 
-int manager_reload(Manager *m) {
-        int r, q;
+/* Regenerated files with unchanged contents get the timestamps of their
+ * previous versions, so that their units do not appear changed */
+static void keep_generator_timestamps(const char *old, const char *new) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+
+        d = opendir(new);
+        if (!d)
+                return;
+
+        FOREACH_DIRENT(de, d, return) {
+                _cleanup_free_ char *o = NULL, *n = NULL, *a = NULL, *b = NULL;
+                struct stat st_old, st_new;
+                struct timespec ts[2];
+                size_t a_size, b_size;
+
+                o = strjoin(old, "/", de->d_name, NULL);
+                n = strjoin(new, "/", de->d_name, NULL);
+                if (!o || !n) {
+                        log_oom();
+                        return;
+                }
+
+                if (lstat(o, &st_old) < 0 || lstat(n, &st_new) < 0)
+                        continue;
+
+                if (S_ISDIR(st_old.st_mode) && S_ISDIR(st_new.st_mode)) {
+                        keep_generator_timestamps(o, n);
+                        continue;
+                }
+
+                if (!S_ISREG(st_old.st_mode) || !S_ISREG(st_new.st_mode) ||
+                    st_old.st_size != st_new.st_size)
+                        continue;
+
+                if (read_full_file(o, &a, &a_size) < 0 ||
+                    read_full_file(n, &b, &b_size) < 0)
+                        continue;
+
+                if (a_size != b_size || memcmp(a, b, a_size) != 0)
+                        continue;
+
+                ts[0] = st_old.st_atim;
+                ts[1] = st_old.st_mtim;
+                if (utimensat(AT_FDCWD, n, ts, 0) < 0)
+                        log_debug("Failed to set timestamps of %s: %m", n);
+        }
+}
+
+static void manager_stash_generators(Manager *m, char *stash[3]) {
+        char **generators[3] = {
+                &m->generator_unit_path,
+                &m->generator_unit_path_early,
+                &m->generator_unit_path_late,
+        };
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(generators); i++) {
+                stash[i] = NULL;
+
+                if (!*generators[i])
+                        continue;
+
+                stash[i] = strappend(*generators[i], ".old");
+                if (!stash[i]) {
+                        log_oom();
+                        continue;
+                }
+
+                rm_rf(stash[i], false, true, false);
+                if (rename(*generators[i], stash[i]) < 0) {
+                        free(stash[i]);
+                        stash[i] = NULL;
+                }
+        }
+}
+
+static void manager_unstash_generators(Manager *m, char *stash[3]) {
+        char *generators[3] = {
+                m->generator_unit_path,
+                m->generator_unit_path_early,
+                m->generator_unit_path_late,
+        };
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(generators); i++) {
+                if (!stash[i])
+                        continue;
+
+                if (generators[i])
+                        keep_generator_timestamps(stash[i], generators[i]);
+
+                rm_rf(stash[i], false, true, false);
+                free(stash[i]);
+                stash[i] = NULL;
+        }
+}
+
+/* Reruns the generators and looks up the unit directories again */
+static int manager_reload_paths(Manager *m) {
+        char *stash[3];
+        int r;
+
+        if (m->incremental_reload)
+                manager_stash_generators(m, stash);
+
+        manager_undo_generators(m);
+        lookup_paths_free(&m->lookup_paths);
+
+        /* Find new unit paths */
+        manager_run_generators(m);
+
+        if (m->incremental_reload)
+                manager_unstash_generators(m, stash);
+
+        r = lookup_paths_init(
+                        &m->lookup_paths, m->running_as, true,
+                        m->generator_unit_path,
+                        m->generator_unit_path_early,
+                        m->generator_unit_path_late);
+
+        manager_build_unit_path_cache(m);
+
+        return r;
+}
+
+/* Maps a path in the unit directories to the unit it configures */
+static int unit_name_from_unit_path(const char *path, char **name, bool *subdir) {
+        _cleanup_free_ char *parent = NULL;
+        const char *dir, *suffix;
+        int r;
+
+        r = path_get_parent(path, &parent);
+        if (r < 0)
+                return r;
+
+        dir = path_get_file_name(parent);
+
+        NULSTR_FOREACH(suffix, ".wants\0.requires\0.d\0")
+                if (endswith(dir, suffix)) {
+                        *name = strndup(dir, strlen(dir) - strlen(suffix));
+                        *subdir = true;
+                        return *name ? 0 : -ENOMEM;
+                }
+
+        *name = strdup(path_get_file_name(path));
+        *subdir = false;
+        return *name ? 0 : -ENOMEM;
+}
+
+/* Adds the unit configured by a path that appeared or disappeared.
+ * Returns 0 if the change cannot be handled incrementally. */
+static int add_changed_unit_path(Manager *m, Set *changed, const char *path) {
+        _cleanup_free_ char *name = NULL;
+        bool subdir;
+        struct stat st;
+        Unit *u;
+        int r;
+
+        r = unit_name_from_unit_path(path, &name, &subdir);
+        if (r < 0)
+                return r;
+
+        if (!unit_name_is_valid(name, true))
+                return 1;
+
+        /* Instances pick up configuration from their templates */
+        if (unit_name_is_template(name))
+                return 0;
+
+        u = manager_get_unit(m, name);
+        if (!u) {
+                /* A new alias changes the names of another unit */
+                if (!subdir && lstat(path, &st) >= 0 && S_ISLNK(st.st_mode))
+                        return 0;
+
+                /* Units that are not loaded will be loaded when
+                 * they are needed */
+                return 1;
+        }
+
+        r = set_put(changed, u);
+        if (r < 0 && r != -EEXIST)
+                return r;
+
+        return 1;
+}
+
+static bool unit_can_reload_incrementally(Unit *u) {
+        assert(u);
+
+        /* Jobs, references from other units and aliases would point
+         * to the old unit object */
+        return !u->job &&
+                !u->nop_job &&
+                !u->refs &&
+                !u->transient &&
+                set_size(u->names) == 1 &&
+                IN_SET(u->type, UNIT_SERVICE, UNIT_SOCKET, UNIT_TARGET, UNIT_PATH, UNIT_TIMER);
+}
+
+typedef struct ReloadDependency {
+        char *unit;
+        char *other;
+        UnitDependency type;
+        bool outgoing;
+        bool add_reference;
+        bool third_party;
+} ReloadDependency;
+
+static void reload_dependencies_free(ReloadDependency *deps, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+                free(deps[i].unit);
+                free(deps[i].other);
+        }
+
+        free(deps);
+}
+
+/* Remembers the dependencies of u that the configuration of u did not
+ * ask for, so that they can be added back after u is reloaded */
+static int save_reload_dependencies(Unit *u, Set *changed, ReloadDependency **deps, size_t *n, size_t *allocated) {
+        UnitDependencyRecord *head, *r;
+        Iterator i;
+        Unit *other;
+
+        HASHMAP_FOREACH_KEY(head, other, u->dependency_records, i)
+                LIST_FOREACH(records, r, head) {
+                        ReloadDependency *d;
+
+                        /* The configuration of the other side is
+                         * reloaded too, and adds these itself */
+                        if (!r->third_party && set_get(changed, other))
+                                continue;
+
+                        if (!GREEDY_REALLOC(*deps, *allocated, *n + 1))
+                                return -ENOMEM;
+
+                        d = *deps + *n;
+                        zero(*d);
+                        d->unit = strdup(u->id);
+                        d->other = strdup(other->id);
+                        (*n)++;
+                        if (!d->unit || !d->other)
+                                return -ENOMEM;
+
+                        d->type = r->type;
+                        d->outgoing = r->outgoing;
+                        d->add_reference = r->add_reference;
+                        d->third_party = r->third_party;
+                }
+
+        return 0;
+}
+
+/* Reloads only the units whose configuration changed since the last
+ * reload. Returns 0 if a full reload is needed instead, in which case
+ * nothing was touched yet, and > 0 on success. */
+static int manager_reload_changed(Manager *m, Set *snapshot, char **unit_path) {
+        _cleanup_set_free_ Set *changed = NULL, *before = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        ReloadDependency *deps = NULL;
+        size_t n_deps = 0, n_allocated = 0, k;
+        Iterator i;
+        char *p, **name;
+        const char *t;
+        Unit *u;
+        int r;
 
         assert(m);
 
+        if (!snapshot || !m->unit_path_cache ||
+            !strv_equal(unit_path, m->lookup_paths.unit_path))
+                return 0;
+
+        changed = set_new(trivial_hash_func, trivial_compare_func);
+        if (!changed)
+                return -ENOMEM;
+
+        /* Files that appeared or disappeared */
+        SET_FOREACH(p, m->unit_path_cache, i)
+                if (!set_get(snapshot, p)) {
+                        r = add_changed_unit_path(m, changed, p);
+                        if (r <= 0)
+                                return r;
+                }
+
+        SET_FOREACH(p, snapshot, i)
+                if (!set_get(m->unit_path_cache, p)) {
+                        r = add_changed_unit_path(m, changed, p);
+                        if (r <= 0)
+                                return r;
+                }
+
+        /* Files that were modified */
+        HASHMAP_FOREACH_KEY(u, t, m->units, i) {
+                if (u->id != t || u->load_state == UNIT_MERGED)
+                        continue;
+
+                if (unit_need_daemon_reload(u)) {
+                        r = set_put(changed, u);
+                        if (r < 0 && r != -EEXIST)
+                                return r;
+                }
+        }
+
+        if (set_isempty(changed))
+                return 1;
+
+        SET_FOREACH(u, changed, i)
+                if (!unit_can_reload_incrementally(u)) {
+                        log_debug("Unit %s cannot be reloaded on its own.", u->id);
+                        return 0;
+                }
+
+        before = set_new(trivial_hash_func, trivial_compare_func);
+        if (!before)
+                return -ENOMEM;
+
         r = manager_open_serialization(m, &f);
         if (r < 0)
                 return r;
 
+        fds = fdset_new();
+        if (!fds)
+                return -ENOMEM;
+
+        SET_FOREACH(u, changed, i) {
+                log_debug("Reloading configuration of %s.", u->id);
+
+                if (unit_can_serialize(u)) {
+                        fputs(u->id, f);
+                        fputc('\n', f);
+
+                        r = unit_serialize(u, f, fds, false);
+                        if (r < 0)
+                                goto finish;
+                }
+
+                r = save_reload_dependencies(u, changed, &deps, &n_deps, &n_allocated);
+                if (r < 0)
+                        goto finish;
+
+                r = strv_extend(&names, u->id);
+                if (r < 0)
+                        goto finish;
+        }
+
+        HASHMAP_FOREACH(u, m->units, i)
+                if (!set_get(changed, u)) {
+                        r = set_put(before, u);
+                        if (r < 0 && r != -EEXIST)
+                                goto finish;
+                }
+
+        fflush(f);
+        if (ferror(f)) {
+                r = -EIO;
+                goto finish;
+        }
+
+        if (fseeko(f, 0, SEEK_SET) < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        /* From here on there is no way back. */
+        while ((u = set_steal_first(changed)))
+                unit_free(u);
+
+        STRV_FOREACH(name, names) {
+                r = manager_load_unit_prepare(m, *name, NULL, NULL, &u);
+                if (r < 0)
+                        log_warning("Failed to load %s: %s", *name, strerror(-r));
+        }
+
+        manager_dispatch_load_queue(m);
+
+        for (k = 0; k < n_deps; k++) {
+                ReloadDependency *d = deps + k;
+                Unit *other;
+
+                if (manager_load_unit(m, d->unit, NULL, NULL, &u) < 0 ||
+                    manager_load_unit(m, d->other, NULL, NULL, &other) < 0)
+                        continue;
+
+                m->loading_unit = d->third_party ? NULL : other;
+
+                if (d->outgoing)
+                        r = unit_add_dependency(u, d->type, other, d->add_reference);
+                else
+                        r = unit_add_dependency(other, d->type, u, d->add_reference);
+                if (r < 0)
+                        log_warning("Failed to restore dependency of %s on %s: %s",
+                                    d->outgoing ? u->id : other->id,
+                                    d->outgoing ? other->id : u->id,
+                                    strerror(-r));
+
+                m->loading_unit = NULL;
+        }
+
+        for (;;) {
+                char line[UNIT_NAME_MAX+2];
+
+                /* Start marker */
+                if (!fgets(line, sizeof(line), f))
+                        break;
+
+                char_array_0(line);
+
+                r = manager_load_unit(m, strstrip(line), NULL, NULL, &u);
+                if (r < 0)
+                        break;
+
+                r = unit_deserialize(u, f, fds);
+                if (r < 0)
+                        break;
+        }
+
+        /* Fire up the reloaded units, and those they pulled in */
+        HASHMAP_FOREACH_KEY(u, t, m->units, i)
+                if (u->id == t && !set_get(before, u))
+                        unit_coldplug(u);
+
+        r = 1;
+
+finish:
+        reload_dependencies_free(deps, n_deps);
+        return r;
+}
+
+int manager_reload(Manager *m) {
+        int r, q = 0;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_set_free_free_ Set *snapshot = NULL;
+        _cleanup_strv_free_ char **unit_path = NULL;
+
+        assert(m);
+
         m->n_reloading ++;
         bus_manager_send_reloading(m, true);
 
+        if (m->incremental_reload) {
+                snapshot = m->unit_path_snapshot;
+                m->unit_path_snapshot = NULL;
+
+                unit_path = strv_copy(m->lookup_paths.unit_path);
+                if (!unit_path) {
+                        m->n_reloading --;
+                        return -ENOMEM;
+                }
+
+                q = manager_reload_paths(m);
+                if (q >= 0) {
+                        r = manager_reload_changed(m, snapshot, unit_path);
+                        if (r > 0) {
+                                if (m->unit_cache)
+                                        unit_cache_flush(m->unit_cache);
+
+                                assert(m->n_reloading > 0);
+                                m->n_reloading--;
+
+                                m->send_reloading_done = true;
+
+                                return 0;
+                        }
+                        if (r < 0)
+                                log_warning("Failed to reload changed units, reloading all units: %s", strerror(-r));
+                }
+        }
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0) {
+                m->n_reloading --;
+                return r;
+        }
+
         fds = fdset_new();
         if (!fds) {
                 m->n_reloading --;
@@ -2255,22 +2842,13 @@ int manager_reload(Manager *m) {
 
         /* From here on there is no way back. */
         manager_clear_jobs_and_units(m);
-        manager_undo_generators(m);
-        lookup_paths_free(&m->lookup_paths);
 
-        /* Find new unit paths */
-        manager_run_generators(m);
-
-        q = lookup_paths_init(
-                        &m->lookup_paths, m->running_as, true,
-                        m->generator_unit_path,
-                        m->generator_unit_path_early,
-                        m->generator_unit_path_late);
+        /* In incremental mode the paths were looked up already */
+        if (!m->incremental_reload)
+                q = manager_reload_paths(m);
         if (q < 0)
                 r = q;
 
-        manager_build_unit_path_cache(m);
-
         /* First, enumerate what we can from all config files */
         q = manager_enumerate(m);
         if (q < 0)
@@ -2289,6 +2867,9 @@ int manager_reload(Manager *m) {
         if (q < 0)
                 r = q;
 
+        if (m->unit_cache)
+                unit_cache_flush(m->unit_cache);
+
         assert(m->n_reloading > 0);
         m->n_reloading--;
 
@@ -2491,10 +3072,51 @@ static void trim_generator_dir(Manager *m, char **generator) {
         return;
 }
 
+static void manager_free_generator_timings(Manager *m) {
+        unsigned i;
+
+        assert(m);
+
+        for (i = 0; i < m->n_generator_timings; i++)
+                free(m->generator_timings[i].name);
+
+        free(m->generator_timings);
+        m->generator_timings = NULL;
+        m->n_generator_timings = 0;
+}
+
+static void manager_add_generator_timing(const char *path, usec_t start, usec_t finish, void *userdata) {
+        Manager *m = userdata;
+        GeneratorTiming *t;
+        char *name;
+
+        assert(m);
+
+        name = strdup(path_get_file_name(path));
+        if (!name) {
+                log_oom();
+                return;
+        }
+
+        t = realloc(m->generator_timings, sizeof(GeneratorTiming) * (m->n_generator_timings + 1));
+        if (!t) {
+                free(name);
+                log_oom();
+                return;
+        }
+
+        m->generator_timings = t;
+        t += m->n_generator_timings++;
+        t->name = name;
+        t->start = start;
+        t->finish = finish;
+}
+
 void manager_run_generators(Manager *m) {
         _cleanup_closedir_ DIR *d = NULL;
         const char *generator_path;
         const char *argv[5];
+        long n_parallel;
         int r;
 
         assert(m);
@@ -2528,8 +3150,15 @@ void manager_run_generators(Manager *m) {
         argv[3] = m->generator_unit_path_late;
         argv[4] = NULL;
 
+        manager_free_generator_timings(m);
+
+        /* Generators mostly wait for the disk, run a few more of
+         * them than there are CPUs */
+        n_parallel = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1) * 2;
+
         RUN_WITH_UMASK(0022)
-                execute_directory(generator_path, d, (char**) argv);
+                execute_directory_full(generator_path, d, (char**) argv, (unsigned) n_parallel,
+                                       manager_add_generator_timing, m);
 
 finish:
         trim_generator_dir(m, &m->generator_unit_path);
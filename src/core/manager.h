@@ -33,7 +33,11 @@
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
 
+/* How many units a GC batch may look at before we go back to the event loop */
+#define GC_QUEUE_BATCH_MAX 1024
+
 typedef struct Manager Manager;
+typedef struct GeneratorTiming GeneratorTiming;
 
 typedef enum ManagerExitCode {
         MANAGER_RUNNING,
@@ -57,6 +61,14 @@ typedef enum ManagerExitCode {
 #include "path-lookup.h"
 #include "execute.h"
 #include "unit-name.h"
+#include "unit-cache.h"
+#include "ratelimit.h"
+
+struct GeneratorTiming {
+        char *name;
+        usec_t start;   /* CLOCK_MONOTONIC */
+        usec_t finish;
+};
 
 struct Manager {
         /* Note that the set of units we know of is allowed to be
@@ -93,6 +105,9 @@ struct Manager {
         /* Units that should be realized */
         LIST_HEAD(Unit, cgroup_queue);
 
+        /* Units whose cgroup might have run empty */
+        LIST_HEAD(Unit, cgroup_empty_queue);
+
         sd_event *event;
 
         Hashmap *watch_pids;  /* pid => Unit object n:1 */
@@ -115,6 +130,11 @@ struct Manager {
 
         LookupPaths lookup_paths;
         Set *unit_path_cache;
+        UnitCache *unit_cache;
+
+        /* The unit directories as of the last (re)load, to find the
+         * units to reload incrementally */
+        Set *unit_path_snapshot;
 
         char **environment;
 
@@ -138,6 +158,10 @@ struct Manager {
         char *generator_unit_path_early;
         char *generator_unit_path_late;
 
+        /* How long each generator took on the last run */
+        GeneratorTiming *generator_timings;
+        unsigned n_generator_timings;
+
         struct udev* udev;
 
         /* Data specific to the device subsystem */
@@ -148,6 +172,10 @@ struct Manager {
         /* Data specific to the mount subsystem */
         FILE *proc_self_mountinfo;
         sd_event_source *mount_event_source;
+        Hashmap *mountinfo_lines;
+        RateLimit mount_ratelimit;
+        sd_event_source *mount_coalesce_event_source;
+        bool mount_reread_pending:1;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -184,11 +212,21 @@ struct Manager {
 
         int gc_marker;
         unsigned n_in_gc_queue;
+        unsigned n_gc_batch;
+        bool gc_in_progress;
+
+        /* Statistics, for the whole lifetime of the manager */
+        uint64_t n_gc_examined;
+        uint64_t n_gc_collected;
 
         /* Make sure the user cannot accidentally unmount our cgroup
          * file system */
         int pin_cgroupfs_fd;
 
+        /* Datagrams from the cgroups agent about released cgroups */
+        int cgroups_agent_fd;
+        sd_event_source *cgroups_agent_event_source;
+
         /* Flags */
         SystemdRunningAs running_as;
         ManagerExitCode exit_code:5;
@@ -202,6 +240,12 @@ struct Manager {
         bool confirm_spawn;
         bool no_console_output;
 
+        /* Reload only the units whose configuration changed */
+        bool incremental_reload;
+
+        /* The unit whose configuration is being loaded */
+        Unit *loading_unit;
+
         ExecOutput default_std_output, default_std_error;
 
         usec_t default_restart_usec, default_timeout_start_usec,
@@ -265,6 +309,8 @@ void manager_dump_jobs(Manager *s, FILE *f, const char *prefix);
 void manager_clear_jobs(Manager *m);
 
 unsigned manager_dispatch_load_queue(Manager *m);
+unsigned manager_dispatch_gc_queue(Manager *m);
+unsigned manager_dispatch_cleanup_queue(Manager *m);
 
 int manager_environment_add(Manager *m, char **minus, char **plus);
 int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit);
@@ -59,6 +59,12 @@ static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
         [MOUNT_FAILED] = UNIT_FAILED
 };
 
+/* Beyond this many mount table changes per interval, changes are
+ * coalesced */
+#define MOUNT_RATELIMIT_INTERVAL_USEC (1*USEC_PER_SEC)
+#define MOUNT_RATELIMIT_BURST 10
+#define MOUNT_COALESCE_USEC (100*USEC_PER_MSEC)
+
 static int mount_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 
@@ -474,7 +480,7 @@ static int mount_fix_timeouts(Mount *m) {
                 return r;
         }
 
-        SET_FOREACH(other, UNIT(m)->dependencies[UNIT_AFTER], i) {
+        PTRSET_FOREACH(other, UNIT(m)->dependencies[UNIT_AFTER], i) {
                 if (other->type != UNIT_DEVICE)
                         continue;
 
@@ -616,7 +622,7 @@ static int mount_notify_automount(Mount *m, int status) {
 
         assert(m);
 
-        SET_FOREACH(p, UNIT(m)->dependencies[UNIT_TRIGGERED_BY], i)
+        PTRSET_FOREACH(p, UNIT(m)->dependencies[UNIT_TRIGGERED_BY], i)
                 if (p->type == UNIT_AUTOMOUNT) {
                          r = automount_send_ready(AUTOMOUNT(p), status);
                          if (r < 0)
@@ -1192,6 +1198,11 @@ static void mount_sigchld_event(Unit *u, pid_t pid, int code, int status) {
 
         m->control_pid = 0;
 
+        /* If we are holding back a mount table change, catch up
+         * first, so that we know whether the kernel has the mount */
+        if (u->manager->mount_reread_pending)
+                mount_process_proc_self_mountinfo(u->manager);
+
         if (is_clean_exit(code, status, NULL))
                 f = MOUNT_SUCCESS;
         else if (code == CLD_EXITED)
@@ -1376,7 +1387,8 @@ static int mount_add_one(
                 const char *where,
                 const char *options,
                 const char *fstype,
-                bool set_flags) {
+                bool set_flags,
+                Unit **ret) {
         int r;
         Unit *u;
         bool delete;
@@ -1389,6 +1401,9 @@ static int mount_add_one(
         assert(where);
         assert(options);
         assert(fstype);
+        assert(ret);
+
+        *ret = NULL;
 
         /* Ignore API mount points. They should never be referenced in
          * dependencies ever. */
@@ -1503,6 +1518,7 @@ static int mount_add_one(
 
         unit_add_to_dbus_queue(u);
 
+        *ret = u;
         return 0;
 
 fail:
@@ -1516,55 +1532,253 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
-        int r = 0;
+typedef struct MountInfoLine {
+        char *line;
+        /* NULL if the line could not be parsed, or is ignored */
+        char *unit;
+        /* Position in the table, the last line of a mount point wins */
+        unsigned index;
+} MountInfoLine;
+
+static void mount_info_line_free(MountInfoLine *l) {
+        if (!l)
+                return;
+
+        free(l->line);
+        free(l->unit);
+        free(l);
+}
+
+static void mount_free_mountinfo_lines(Manager *m) {
+        MountInfoLine *l;
+
+        assert(m);
+
+        while ((l = hashmap_steal_first(m->mountinfo_lines)))
+                mount_info_line_free(l);
+
+        hashmap_free(m->mountinfo_lines);
+        m->mountinfo_lines = NULL;
+}
+
+static int mount_parse_line(Manager *m, const char *line, unsigned i, bool set_flags, char **unit) {
+        _cleanup_free_ char *device = NULL, *path = NULL, *options = NULL, *options2 = NULL, *fstype = NULL, *d = NULL, *p = NULL, *o = NULL;
+        Unit *u;
+        int k;
+
+        assert(m);
+        assert(line);
+        assert(unit);
+
+        k = sscanf(line,
+                   "%*s "       /* (1) mount id */
+                   "%*s "       /* (2) parent id */
+                   "%*s "       /* (3) major:minor */
+                   "%*s "       /* (4) root */
+                   "%ms "       /* (5) mount point */
+                   "%ms"        /* (6) mount options */
+                   "%*[^-]"     /* (7) optional fields */
+                   "- "         /* (8) separator */
+                   "%ms "       /* (9) file system type */
+                   "%ms"        /* (10) mount source */
+                   "%ms"        /* (11) mount options 2 */
+                   "%*[^\n]",   /* some rubbish at the end */
+                   &path,
+                   &options,
+                   &fstype,
+                   &device,
+                   &options2);
+
+        if (k != 5) {
+                log_warning("Failed to parse /proc/self/mountinfo:%u.", i);
+                *unit = NULL;
+                return 0;
+        }
+
+        o = strjoin(options, ",", options2, NULL);
+        if (!o)
+                return log_oom();
+
+        d = cunescape(device);
+        p = cunescape(path);
+        if (!d || !p)
+                return log_oom();
+
+        k = mount_add_one(m, d, p, o, fstype, set_flags, &u);
+        if (k < 0)
+                return k;
+
+        /* Lines of mount points we ignore have no unit */
+        if (!u) {
+                *unit = NULL;
+                return 0;
+        }
+
+        *unit = strdup(u->id);
+        if (!*unit)
+                return log_oom();
+
+        return 0;
+}
+
+static int mount_info_line_compare(const void *a, const void *b) {
+        const MountInfoLine * const *x = a, * const *y = b;
+
+        if ((*x)->index < (*y)->index)
+                return -1;
+        if ((*x)->index > (*y)->index)
+                return 1;
+        return 0;
+}
+
+static int mount_reparse_lines(Manager *m, Hashmap *lines, Set *units, bool set_flags) {
+        _cleanup_free_ MountInfoLine **array = NULL;
+        MountInfoLine *l;
+        Iterator i;
+        unsigned n = 0, j;
+        int r = 0, k;
+
+        assert(m);
+        assert(lines);
+        assert(units);
+
+        /* The parameters of a unit come from the last of its lines
+         * in the table. If that one vanished, the remaining ones of
+         * stacked mounts are parsed again, in table order. */
+
+        array = new(MountInfoLine*, hashmap_size(lines));
+        if (!array)
+                return log_oom();
+
+        HASHMAP_FOREACH(l, lines, i) {
+                Unit *u;
+
+                if (!l->unit)
+                        continue;
+
+                u = manager_get_unit(m, l->unit);
+                if (u && set_get(units, u))
+                        array[n++] = l;
+        }
+
+        qsort(array, n, sizeof(MountInfoLine*), mount_info_line_compare);
+
+        for (j = 0; j < n; j++) {
+                _cleanup_free_ char *unit = NULL;
+
+                k = mount_parse_line(m, array[j]->line, array[j]->index, set_flags, &unit);
+                if (k < 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set *changed) {
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_set_free_ Set *reparse = NULL;
+        size_t allocated = 0;
+        Hashmap *lines;
+        MountInfoLine *l;
+        Unit *u;
+        int r = 0, k;
         unsigned i;
 
         assert(m);
 
+        /* Only the lines that are not in the snapshot of the
+         * previous run are parsed, and only the mount units they and
+         * the lines that vanished belong to are put into the changed
+         * set. Without snapshot everything is looked at. */
+
+        lines = hashmap_new(string_hash_func, string_compare_func);
+        if (!lines)
+                return log_oom();
+
+        if (!m->mountinfo_lines)
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                        MOUNT(u)->n_mountinfo_lines = 0;
+
+                        if (changed && set_put(changed, u) < 0)
+                                r = log_oom();
+                }
+
         rewind(m->proc_self_mountinfo);
 
-        for (i = 1;; i++) {
-                _cleanup_free_ char *device = NULL, *path = NULL, *options = NULL, *options2 = NULL, *fstype = NULL, *d = NULL, *p = NULL, *o = NULL;
-                int k;
-
-                k = fscanf(m->proc_self_mountinfo,
-                           "%*s "       /* (1) mount id */
-                           "%*s "       /* (2) parent id */
-                           "%*s "       /* (3) major:minor */
-                           "%*s "       /* (4) root */
-                           "%ms "       /* (5) mount point */
-                           "%ms"        /* (6) mount options */
-                           "%*[^-]"     /* (7) optional fields */
-                           "- "         /* (8) separator */
-                           "%ms "       /* (9) file system type */
-                           "%ms"        /* (10) mount source */
-                           "%ms"        /* (11) mount options 2 */
-                           "%*[^\n]",   /* some rubbish at the end */
-                           &path,
-                           &options,
-                           &fstype,
-                           &device,
-                           &options2);
-
-                if (k == EOF)
-                        break;
-
-                if (k != 5) {
-                        log_warning("Failed to parse /proc/self/mountinfo:%u.", i);
-                        continue;
+        for (i = 1; getline(&buf, &allocated, m->proc_self_mountinfo) >= 0; i++) {
+
+                l = hashmap_remove(m->mountinfo_lines, buf);
+                if (!l) {
+                        l = new0(MountInfoLine, 1);
+                        if (!l) {
+                                r = log_oom();
+                                continue;
+                        }
+
+                        l->line = strdup(buf);
+                        if (!l->line) {
+                                mount_info_line_free(l);
+                                r = log_oom();
+                                continue;
+                        }
+
+                        k = mount_parse_line(m, buf, i, set_flags, &l->unit);
+                        if (k < 0) {
+                                /* Not remembered, hence retried next time */
+                                mount_info_line_free(l);
+                                r = k;
+                                continue;
+                        }
+
+                        if (l->unit) {
+                                u = manager_get_unit(m, l->unit);
+                                assert(u);
+
+                                MOUNT(u)->n_mountinfo_lines++;
+
+                                if (changed && set_put(changed, u) < 0)
+                                        r = log_oom();
+                        }
                 }
 
-                o = strjoin(options, ",", options2, NULL);
-                if (!o)
-                        return log_oom();
+                l->index = i;
 
-                d = cunescape(device);
-                p = cunescape(path);
-                if (!d || !p)
-                        return log_oom();
+                k = hashmap_put(lines, l->line, l);
+                if (k < 0) {
+                        mount_info_line_free(l);
+                        r = k;
+                }
+        }
+
+        /* What is left over has vanished from the table */
+        while ((l = hashmap_steal_first(m->mountinfo_lines))) {
+                if (l->unit) {
+                        u = manager_get_unit(m, l->unit);
+                        if (u) {
+                                assert(MOUNT(u)->n_mountinfo_lines > 0);
+                                MOUNT(u)->n_mountinfo_lines--;
+
+                                if (changed && set_put(changed, u) < 0)
+                                        r = log_oom();
+
+                                /* Still mounted below, take the parameters from there */
+                                if (MOUNT(u)->n_mountinfo_lines > 0) {
+                                        if (!reparse)
+                                                reparse = set_new(trivial_hash_func, trivial_compare_func);
+                                        if (!reparse || set_put(reparse, u) < 0)
+                                                r = log_oom();
+                                }
+                        }
+                }
+
+                mount_info_line_free(l);
+        }
 
-                k = mount_add_one(m, d, p, o, fstype, set_flags);
+        hashmap_free(m->mountinfo_lines);
+        m->mountinfo_lines = lines;
+
+        if (reparse) {
+                k = mount_reparse_lines(m, lines, reparse, set_flags);
                 if (k < 0)
                         r = k;
         }
@@ -1576,6 +1790,10 @@ static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_coalesce_event_source = sd_event_source_unref(m->mount_coalesce_event_source);
+        m->mount_reread_pending = false;
+
+        mount_free_mountinfo_lines(m);
 
         if (m->proc_self_mountinfo) {
                 fclose(m->proc_self_mountinfo);
@@ -1602,9 +1820,15 @@ static int mount_enumerate(Manager *m) {
                 r = sd_event_source_set_priority(m->mount_event_source, -10);
                 if (r < 0)
                         goto fail;
+
+                RATELIMIT_INIT(m->mount_ratelimit, MOUNT_RATELIMIT_INTERVAL_USEC, MOUNT_RATELIMIT_BURST);
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        /* The units the snapshot refers to might have been freed
+         * since, e.g. on reload */
+        mount_free_mountinfo_lines(m);
+
+        r = mount_load_proc_self_mountinfo(m, false, NULL);
         if (r < 0)
                 goto fail;
 
@@ -1615,22 +1839,30 @@ fail:
         return r;
 }
 
-static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        Manager *m = userdata;
+void mount_process_proc_self_mountinfo(Manager *m) {
+        _cleanup_set_free_ Set *changed = NULL;
+        Iterator i;
         Unit *u;
         int r;
 
         assert(m);
-        assert(revents & EPOLLPRI);
 
-        /* The manager calls this for every fd event happening on the
-         * /proc/self/mountinfo file, which informs us about mounting
-         * table changes */
+        m->mount_reread_pending = false;
+        if (m->mount_coalesce_event_source)
+                sd_event_source_set_enabled(m->mount_coalesce_event_source, SD_EVENT_OFF);
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        changed = set_new(trivial_hash_func, trivial_compare_func);
+        if (!changed)
+                r = log_oom();
+        else
+                r = mount_load_proc_self_mountinfo(m, true, changed);
         if (r < 0) {
                 log_error("Failed to reread /proc/self/mountinfo: %s", strerror(-r));
 
+                /* We don't know which units we missed, hence look
+                 * at all of them next time */
+                mount_free_mountinfo_lines(m);
+
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
                         Mount *mount = MOUNT(u);
@@ -1638,14 +1870,16 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         mount->is_mounted = mount->just_mounted = mount->just_changed = false;
                 }
 
-                return 0;
+                return;
         }
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+        SET_FOREACH(u, changed, i) {
                 Mount *mount = MOUNT(u);
 
+                mount->is_mounted = mount->n_mountinfo_lines > 0;
+
                 if (!mount->is_mounted) {
                         /* This has just been unmounted. */
 
@@ -1692,7 +1926,61 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                 /* Reset the flags for later calls */
                 mount->is_mounted = mount->just_mounted = mount->just_changed = false;
         }
+}
+
+static int mount_dispatch_coalesce(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(m->mount_coalesce_event_source == source);
+
+        if (m->mount_reread_pending)
+                mount_process_proc_self_mountinfo(m);
+
+        return 0;
+}
+
+static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        usec_t t;
+        int r;
+
+        assert(m);
+        assert(revents & EPOLLPRI);
+
+        /* The manager calls this for every fd event happening on the
+         * /proc/self/mountinfo file, which informs us about mounting
+         * table changes */
+
+        if (m->mount_reread_pending)
+                return 0;
+
+        if (ratelimit_test(&m->mount_ratelimit)) {
+                mount_process_proc_self_mountinfo(m);
+                return 0;
+        }
+
+        /* The table changes a lot, e.g. because many containers are
+         * started at once. Reread it once after a short delay, rather
+         * than for every single change. */
+        t = now(CLOCK_MONOTONIC) + MOUNT_COALESCE_USEC;
+
+        if (m->mount_coalesce_event_source) {
+                r = sd_event_source_set_time(m->mount_coalesce_event_source, t);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->mount_coalesce_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_monotonic(m->event, t, 0, mount_dispatch_coalesce, m, &m->mount_coalesce_event_source);
+                if (r >= 0)
+                        r = sd_event_source_set_priority(m->mount_coalesce_event_source, -10);
+        }
+        if (r < 0) {
+                log_warning("Failed to delay rereading /proc/self/mountinfo, doing it right away: %s", strerror(-r));
+                mount_process_proc_self_mountinfo(m);
+                return 0;
+        }
 
+        m->mount_reread_pending = true;
         return 0;
 }
 
@@ -88,6 +88,10 @@ struct Mount {
         bool just_mounted:1;
         bool just_changed:1;
 
+        /* Number of lines in /proc/self/mountinfo for this mount
+         * point, there may be more than one if mounts are stacked */
+        unsigned n_mountinfo_lines;
+
         MountResult result;
         MountResult reload_result;
 
@@ -114,7 +118,7 @@ struct Mount {
 
 extern const UnitVTable mount_vtable;
 
-void mount_fd_event(Manager *m, int events);
+void mount_process_proc_self_mountinfo(Manager *m);
 
 const char* mount_state_to_string(MountState i) _const_;
 MountState mount_state_from_string(const char *s) _pure_;
@@ -134,7 +134,7 @@ static int snapshot_serialize(Unit *u, FILE *f, FDSet *fds) {
 
         unit_serialize_item(u, f, "state", snapshot_state_to_string(s->state));
         unit_serialize_item(u, f, "cleanup", yes_no(s->cleanup));
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
                 unit_serialize_item(u, f, "wants", other->id);
 
         return 0;
@@ -294,8 +294,7 @@ static int transaction_merge_jobs(Transaction *tr, sd_bus_error *e) {
 }
 
 static void transaction_drop_redundant(Transaction *tr) {
-        Job *j;
-        Iterator i;
+        bool again;
 
         /* Goes through the transaction and removes all jobs of the units
          * whose jobs are all noops. If not all of a unit's jobs are
@@ -303,23 +302,35 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                Job *k;
+        /* Dropping a unit's jobs only touches that unit's entry, so
+         * we can continue the iteration. Entries of units whose jobs
+         * are deleted behind the iterator are checked again in
+         * another pass. */
+        do {
+                Job *j;
+                Iterator i;
 
-                LIST_FOREACH(transaction, k, j) {
+                again = false;
 
-                        if (tr->anchor_job == k ||
-                            !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
-                            (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type)))
-                                goto next_unit;
-                }
+                HASHMAP_FOREACH(j, tr->jobs, i) {
+                        Unit *u = j->unit;
+                        Job *k;
 
-                /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
-        next_unit:;
-        }
+                        LIST_FOREACH(transaction, k, j) {
+
+                                if (tr->anchor_job == k ||
+                                    !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
+                                    (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type)))
+                                        goto next_unit;
+                        }
+
+                        /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
+                        while ((k = hashmap_get(tr->jobs, u)))
+                                transaction_delete_job(tr, k, false);
+                        again = true;
+                next_unit:;
+                }
+        } while (again);
 }
 
 _pure_ static bool unit_matters_to_anchor(Unit *u, Job *j) {
@@ -336,94 +347,118 @@ _pure_ static bool unit_matters_to_anchor(Unit *u, Job *j) {
         return false;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
-        Iterator i;
-        Unit *u;
-        int r;
+static int transaction_break_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete;
 
         assert(tr);
         assert(j);
-        assert(!j->transaction_prev);
+        assert(j->marker);
+
+        /* We came across j again while it is still on our path,
+         * hence we have a cycle. Let's try to break it. We go
+         * backwards in our path and try to find a suitable job to
+         * remove. We use the marker to find our way back, since
+         * smart how we are we stored our way back in there. */
+        log_warning_unit(j->unit->id,
+                         "Found ordering cycle on %s/%s",
+                         j->unit->id, job_type_to_string(j->type));
+
+        delete = NULL;
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+
+                /* logging for j not k here here to provide consistent narrative */
+                log_info_unit(j->unit->id,
+                              "Found dependency on %s/%s",
+                              k->unit->id, job_type_to_string(k->type));
+
+                if (!delete &&
+                    !unit_matters_to_anchor(k->unit, k)) {
+                        /* Ok, we can drop this one, so let's
+                         * do so. */
+                        delete = k;
+                }
 
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+                /* Check if this in fact was the beginning of
+                 * the cycle */
+                if (k == j)
+                        break;
+        }
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete;
+        if (delete) {
+                /* logging for j not k here here to provide consistent narrative */
+                log_warning_unit(j->unit->id,
+                                 "Breaking ordering cycle by deleting job %s/%s",
+                                 delete->unit->id, job_type_to_string(delete->type));
+                log_error_unit(delete->unit->id,
+                               "Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                               delete->unit->id, job_type_to_string(delete->type),
+                               j->unit->id, job_type_to_string(j->type));
+                unit_status_printf(delete->unit, ANSI_HIGHLIGHT_RED_ON " SKIP " ANSI_HIGHLIGHT_OFF,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
+        }
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+        log_error("Unable to break cycle");
 
-                /* So, the marker is not NULL and we already have been
-                 * here. We have a cycle. Let's try to break it. We go
-                 * backwards in our path and try to find a suitable
-                 * job to remove. We use the marker to find our way
-                 * back, since smart how we are we stored our way back
-                 * in there. */
-                log_warning_unit(j->unit->id,
-                                 "Found ordering cycle on %s/%s",
-                                 j->unit->id, job_type_to_string(j->type));
-
-                delete = NULL;
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
-
-                        /* logging for j not k here here to provide consistent narrative */
-                        log_info_unit(j->unit->id,
-                                      "Found dependency on %s/%s",
-                                      k->unit->id, job_type_to_string(k->type));
-
-                        if (!delete &&
-                            !unit_matters_to_anchor(k->unit, k)) {
-                                /* Ok, we can drop this one, so let's
-                                 * do so. */
-                                delete = k;
-                        }
+        sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                          "Transaction order is cyclic. See system logs for details.");
+        return -ENOEXEC;
+}
 
-                        /* Check if this in fact was the beginning of
-                         * the cycle */
-                        if (k == j)
-                                break;
-                }
+typedef struct OrderFrame {
+        Job *job;
+        Iterator i;
+} OrderFrame;
 
+static int transaction_verify_order_one(Transaction *tr, Job *j, unsigned generation, OrderFrame **stack, size_t *allocated, sd_bus_error *e) {
+        size_t n = 0;
 
-                if (delete) {
-                        /* logging for j not k here here to provide consistent narrative */
-                        log_warning_unit(j->unit->id,
-                                         "Breaking ordering cycle by deleting job %s/%s",
-                                         delete->unit->id, job_type_to_string(delete->type));
-                        log_error_unit(delete->unit->id,
-                                       "Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                       delete->unit->id, job_type_to_string(delete->type),
-                                       j->unit->id, job_type_to_string(j->type));
-                        unit_status_printf(delete->unit, ANSI_HIGHLIGHT_RED_ON " SKIP " ANSI_HIGHLIGHT_OFF,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
+        assert(tr);
+        assert(j);
+        assert(!j->transaction_prev);
+        assert(stack);
+        assert(allocated);
 
-                log_error("Unable to break cycle");
+        /* Does a depth-first sweep through the ordering graph,
+         * looking for a cycle. If we find a cycle we try to break
+         * it. The path is kept on an explicit stack rather than
+         * recursing, since on large transactions it can get very
+         * long. */
 
-                sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                  "Transaction order is cyclic. See system logs for details.");
-                return -ENOEXEC;
-        }
+        /* Have we seen this before? Then we already decided the job
+         * was loop-free from here. */
+        if (j->generation == generation)
+                return 0;
 
         /* Make the marker point to where we come from, so that we can
          * find our way backwards if we want to break a cycle. We use
          * a special marker for the beginning: we point to
          * ourselves. */
-        j->marker = from ? from : j;
+        j->marker = j;
         j->generation = generation;
 
-        /* We assume that the dependencies are bidirectional, and
-         * hence can ignore UNIT_AFTER */
-        SET_FOREACH(u, j->unit->dependencies[UNIT_BEFORE], i) {
+        if (!GREEDY_REALLOC(*stack, *allocated, 1))
+                return -ENOMEM;
+
+        (*stack)[n++] = (OrderFrame) { j, ITERATOR_FIRST };
+
+        while (n > 0) {
+                OrderFrame *f = *stack + n - 1;
+                Unit *u;
                 Job *o;
 
+                /* We assume that the dependencies are bidirectional,
+                 * and hence can ignore UNIT_AFTER */
+                u = ptrset_iterate(f->job->unit->dependencies[UNIT_BEFORE], &f->i);
+                if (!u) {
+                        /* Ok, let's backtrack, and remember that this
+                         * entry is not on our path anymore. */
+                        f->job->marker = NULL;
+                        n--;
+                        continue;
+                }
+
                 /* Is there a job for this unit? */
                 o = hashmap_get(tr->jobs, u);
                 if (!o) {
@@ -435,19 +470,31 @@ static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsi
                                 continue;
                 }
 
-                r = transaction_verify_order_one(tr, o, j, generation, e);
-                if (r < 0)
-                        return r;
-        }
+                if (o->generation == generation) {
+                        /* If the marker is NULL we have been here
+                         * already and decided the job was loop-free
+                         * from here. */
+                        if (!o->marker)
+                                continue;
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+                        return transaction_break_cycle(tr, o, f->job, generation, e);
+                }
+
+                o->marker = f->job;
+                o->generation = generation;
+
+                if (!GREEDY_REALLOC(*stack, *allocated, n + 1))
+                        return -ENOMEM;
+
+                (*stack)[n++] = (OrderFrame) { o, ITERATOR_FIRST };
+        }
 
         return 0;
 }
 
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
+        _cleanup_free_ OrderFrame *stack = NULL;
+        size_t allocated = 0;
         Job *j;
         int r;
         Iterator i;
@@ -457,39 +504,51 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         assert(generation);
 
         /* Check if the ordering graph is cyclic. If it is, try to fix
-         * that up by dropping one of the jobs. */
+         * that up by dropping one of the jobs. Every job is visited
+         * only once per call, thanks to the generation marker. */
 
         g = (*generation)++;
 
-        HASHMAP_FOREACH(j, tr->jobs, i)
-                if ((r = transaction_verify_order_one(tr, j, NULL, g, e)) < 0)
+        HASHMAP_FOREACH(j, tr->jobs, i) {
+                r = transaction_verify_order_one(tr, j, g, &stack, &allocated, e);
+                if (r < 0)
                         return r;
+        }
 
         return 0;
 }
 
 static void transaction_collect_garbage(Transaction *tr) {
-        Iterator i;
-        Job *j;
+        bool again;
 
         assert(tr);
 
         /* Drop jobs that are not required by any other job */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                if (tr->anchor_job == j || j->object_list) {
-                        /* log_debug("Keeping job %s/%s because of %s/%s", */
-                        /*           j->unit->id, job_type_to_string(j->type), */
-                        /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
-                        /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
-                        continue;
-                }
+        /* Nothing depends on a garbage job, hence deleting it never
+         * deletes other jobs, and we can continue the iteration. Jobs
+         * that become garbage by this are collected in another
+         * pass. */
+        do {
+                Iterator i;
+                Job *j;
+
+                again = false;
+
+                HASHMAP_FOREACH(j, tr->jobs, i) {
+                        if (tr->anchor_job == j || j->object_list) {
+                                /* log_debug("Keeping job %s/%s because of %s/%s", */
+                                /*           j->unit->id, job_type_to_string(j->type), */
+                                /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
+                                /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
+                                continue;
+                        }
 
-                /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, true);
-                goto rescan;
-        }
+                        /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
+                        transaction_delete_job(tr, j, true);
+                        again = true;
+                }
+        } while (again);
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -521,6 +580,7 @@ static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_erro
 static void transaction_minimize_impact(Transaction *tr) {
         Job *j;
         Iterator i;
+        bool again;
 
         assert(tr);
 
@@ -528,6 +588,8 @@ static void transaction_minimize_impact(Transaction *tr) {
          * or that stop a running service. */
 
 rescan:
+        again = false;
+
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 LIST_FOREACH(transaction, j, j) {
                         bool stops_running_service, changes_existing_job;
@@ -565,10 +627,25 @@ rescan:
                                        "Deleting %s/%s to minimize impact.",
                                        j->unit->id, job_type_to_string(j->type));
 
+                        /* If nothing depends on this job, deleting it
+                         * touches no other entry, and we can go on
+                         * with the next unit, and look at the rest
+                         * of this one in another pass. Otherwise the
+                         * jobs depending on it are deleted too, and
+                         * we need to start over right away. */
+                        if (j->object_list) {
+                                transaction_delete_job(tr, j, true);
+                                goto rescan;
+                        }
+
                         transaction_delete_job(tr, j, true);
-                        goto rescan;
+                        again = true;
+                        break;
                 }
         }
+
+        if (again)
+                goto rescan;
 }
 
 static int transaction_apply(Transaction *tr, Manager *m, JobMode mode) {
@@ -930,7 +1007,7 @@ int transaction_add_job_and_dependencies(
 
                 /* Finally, recursively add in all dependencies. */
                 if (type == JOB_START || type == JOB_RESTART) {
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -941,7 +1018,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -952,7 +1029,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES_OVERRIDABLE], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES_OVERRIDABLE], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, !override, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_full_unit(r == -EADDRNOTAVAIL ? LOG_DEBUG : LOG_WARNING, dep->id,
@@ -964,7 +1041,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_WANTS], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_WANTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_full_unit(r == -EADDRNOTAVAIL ? LOG_DEBUG : LOG_WARNING, dep->id,
@@ -976,7 +1053,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -987,7 +1064,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE_OVERRIDABLE], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE_OVERRIDABLE], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, !override, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_full_unit(r == -EADDRNOTAVAIL ? LOG_DEBUG : LOG_WARNING, dep->id,
@@ -999,7 +1076,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, override, true, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -1010,7 +1087,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_warning_unit(dep->id,
@@ -1026,7 +1103,7 @@ int transaction_add_job_and_dependencies(
 
                 if (type == JOB_STOP || type == JOB_RESTART) {
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRED_BY], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRED_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, type, dep, ret, true, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -1037,7 +1114,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_BOUND_BY], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_BOUND_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, type, dep, ret, true, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -1048,7 +1125,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONSISTS_OF], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_CONSISTS_OF], i) {
                                 r = transaction_add_job_and_dependencies(tr, type, dep, ret, true, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR)
@@ -1063,7 +1140,7 @@ int transaction_add_job_and_dependencies(
 
                 if (type == JOB_RELOAD) {
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
+                        PTRSET_FOREACH(dep, ret->unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_RELOAD, dep, ret, false, override, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_warning_unit(dep->id,
@@ -0,0 +1,793 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "unit-cache.h"
+#include "util.h"
+#include "hashmap.h"
+#include "set.h"
+#include "strbuf.h"
+#include "mkdir.h"
+#include "log.h"
+
+/* On-disk format: the header, all file records, all assignments of all
+ * files, and the strings. The file is only ever read by the same
+ * version of systemd on the same machine, so everything is stored in
+ * host byte order. All offsets are relative to the start of the file,
+ * a string offset of 0 denotes a NULL string. */
+
+#define UNIT_CACHE_SIGNATURE { 'S', 'D', 'U', 'N', 'I', 'T', 'C', '1' }
+
+struct unit_cache_header {
+        uint8_t signature[8];
+        char version[16];
+
+        uint64_t file_size;
+        uint64_t header_size;
+        uint64_t file_record_size;
+        uint64_t entry_size;
+
+        uint64_t files_off;
+        uint64_t files_count;
+};
+
+struct unit_cache_file {
+        uint64_t path_off;
+        uint64_t sections_off;
+        uint64_t sections_size;
+
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t mtime;
+        uint64_t ctime;
+
+        uint64_t entries_off;
+        uint64_t entries_count;
+};
+
+struct unit_cache_entry {
+        uint32_t line;
+        uint32_t section_line;
+        uint64_t section_off;
+        uint64_t lvalue_off;
+        uint64_t rvalue_off;
+};
+
+typedef struct UnitCacheKey {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t mtime;
+        uint64_t ctime;
+} UnitCacheKey;
+
+typedef struct UnitCacheEntry {
+        unsigned line;
+        unsigned section_line;
+        char *section;
+        char *lvalue;
+        char *rvalue;
+} UnitCacheEntry;
+
+/* A file parsed since the cache file was last written */
+typedef struct UnitCacheRecord {
+        char *path;
+        char *sections;
+        size_t sections_size;
+        UnitCacheKey key;
+
+        UnitCacheEntry *entries;
+        unsigned n_entries;
+        size_t n_allocated;
+
+        bool uncacheable;
+} UnitCacheRecord;
+
+struct UnitCache {
+        char *path;
+
+        /* The cache file */
+        void *map;
+        size_t map_size;
+        Hashmap *mapped;
+
+        /* Files of the cache file which have been used since it was
+         * written, and files which have been parsed since then */
+        Set *used;
+        Hashmap *recorded;
+
+        unsigned hits;
+        unsigned misses;
+};
+
+static const char *map_string(UnitCache *c, uint64_t off) {
+        if (off == 0)
+                return NULL;
+
+        return (const char*) c->map + off;
+}
+
+static void unit_cache_record_free(UnitCacheRecord *r) {
+        unsigned i;
+
+        if (!r)
+                return;
+
+        for (i = 0; i < r->n_entries; i++) {
+                free(r->entries[i].section);
+                free(r->entries[i].lvalue);
+                free(r->entries[i].rvalue);
+        }
+
+        free(r->entries);
+        free(r->sections);
+        free(r->path);
+        free(r);
+}
+
+static void unit_cache_unmap(UnitCache *c) {
+        assert(c);
+
+        set_free(c->used);
+        c->used = NULL;
+
+        hashmap_free(c->mapped);
+        c->mapped = NULL;
+
+        if (c->map) {
+                munmap(c->map, c->map_size);
+                c->map = NULL;
+                c->map_size = 0;
+        }
+}
+
+/* Records are read in place, hence must be aligned like their struct */
+static bool range_ok(UnitCache *c, uint64_t off, uint64_t n, uint64_t size, uint64_t align) {
+        if (n == 0)
+                return true;
+
+        if (off < sizeof(struct unit_cache_header) || off >= c->map_size)
+                return false;
+
+        if (off % align != 0)
+                return false;
+
+        return n <= (c->map_size - off) / size;
+}
+
+static bool string_ok(UnitCache *c, uint64_t off) {
+        return off == 0 || (off >= sizeof(struct unit_cache_header) && off < c->map_size);
+}
+
+/* Map the cache file and index its records; a missing, outdated or
+ * inconsistent file is not an error, it is just not used */
+static int unit_cache_map(UnitCache *c) {
+        static const uint8_t sig[] = UNIT_CACHE_SIGNATURE;
+        const struct unit_cache_header *h;
+        const struct unit_cache_file *files;
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        uint64_t i;
+
+        assert(c);
+        assert(!c->map);
+
+        fd = open(c->path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(struct unit_cache_header))
+                return 0;
+
+        c->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (c->map == MAP_FAILED) {
+                c->map = NULL;
+                return -errno;
+        }
+        c->map_size = st.st_size;
+
+        h = c->map;
+        if (memcmp(h->signature, sig, sizeof(sig)) != 0 ||
+            strneq(h->version, PACKAGE_VERSION, sizeof(h->version)) == false ||
+            h->file_size != c->map_size ||
+            h->header_size != sizeof(struct unit_cache_header) ||
+            h->file_record_size != sizeof(struct unit_cache_file) ||
+            h->entry_size != sizeof(struct unit_cache_entry) ||
+            ((const char*) c->map)[c->map_size - 1] != '\0' ||
+            !range_ok(c, h->files_off, h->files_count, sizeof(struct unit_cache_file), __alignof__(struct unit_cache_file)))
+                goto invalid;
+
+        c->mapped = hashmap_new(string_hash_func, string_compare_func);
+        if (!c->mapped)
+                goto fail;
+
+        files = (const struct unit_cache_file*) ((const uint8_t*) c->map + h->files_off);
+        for (i = 0; i < h->files_count; i++) {
+                const struct unit_cache_file *file = files + i;
+                const struct unit_cache_entry *entries;
+                uint64_t k;
+                int r;
+
+                if (file->path_off == 0 ||
+                    !string_ok(c, file->path_off) ||
+                    !range_ok(c, file->sections_off, file->sections_size, 1, 1) ||
+                    !range_ok(c, file->entries_off, file->entries_count, sizeof(struct unit_cache_entry), __alignof__(struct unit_cache_entry)))
+                        goto invalid;
+
+                entries = (const struct unit_cache_entry*) ((const uint8_t*) c->map + file->entries_off);
+                for (k = 0; k < file->entries_count; k++)
+                        if (!string_ok(c, entries[k].section_off) ||
+                            entries[k].lvalue_off == 0 || !string_ok(c, entries[k].lvalue_off) ||
+                            entries[k].rvalue_off == 0 || !string_ok(c, entries[k].rvalue_off))
+                                goto invalid;
+
+                r = hashmap_put(c->mapped, map_string(c, file->path_off), (void*) file);
+                if (r == -ENOMEM)
+                        goto fail;
+        }
+
+        log_debug("Loaded unit file cache %s with %llu files.",
+                  c->path, (unsigned long long) h->files_count);
+        return 0;
+
+invalid:
+        log_debug("Ignoring invalid unit file cache %s.", c->path);
+        unit_cache_unmap(c);
+        return 0;
+
+fail:
+        unit_cache_unmap(c);
+        return -ENOMEM;
+}
+
+int unit_cache_new(UnitCache **ret, const char *path) {
+        UnitCache *c;
+        int r;
+
+        assert(ret);
+        assert(path);
+
+        c = new0(UnitCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->path = strdup(path);
+        if (!c->path) {
+                free(c);
+                return -ENOMEM;
+        }
+
+        c->recorded = hashmap_new(string_hash_func, string_compare_func);
+        if (!c->recorded) {
+                unit_cache_free(c);
+                return -ENOMEM;
+        }
+
+        r = unit_cache_map(c);
+        if (r < 0)
+                log_warning("Failed to load unit file cache %s: %s", path, strerror(-r));
+
+        *ret = c;
+        return 0;
+}
+
+void unit_cache_free(UnitCache *c) {
+        UnitCacheRecord *r;
+
+        if (!c)
+                return;
+
+        unit_cache_unmap(c);
+
+        while ((r = hashmap_steal_first(c->recorded)))
+                unit_cache_record_free(r);
+        hashmap_free(c->recorded);
+
+        free(c->path);
+        free(c);
+}
+
+static void key_from_stat(UnitCacheKey *key, const struct stat *st) {
+        key->dev = st->st_dev;
+        key->ino = st->st_ino;
+        key->size = st->st_size;
+        key->mtime = (uint64_t) st->st_mtim.tv_sec * NSEC_PER_SEC + st->st_mtim.tv_nsec;
+        key->ctime = (uint64_t) st->st_ctim.tv_sec * NSEC_PER_SEC + st->st_ctim.tv_nsec;
+}
+
+static bool file_is_fresh(const struct unit_cache_file *file, const UnitCacheKey *key) {
+        return file->dev == key->dev &&
+               file->ino == key->ino &&
+               file->size == key->size &&
+               file->mtime == key->mtime &&
+               file->ctime == key->ctime;
+}
+
+/* The size of a nulstr, including its terminating empty string */
+static size_t nulstr_length(const char *s) {
+        const char *i;
+
+        for (i = s; *i; i += strlen(i) + 1)
+                ;
+
+        return i - s + 1;
+}
+
+static bool sections_equal(const char *a, size_t a_size, const char *sections) {
+        return a_size == nulstr_length(sections) && memcmp(a, sections, a_size) == 0;
+}
+
+static int record_assignment(unsigned line,
+                             const char *section,
+                             unsigned section_line,
+                             const char *lvalue,
+                             const char *rvalue,
+                             void *recorder_data) {
+
+        UnitCacheRecord *r = recorder_data;
+        UnitCacheEntry *e;
+
+        assert(r);
+
+        if (!lvalue) {
+                r->uncacheable = true;
+                return 0;
+        }
+
+        if (r->uncacheable)
+                return 0;
+
+        if (!GREEDY_REALLOC(r->entries, r->n_allocated, r->n_entries + 1))
+                return -ENOMEM;
+
+        e = r->entries + r->n_entries;
+        zero(*e);
+        e->line = line;
+        e->section_line = section_line;
+
+        if (section) {
+                e->section = strdup(section);
+                if (!e->section)
+                        return -ENOMEM;
+        }
+
+        e->lvalue = strdup(lvalue);
+        e->rvalue = strdup(rvalue);
+        r->n_entries++;
+
+        if (!e->lvalue || !e->rvalue)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int unit_cache_record(UnitCache *c,
+                             const char *unit,
+                             const char *filename,
+                             FILE *f,
+                             const UnitCacheKey *key,
+                             const char *sections,
+                             ConfigItemLookup lookup,
+                             void *table,
+                             bool allow_include,
+                             void *userdata) {
+
+        UnitCacheRecord *r, *old;
+        int q;
+
+        r = new0(UnitCacheRecord, 1);
+        if (!r)
+                return -ENOMEM;
+
+        r->key = *key;
+        r->path = strdup(filename);
+        if (!r->path) {
+                unit_cache_record_free(r);
+                return -ENOMEM;
+        }
+
+        r->sections_size = nulstr_length(sections);
+        r->sections = memdup(sections, r->sections_size);
+        if (!r->sections) {
+                unit_cache_record_free(r);
+                return -ENOMEM;
+        }
+
+        q = config_parse_full(unit, filename, f, sections, lookup, table,
+                              false, allow_include, record_assignment, r, userdata);
+
+        /* Only files which parsed cleanly are cached, files with
+         * errors are parsed again, and complain again, next time */
+        if (q < 0 || r->uncacheable) {
+                unit_cache_record_free(r);
+                return q;
+        }
+
+        old = hashmap_get(c->recorded, r->path);
+        q = hashmap_replace(c->recorded, r->path, r);
+        if (q < 0)
+                unit_cache_record_free(r);
+        else
+                unit_cache_record_free(old);
+
+        return 0;
+}
+
+int unit_cache_parse(UnitCache *c,
+                     const char *unit,
+                     const char *filename,
+                     FILE *f,
+                     const char *sections,
+                     ConfigItemLookup lookup,
+                     void *table,
+                     bool allow_include,
+                     void *userdata) {
+
+        _cleanup_fclose_ FILE *ours = NULL;
+        const struct unit_cache_file *file;
+        UnitCacheRecord *record;
+        UnitCacheKey key;
+        struct stat st;
+        int r;
+
+        assert(c);
+        assert(filename);
+        assert(lookup);
+
+        if (f)
+                r = fstat(fileno(f), &st);
+        else
+                r = stat(filename, &st);
+        if (r < 0 || !sections)
+                return config_parse(unit, filename, f, sections, lookup, table, false, allow_include, userdata);
+
+        key_from_stat(&key, &st);
+
+        record = hashmap_get(c->recorded, filename);
+        if (record &&
+            memcmp(&record->key, &key, sizeof(key)) == 0 &&
+            sections_equal(record->sections, record->sections_size, sections)) {
+                unsigned i;
+
+                c->hits++;
+
+                for (i = 0; i < record->n_entries; i++) {
+                        UnitCacheEntry *e = record->entries + i;
+
+                        r = config_parse_assignment(unit, filename, e->line, lookup, table,
+                                                    e->section, e->section_line,
+                                                    e->lvalue, e->rvalue, false, userdata);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        file = c->mapped ? hashmap_get(c->mapped, filename) : NULL;
+        if (!record && file &&
+            file_is_fresh(file, &key) &&
+            sections_equal(map_string(c, file->sections_off), file->sections_size, sections)) {
+                const struct unit_cache_entry *entries;
+                uint64_t i;
+
+                c->hits++;
+
+                entries = (const struct unit_cache_entry*) ((const uint8_t*) c->map + file->entries_off);
+                for (i = 0; i < file->entries_count; i++) {
+                        r = config_parse_assignment(unit, filename, entries[i].line, lookup, table,
+                                                    map_string(c, entries[i].section_off),
+                                                    entries[i].section_line,
+                                                    map_string(c, entries[i].lvalue_off),
+                                                    map_string(c, entries[i].rvalue_off),
+                                                    false, userdata);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = set_ensure_allocated(&c->used, trivial_hash_func, trivial_compare_func);
+                if (r < 0)
+                        return r;
+
+                r = set_put(c->used, (void*) file);
+                if (r < 0 && r != -EEXIST)
+                        return r;
+
+                return 0;
+        }
+
+        c->misses++;
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f) {
+                        log_error("Failed to open configuration file '%s': %m", filename);
+                        return -errno;
+                }
+        }
+
+        return unit_cache_record(c, unit, filename, f, &key, sections, lookup, table, allow_include, userdata);
+}
+
+/* Strings are first stored with their offset in the string buffer plus
+ * one, they are relocated when the position of the buffer is known */
+static int add_string(struct strbuf *sb, const char *s, size_t len, uint64_t *ret) {
+        ssize_t off;
+
+        if (!s) {
+                *ret = 0;
+                return 0;
+        }
+
+        off = strbuf_add_string(sb, s, len);
+        if (off < 0)
+                return off;
+
+        *ret = (uint64_t) off + 1;
+        return 0;
+}
+
+static int add_file(struct strbuf *sb,
+                    struct unit_cache_file *o,
+                    const char *path,
+                    const char *sections,
+                    size_t sections_size,
+                    const UnitCacheKey *key,
+                    uint64_t entries_idx,
+                    uint64_t entries_count) {
+        int r;
+
+        r = add_string(sb, path, strlen(path), &o->path_off);
+        if (r < 0)
+                return r;
+
+        r = add_string(sb, sections, sections_size, &o->sections_off);
+        if (r < 0)
+                return r;
+
+        o->sections_size = sections_size;
+        o->dev = key->dev;
+        o->ino = key->ino;
+        o->size = key->size;
+        o->mtime = key->mtime;
+        o->ctime = key->ctime;
+        o->entries_off = entries_idx;
+        o->entries_count = entries_count;
+
+        return 0;
+}
+
+static int add_entry(struct strbuf *sb,
+                     struct unit_cache_entry *o,
+                     unsigned line,
+                     unsigned section_line,
+                     const char *section,
+                     const char *lvalue,
+                     const char *rvalue) {
+        int r;
+
+        o->line = line;
+        o->section_line = section_line;
+
+        r = add_string(sb, section, section ? strlen(section) : 0, &o->section_off);
+        if (r < 0)
+                return r;
+
+        r = add_string(sb, lvalue, strlen(lvalue), &o->lvalue_off);
+        if (r < 0)
+                return r;
+
+        return add_string(sb, rvalue, strlen(rvalue), &o->rvalue_off);
+}
+
+static void relocate(uint64_t *off, uint64_t strings_off) {
+        if (*off > 0)
+                *off = strings_off + *off - 1;
+}
+
+static int unit_cache_write(UnitCache *c, FILE *f) {
+        static const uint8_t sig[] = UNIT_CACHE_SIGNATURE;
+        struct unit_cache_header h = {};
+        _cleanup_free_ struct unit_cache_file *files = NULL;
+        _cleanup_free_ struct unit_cache_entry *entries = NULL;
+        size_t n_files = 0, n_entries = 0, nf = 0, ne = 0, k;
+        const struct unit_cache_file *file;
+        UnitCacheRecord *record;
+        struct strbuf *sb;
+        uint64_t entries_off, strings_off;
+        Iterator i;
+        int r;
+
+        assert(c);
+        assert(f);
+
+        /* Everything parsed since the cache was written, and the
+         * files of the cache which were used again; whatever was not
+         * loaded anymore is dropped */
+        HASHMAP_FOREACH(record, c->recorded, i) {
+                n_files++;
+                n_entries += record->n_entries;
+        }
+        SET_FOREACH(file, c->used, i) {
+                if (hashmap_get(c->recorded, map_string(c, file->path_off)))
+                        continue;
+
+                n_files++;
+                n_entries += file->entries_count;
+        }
+
+        files = new0(struct unit_cache_file, MAX(n_files, 1U));
+        entries = new0(struct unit_cache_entry, MAX(n_entries, 1U));
+        if (!files || !entries)
+                return -ENOMEM;
+
+        sb = strbuf_new();
+        if (!sb)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(record, c->recorded, i) {
+                unsigned n;
+
+                r = add_file(sb, files + nf++, record->path,
+                             record->sections, record->sections_size,
+                             &record->key, ne, record->n_entries);
+                if (r < 0)
+                        goto finish;
+
+                for (n = 0; n < record->n_entries; n++) {
+                        UnitCacheEntry *e = record->entries + n;
+
+                        r = add_entry(sb, entries + ne++, e->line, e->section_line,
+                                      e->section, e->lvalue, e->rvalue);
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        SET_FOREACH(file, c->used, i) {
+                const struct unit_cache_entry *e;
+                UnitCacheKey key;
+                uint64_t n;
+
+                if (hashmap_get(c->recorded, map_string(c, file->path_off)))
+                        continue;
+
+                key.dev = file->dev;
+                key.ino = file->ino;
+                key.size = file->size;
+                key.mtime = file->mtime;
+                key.ctime = file->ctime;
+
+                r = add_file(sb, files + nf++, map_string(c, file->path_off),
+                             map_string(c, file->sections_off), file->sections_size,
+                             &key, ne, file->entries_count);
+                if (r < 0)
+                        goto finish;
+
+                e = (const struct unit_cache_entry*) ((const uint8_t*) c->map + file->entries_off);
+                for (n = 0; n < file->entries_count; n++) {
+                        r = add_entry(sb, entries + ne++, e[n].line, e[n].section_line,
+                                      map_string(c, e[n].section_off),
+                                      map_string(c, e[n].lvalue_off),
+                                      map_string(c, e[n].rvalue_off));
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        assert(nf == n_files);
+        assert(ne == n_entries);
+
+        strbuf_complete(sb);
+
+        memcpy(h.signature, sig, sizeof(h.signature));
+        strncpy(h.version, PACKAGE_VERSION, sizeof(h.version));
+        h.header_size = sizeof(struct unit_cache_header);
+        h.file_record_size = sizeof(struct unit_cache_file);
+        h.entry_size = sizeof(struct unit_cache_entry);
+        h.files_off = sizeof(struct unit_cache_header);
+        h.files_count = n_files;
+
+        entries_off = h.files_off + n_files * sizeof(struct unit_cache_file);
+        strings_off = entries_off + n_entries * sizeof(struct unit_cache_entry);
+        h.file_size = strings_off + sb->len;
+
+        for (k = 0; k < n_files; k++) {
+                relocate(&files[k].path_off, strings_off);
+                relocate(&files[k].sections_off, strings_off);
+                files[k].entries_off = entries_off + files[k].entries_off * sizeof(struct unit_cache_entry);
+        }
+
+        for (k = 0; k < n_entries; k++) {
+                relocate(&entries[k].section_off, strings_off);
+                relocate(&entries[k].lvalue_off, strings_off);
+                relocate(&entries[k].rvalue_off, strings_off);
+        }
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(files, sizeof(struct unit_cache_file), n_files, f);
+        fwrite(entries, sizeof(struct unit_cache_entry), n_entries, f);
+        fwrite(sb->buf, 1, sb->len, f);
+
+        fflush(f);
+        r = ferror(f) ? -EIO : 0;
+
+finish:
+        strbuf_cleanup(sb);
+        return r;
+}
+
+/* Write out the files parsed since the last flush and the cached files
+ * which were used again, and switch over to the new cache file */
+int unit_cache_flush(UnitCache *c) {
+        _cleanup_free_ char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        UnitCacheRecord *record;
+        int r;
+
+        assert(c);
+
+        log_debug("Unit file cache: %u files replayed, %u files parsed.", c->hits, c->misses);
+        c->hits = c->misses = 0;
+
+        /* Nothing changed, the cache file is still accurate */
+        if (c->map && hashmap_isempty(c->recorded) && set_size(c->used) == hashmap_size(c->mapped)) {
+                set_clear(c->used);
+                return 0;
+        }
+
+        r = mkdir_parents_label(c->path, 0755);
+        if (r < 0)
+                goto finish;
+
+        r = fopen_temporary(c->path, &f, &t);
+        if (r < 0)
+                goto finish;
+
+        r = unit_cache_write(c, f);
+        if (r >= 0 && rename(t, c->path) < 0)
+                r = -errno;
+        if (r < 0)
+                unlink(t);
+
+finish:
+        unit_cache_unmap(c);
+
+        while ((record = hashmap_steal_first(c->recorded)))
+                unit_cache_record_free(record);
+
+        if (r < 0) {
+                log_warning("Failed to write unit file cache %s: %s", c->path, strerror(-r));
+                return r;
+        }
+
+        return unit_cache_map(c);
+}
@@ -0,0 +1,48 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "conf-parser.h"
+
+/* A cache of the tokenized assignments of unit files and drop-ins,
+ * keyed by path, inode, size and timestamps. Files that did not change
+ * since they were last parsed are not read again, their assignments
+ * are replayed from the cache into the configuration parsers. The
+ * cache is written to an mmap()able file, so that it survives
+ * daemon-reexec and the switch from the initrd. */
+
+typedef struct UnitCache UnitCache;
+
+int unit_cache_new(UnitCache **ret, const char *path);
+void unit_cache_free(UnitCache *c);
+
+int unit_cache_parse(UnitCache *c,
+                     const char *unit,
+                     const char *filename,
+                     FILE *f,
+                     const char *sections,  /* nulstr */
+                     ConfigItemLookup lookup,
+                     void *table,
+                     bool allow_include,
+                     void *userdata);
+
+int unit_cache_flush(UnitCache *c);
@@ -310,6 +310,10 @@ void unit_add_to_cleanup_queue(Unit *u) {
 void unit_add_to_gc_queue(Unit *u) {
         assert(u);
 
+        /* Something changed, hence forget what a GC run in progress
+         * found out about this unit */
+        u->gc_marker = 0;
+
         if (u->in_gc_queue || u->in_cleanup_queue)
                 return;
 
@@ -339,25 +343,116 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Set *s) {
+static void dependency_records_free(UnitDependencyRecord *head) {
+        UnitDependencyRecord *r;
+
+        while ((r = head)) {
+                LIST_REMOVE(records, head, r);
+                free(r);
+        }
+}
+
+/* Returns 1 if a new record was added, 0 if an existing one was updated */
+static int unit_record_dependency(Unit *u, Unit *other, UnitDependency d, bool outgoing, bool add_reference, bool third_party) {
+        UnitDependencyRecord *head, *r;
+        int q;
+
+        assert(u);
+        assert(other);
+
+        head = hashmap_get(u->dependency_records, other);
+        LIST_FOREACH(records, r, head)
+                if (r->type == d && r->outgoing == outgoing) {
+                        r->add_reference = r->add_reference || add_reference;
+                        r->third_party = r->third_party || third_party;
+                        return 0;
+                }
+
+        q = hashmap_ensure_allocated(&u->dependency_records, trivial_hash_func, trivial_compare_func);
+        if (q < 0)
+                return q;
+
+        r = new0(UnitDependencyRecord, 1);
+        if (!r)
+                return -ENOMEM;
+
+        r->type = d;
+        r->outgoing = outgoing;
+        r->add_reference = add_reference;
+        r->third_party = third_party;
+
+        LIST_PREPEND(records, head, r);
+        q = hashmap_replace(u->dependency_records, other, head);
+        if (q < 0) {
+                LIST_REMOVE(records, head, r);
+                free(r);
+                return q;
+        }
+
+        return 1;
+}
+
+static void unit_forget_dependency_record(Unit *u, Unit *other, UnitDependency d, bool outgoing) {
+        UnitDependencyRecord *head, *r;
+
+        assert(u);
+        assert(other);
+
+        head = hashmap_get(u->dependency_records, other);
+        LIST_FOREACH(records, r, head)
+                if (r->type == d && r->outgoing == outgoing)
+                        break;
+        if (!r)
+                return;
+
+        LIST_REMOVE(records, head, r);
+        free(r);
+
+        if (head)
+                hashmap_replace(u->dependency_records, other, head);
+        else
+                hashmap_remove(u->dependency_records, other);
+}
+
+/* Re-key the records of u about 'from' to 'to' */
+static void unit_move_dependency_records(Unit *u, Unit *from, Unit *to) {
+        UnitDependencyRecord *head, *r;
+
+        head = hashmap_remove(u->dependency_records, from);
+
+        while ((r = head)) {
+                LIST_REMOVE(records, head, r);
+
+                if (to != u && unit_record_dependency(u, to, r->type, r->outgoing, r->add_reference, r->third_party) < 0)
+                        log_oom();
+
+                free(r);
+        }
+}
+
+static void bidi_set_free(Unit *u, PtrSet **s) {
         Iterator i;
         Unit *other;
 
         assert(u);
+        assert(s);
 
         /* Frees the set and makes sure we are dropped from the
          * inverse pointers */
 
-        SET_FOREACH(other, s, i) {
+        PTRSET_FOREACH(other, *s, i) {
                 UnitDependency d;
 
                 for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        set_remove(other->dependencies[d], u);
+                        ptrset_remove(&other->dependencies[d], u);
+
+                dependency_records_free(hashmap_remove(other->dependency_records, u));
 
                 unit_add_to_gc_queue(other);
         }
 
-        set_free(s);
+        ptrset_free(*s);
+        *s = NULL;
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -412,6 +507,7 @@ static void unit_free_requires_mounts_for(Unit *u) {
 }
 
 void unit_free(Unit *u) {
+        UnitDependencyRecord *head;
         UnitDependency d;
         Iterator i;
         char *t;
@@ -445,7 +541,11 @@ void unit_free(Unit *u) {
         }
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                bidi_set_free(u, u->dependencies[d]);
+                bidi_set_free(u, &u->dependencies[d]);
+
+        while ((head = hashmap_steal_first(u->dependency_records)))
+                dependency_records_free(head);
+        hashmap_free(u->dependency_records);
 
         if (u->type != _UNIT_TYPE_INVALID)
                 LIST_REMOVE(units_by_type, u->manager->units_by_type[u->type], u);
@@ -467,6 +567,9 @@ void unit_free(Unit *u) {
         if (u->in_cgroup_queue)
                 LIST_REMOVE(cgroup_queue, u->manager->cgroup_queue, u);
 
+        if (u->in_cgroup_empty_queue)
+                LIST_REMOVE(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
+
         if (u->cgroup_path) {
                 hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 free(u->cgroup_path);
@@ -552,26 +655,33 @@ static void merge_dependencies(Unit *u, Unit *other, UnitDependency d) {
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers */
-        SET_FOREACH(back, other->dependencies[d], i) {
+        PTRSET_FOREACH(back, other->dependencies[d], i) {
                 UnitDependency k;
 
+                /* Our own sets are fixed up below, after the move */
+                if (back == u)
+                        continue;
+
                 for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
-                        r = set_remove_and_put(back->dependencies[k], other, u);
+                        r = ptrset_remove_and_put(&back->dependencies[k], other, u);
                         if (r == -EEXIST)
-                                set_remove(back->dependencies[k], other);
+                                ptrset_remove(&back->dependencies[k], other);
                         else
                                 assert(r >= 0 || r == -ENOENT);
                 }
         }
 
-        complete_move(&u->dependencies[d], &other->dependencies[d]);
+        /* Room was made in unit_merge(), hence this cannot fail */
+        assert_se(ptrset_move(&u->dependencies[d], &other->dependencies[d]) >= 0);
 
-        set_free(other->dependencies[d]);
-        other->dependencies[d] = NULL;
+        /* We won't allow dependencies on ourselves */
+        ptrset_remove(&u->dependencies[d], other);
+        ptrset_remove(&u->dependencies[d], u);
 }
 
 int unit_merge(Unit *u, Unit *other) {
         UnitDependency d;
+        int r;
 
         assert(u);
         assert(other);
@@ -602,6 +712,14 @@ int unit_merge(Unit *u, Unit *other) {
         if (!UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(other)))
                 return -EEXIST;
 
+        /* Make room for the dependencies of the other unit first, so
+         * that running out of memory leaves both units untouched */
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
+                r = ptrset_reserve(&u->dependencies[d], ptrset_size(other->dependencies[d]));
+                if (r < 0)
+                        return r;
+        }
+
         /* Merge names */
         merge_names(u, other);
 
@@ -609,6 +727,30 @@ int unit_merge(Unit *u, Unit *other) {
         while (other->refs)
                 unit_ref_set(other->refs, u);
 
+        /* Merge dependency records, before the back pointers change */
+        if (u->manager->incremental_reload) {
+                Unit *back;
+                Iterator i;
+
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                        PTRSET_FOREACH(back, other->dependencies[d], i)
+                                unit_move_dependency_records(back, other, u);
+
+                while ((back = hashmap_first_key(other->dependency_records))) {
+                        UnitDependencyRecord *head, *rec;
+
+                        head = hashmap_remove(other->dependency_records, back);
+                        while ((rec = head)) {
+                                LIST_REMOVE(records, head, rec);
+
+                                if (back != u && unit_record_dependency(u, back, rec->type, rec->outgoing, rec->add_reference, rec->third_party) < 0)
+                                        log_oom();
+
+                                free(rec);
+                        }
+                }
+        }
+
         /* Merge dependencies */
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 merge_dependencies(u, other, d);
@@ -808,7 +950,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
                 Unit *other;
 
-                SET_FOREACH(other, u->dependencies[d], i)
+                PTRSET_FOREACH(other, u->dependencies[d], i)
                         fprintf(f, "%s\t%s: %s\n", prefix, unit_dependency_to_string(d), other->id);
         }
 
@@ -926,7 +1068,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (set_get(target->dependencies[UNIT_BEFORE], u))
+        if (ptrset_contains(target->dependencies[UNIT_BEFORE], u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true);
@@ -949,7 +1091,7 @@ static int unit_add_default_dependencies(Unit *u) {
         assert(u);
 
         for (k = 0; k < ELEMENTSOF(deps); k++)
-                SET_FOREACH(target, u->dependencies[deps[k]], i) {
+                PTRSET_FOREACH(target, u->dependencies[deps[k]], i) {
                         r = unit_add_default_target_dependency(u, target);
                         if (r < 0)
                                 return r;
@@ -1007,6 +1149,7 @@ static int unit_add_mount_links(Unit *u) {
 }
 
 int unit_load(Unit *u) {
+        Unit *loading;
         int r;
 
         assert(u);
@@ -1022,6 +1165,11 @@ int unit_load(Unit *u) {
         if (u->load_state != UNIT_STUB)
                 return 0;
 
+        /* Dependencies added from here on are asked for by this unit;
+         * loading it may load other units on the way */
+        loading = u->manager->loading_unit;
+        u->manager->loading_unit = u;
+
         if (UNIT_VTABLE(u)->load) {
                 r = UNIT_VTABLE(u)->load(u);
                 if (r < 0)
@@ -1048,7 +1196,7 @@ int unit_load(Unit *u) {
                         goto fail;
 
                 if (u->on_failure_job_mode == JOB_ISOLATE &&
-                    set_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                    ptrset_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
 
                         log_error_unit(u->id,
                                        "More than one OnFailure= dependencies specified for %s but OnFailureJobMode=isolate set. Refusing.", u->id);
@@ -1060,12 +1208,15 @@ int unit_load(Unit *u) {
 
         assert((u->load_state != UNIT_MERGED) == !u->merged_into);
 
+        u->manager->loading_unit = loading;
+
         unit_add_to_dbus_queue(unit_follow_merge(u));
         unit_add_to_gc_queue(u);
 
         return 0;
 
 fail:
+        u->manager->loading_unit = loading;
         u->load_state = u->load_state == UNIT_STUB ? UNIT_NOT_FOUND : UNIT_ERROR;
         u->load_error = r;
         unit_add_to_dbus_queue(u);
@@ -1347,19 +1498,19 @@ static void unit_check_unneeded(Unit *u) {
         if (!UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)))
                 return;
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY], i)
                 if (unit_active_or_pending(other))
                         return;
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY_OVERRIDABLE], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRED_BY_OVERRIDABLE], i)
                 if (unit_active_or_pending(other))
                         return;
 
-        SET_FOREACH(other, u->dependencies[UNIT_WANTED_BY], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_WANTED_BY], i)
                 if (unit_active_or_pending(other))
                         return;
 
-        SET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
                 if (unit_active_or_pending(other))
                         return;
 
@@ -1376,31 +1527,31 @@ static void retroactively_start_dependencies(Unit *u) {
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
+                if (!ptrset_contains(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, true, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        PTRSET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
+                if (!ptrset_contains(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, true, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES_OVERRIDABLE], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRES_OVERRIDABLE], i)
+                if (!ptrset_contains(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, false, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        PTRSET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
+                if (!ptrset_contains(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, false, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTS], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_CONFLICTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, true, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, true, NULL, NULL);
 }
@@ -1413,7 +1564,7 @@ static void retroactively_stop_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        SET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, true, NULL, NULL);
 }
@@ -1426,22 +1577,22 @@ static void check_unneeded_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Garbage collect services that might not be needed anymore, if enabled */
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES_OVERRIDABLE], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUIRES_OVERRIDABLE], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_REQUISITE], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUISITE], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_REQUISITE_OVERRIDABLE], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_REQUISITE_OVERRIDABLE], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
 }
@@ -1452,12 +1603,12 @@ void unit_start_on_failure(Unit *u) {
 
         assert(u);
 
-        if (set_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (ptrset_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
                 return;
 
         log_info_unit(u->id, "Triggering OnFailure= dependencies of %s.", u->id);
 
-        SET_FOREACH(other, u->dependencies[UNIT_ON_FAILURE], i) {
+        PTRSET_FOREACH(other, u->dependencies[UNIT_ON_FAILURE], i) {
                 int r;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, true, NULL, NULL);
@@ -1472,7 +1623,7 @@ void unit_trigger_notify(Unit *u) {
 
         assert(u);
 
-        SET_FOREACH(other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        PTRSET_FOREACH(other, u->dependencies[UNIT_TRIGGERED_BY], i)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -1752,7 +1903,7 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
                 [UNIT_RELOAD_PROPAGATED_FROM] = UNIT_PROPAGATES_RELOAD_TO,
                 [UNIT_JOINS_NAMESPACE_OF] = UNIT_JOINS_NAMESPACE_OF,
         };
-        int r, q = 0, v = 0, w = 0;
+        int r, q = 0, v = 0, w = 0, x = 0, y = 0;
 
         assert(u);
         assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
@@ -1766,32 +1917,12 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
         if (u == other)
                 return 0;
 
-        r = set_ensure_allocated(&u->dependencies[d], trivial_hash_func, trivial_compare_func);
-        if (r < 0)
-                return r;
-
-        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID) {
-                r = set_ensure_allocated(&other->dependencies[inverse_table[d]], trivial_hash_func, trivial_compare_func);
-                if (r < 0)
-                        return r;
-        }
-
-        if (add_reference) {
-                r = set_ensure_allocated(&u->dependencies[UNIT_REFERENCES], trivial_hash_func, trivial_compare_func);
-                if (r < 0)
-                        return r;
-
-                r = set_ensure_allocated(&other->dependencies[UNIT_REFERENCED_BY], trivial_hash_func, trivial_compare_func);
-                if (r < 0)
-                        return r;
-        }
-
-        q = set_put(u->dependencies[d], other);
+        q = ptrset_put(&u->dependencies[d], other);
         if (q < 0)
                 return q;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                v = set_put(other->dependencies[inverse_table[d]], u);
+                v = ptrset_put(&other->dependencies[inverse_table[d]], u);
                 if (v < 0) {
                         r = v;
                         goto fail;
@@ -1799,15 +1930,39 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
         }
 
         if (add_reference) {
-                w = set_put(u->dependencies[UNIT_REFERENCES], other);
+                w = ptrset_put(&u->dependencies[UNIT_REFERENCES], other);
                 if (w < 0) {
                         r = w;
                         goto fail;
                 }
 
-                r = set_put(other->dependencies[UNIT_REFERENCED_BY], u);
-                if (r < 0)
+                x = ptrset_put(&other->dependencies[UNIT_REFERENCED_BY], u);
+                if (x < 0) {
+                        r = x;
                         goto fail;
+                }
+        }
+
+        /* Remember which side's configuration asked for this, so
+         * that reloading only one of them restores the other's */
+        if (u->manager->incremental_reload) {
+                Unit *origin;
+
+                origin = u->manager->loading_unit ? unit_follow_merge(u->manager->loading_unit) : NULL;
+
+                if (origin != u) {
+                        y = unit_record_dependency(u, other, d, true, add_reference, origin != other);
+                        if (y < 0) {
+                                r = y;
+                                goto fail;
+                        }
+                }
+
+                if (origin != other) {
+                        r = unit_record_dependency(other, u, d, false, add_reference, origin != u);
+                        if (r < 0)
+                                goto fail;
+                }
         }
 
         unit_add_to_dbus_queue(u);
@@ -1815,13 +1970,19 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
 
 fail:
         if (q > 0)
-                set_remove(u->dependencies[d], other);
+                ptrset_remove(&u->dependencies[d], other);
 
         if (v > 0)
-                set_remove(other->dependencies[inverse_table[d]], u);
+                ptrset_remove(&other->dependencies[inverse_table[d]], u);
 
         if (w > 0)
-                set_remove(u->dependencies[UNIT_REFERENCES], other);
+                ptrset_remove(&u->dependencies[UNIT_REFERENCES], other);
+
+        if (x > 0)
+                ptrset_remove(&other->dependencies[UNIT_REFERENCED_BY], u);
+
+        if (y > 0)
+                unit_forget_dependency_record(u, other, d, true);
 
         return r;
 }
@@ -3075,7 +3236,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        SET_FOREACH(other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        PTRSET_FOREACH(other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
 
                 *rt = unit_get_exec_runtime(other);
                 if (*rt) {
@@ -30,10 +30,12 @@ typedef struct UnitVTable UnitVTable;
 typedef enum UnitActiveState UnitActiveState;
 typedef enum UnitDependency UnitDependency;
 typedef struct UnitRef UnitRef;
+typedef struct UnitDependencyRecord UnitDependencyRecord;
 typedef struct UnitStatusMessageFormats UnitStatusMessageFormats;
 
 #include "sd-event.h"
 #include "set.h"
+#include "ptrset.h"
 #include "util.h"
 #include "list.h"
 #include "socket-util.h"
@@ -129,6 +131,18 @@ struct UnitRef {
         LIST_FIELDS(UnitRef, refs);
 };
 
+struct UnitDependencyRecord {
+        /* Remembers a dependency on another unit that the
+         * configuration of this unit did not ask for, so that it can
+         * be restored when only this unit is reloaded */
+
+        UnitDependency type;
+        bool outgoing:1;        /* We are the depending side */
+        bool add_reference:1;
+        bool third_party:1;     /* Neither side's configuration asked for it */
+        LIST_FIELDS(UnitDependencyRecord, records);
+};
+
 struct Unit {
         Manager *manager;
 
@@ -140,7 +154,11 @@ struct Unit {
         char *instance;
 
         Set *names;
-        Set *dependencies[_UNIT_DEPENDENCY_MAX];
+        PtrSet *dependencies[_UNIT_DEPENDENCY_MAX];
+
+        /* Other unit -> list of UnitDependencyRecord, only
+         * maintained when units may be reloaded incrementally */
+        Hashmap *dependency_records;
 
         char **requires_mounts_for;
 
@@ -203,6 +221,9 @@ struct Unit {
         /* CGroup realize members queue */
         LIST_FIELDS(Unit, cgroup_queue);
 
+        /* CGroup empty check queue */
+        LIST_FIELDS(Unit, cgroup_empty_queue);
+
         /* Used during GC sweeps */
         unsigned gc_marker;
 
@@ -253,6 +274,7 @@ struct Unit {
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
         bool in_cgroup_queue:1;
+        bool in_cgroup_empty_queue:1;
 
         bool sent_dbus_new_signal:1;
 
@@ -461,7 +483,7 @@ extern const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX];
 /* For casting the various unit types into a unit */
 #define UNIT(u) (&(u)->meta)
 
-#define UNIT_TRIGGER(u) ((Unit*) set_first((u)->dependencies[UNIT_TRIGGERS]))
+#define UNIT_TRIGGER(u) ((Unit*) ptrset_first((u)->dependencies[UNIT_TRIGGERS]))
 
 DEFINE_CAST(SERVICE, Service);
 DEFINE_CAST(SOCKET, Socket);
@@ -438,5 +438,12 @@ _public_ int sd_bus_query_sender_creds(sd_bus_message *call, uint64_t mask, sd_b
                         return sd_bus_get_peer_creds(call->bus, mask, creds);
         }
 
+        /* The missing bits are read from /proc for every call, and
+         * deliberately not cached per connection: apart from the
+         * start time, all of them may change while the PID stays the
+         * same. COMM, EXE and CMDLINE change on execve(), UID and GID
+         * on setuid(), CGROUP and everything derived from it when the
+         * process is moved, and the audit data once it is set.
+         * Authorization checks must never see stale values. */
         return bus_creds_extend_by_pid(c, mask, creds);
 }
@@ -105,7 +105,7 @@ struct node_vtable {
 };
 
 struct vtable_member {
-        const char *path;
+        struct node *node;
         const char *interface;
         const char *member;
         struct node_vtable *parent;
@@ -150,6 +150,7 @@ struct sd_bus {
 
         bool is_kernel:1;
         bool can_fds:1;
+        bool can_memfd_payload:1;
         bool bus_client:1;
         bool ucred_valid:1;
         bool is_server:1;
@@ -159,6 +160,7 @@ struct sd_bus {
         bool match_callbacks_modified:1;
         bool filter_callbacks_modified:1;
         bool nodes_modified:1;
+        bool coalesce_properties:1;
 
         int use_memfd;
 
@@ -186,6 +188,10 @@ struct sd_bus {
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
 
+        /* PropertiesChanged signals queued while coalescing, keyed
+         * by object path and interface */
+        Hashmap *properties_changed;
+
         union {
                 struct sockaddr sa;
                 struct sockaddr_un un;
@@ -248,6 +254,7 @@ struct sd_bus {
         sd_event_source *output_io_event_source;
         sd_event_source *time_event_source;
         sd_event_source *quit_event_source;
+        sd_event_source *properties_changed_event_source;
         sd_event *event;
 
         sd_bus_message *current;
@@ -1070,23 +1070,18 @@ static int process_get_managed_objects(
 static int object_find_and_run(
                 sd_bus *bus,
                 sd_bus_message *m,
-                const char *p,
+                struct node *n,
                 bool require_fallback,
                 bool *found_object) {
 
-        struct node *n;
         struct vtable_member vtable_key, *v;
         int r;
 
         assert(bus);
         assert(m);
-        assert(p);
+        assert(n);
         assert(found_object);
 
-        n = hashmap_get(bus->nodes, p);
-        if (!n)
-                return 0;
-
         /* First, try object callbacks */
         r = node_callbacks_run(bus, m, n->callbacks, require_fallback, found_object);
         if (r != 0)
@@ -1098,7 +1093,7 @@ static int object_find_and_run(
                 return 0;
 
         /* Then, look for a known method */
-        vtable_key.path = (char*) p;
+        vtable_key.node = n;
         vtable_key.interface = m->interface;
         vtable_key.member = m->member;
 
@@ -1123,7 +1118,7 @@ static int object_find_and_run(
                         if (r < 0)
                                 return r;
 
-                        vtable_key.path = (char*) p;
+                        vtable_key.node = n;
 
                         r = sd_bus_message_read(m, "ss", &vtable_key.interface, &vtable_key.member);
                         if (r < 0)
@@ -1208,20 +1203,32 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         pl = strlen(m->path);
         do {
                 char prefix[pl+1];
+                struct node *n;
 
                 bus->nodes_modified = false;
 
-                r = object_find_and_run(bus, m, m->path, false, &found_object);
-                if (r != 0)
-                        return r;
-
-                /* Look for fallback prefixes */
-                OBJECT_PATH_FOREACH_PREFIX(prefix, m->path) {
+                n = hashmap_get(bus->nodes, m->path);
+                if (n) {
+                        r = object_find_and_run(bus, m, n, false, &found_object);
+                        if (r != 0)
+                                return r;
 
-                        if (bus->nodes_modified)
-                                break;
+                        n = n->parent;
+                } else
+                        /* Find the closest registered prefix */
+                        OBJECT_PATH_FOREACH_PREFIX(prefix, m->path) {
+                                n = hashmap_get(bus->nodes, prefix);
+                                if (n)
+                                        break;
+                        }
 
-                        r = object_find_and_run(bus, m, prefix, true, &found_object);
+                /* Look for fallback prefixes. Since all parents of
+                 * a node are allocated with it, we can simply follow
+                 * the tree upwards from here, and need no further
+                 * lookups. Any modification of the tree might free
+                 * nodes, hence start from the beginning then. */
+                for (; n && !bus->nodes_modified; n = n->parent) {
+                        r = object_find_and_run(bus, m, n, true, &found_object);
                         if (r != 0)
                                 return r;
                 }
@@ -1321,6 +1328,10 @@ static void bus_node_gc(sd_bus *b, struct node *n) {
 
         assert(hashmap_remove(b->nodes, n->path) == n);
 
+        /* Make sure nobody keeps walking the tree across a freed
+         * node */
+        b->nodes_modified = true;
+
         if (n->parent)
                 LIST_REMOVE(siblings, n->parent->child, n);
 
@@ -1454,7 +1465,7 @@ static void free_node_vtable(sd_bus *bus, struct node_vtable *w) {
                         case _SD_BUS_VTABLE_METHOD: {
                                 struct vtable_member key;
 
-                                key.path = w->node->path;
+                                key.node = w->node;
                                 key.interface = w->interface;
                                 key.member = v->x.method.member;
 
@@ -1466,7 +1477,7 @@ static void free_node_vtable(sd_bus *bus, struct node_vtable *w) {
                         case _SD_BUS_VTABLE_WRITABLE_PROPERTY: {
                                 struct vtable_member key;
 
-                                key.path = w->node->path;
+                                key.node = w->node;
                                 key.interface = w->interface;
                                 key.member = v->x.property.member;
                                 x = hashmap_remove(bus->vtable_properties, &key);
@@ -1486,8 +1497,12 @@ static unsigned vtable_member_hash_func(const void *a) {
 
         assert(m);
 
+        /* Nodes are unique per path, hence we can hash and compare
+         * them by pointer, instead of hashing the full path on each
+         * lookup. */
+
         return
-                string_hash_func(m->path) ^
+                trivial_hash_func(m->node) ^
                 string_hash_func(m->interface) ^
                 string_hash_func(m->member);
 }
@@ -1499,9 +1514,8 @@ static int vtable_member_compare_func(const void *a, const void *b) {
         assert(x);
         assert(y);
 
-        r = strcmp(x->path, y->path);
-        if (r != 0)
-                return r;
+        if (x->node != y->node)
+                return x->node < y->node ? -1 : 1;
 
         r = strcmp(x->interface, y->interface);
         if (r != 0)
@@ -1606,7 +1620,7 @@ static int add_object_vtable_internal(
                         }
 
                         m->parent = c;
-                        m->path = n->path;
+                        m->node = n;
                         m->interface = c->interface;
                         m->member = v->x.method.member;
                         m->vtable = v;
@@ -1649,7 +1663,7 @@ static int add_object_vtable_internal(
                         }
 
                         m->parent = c;
-                        m->path = n->path;
+                        m->node = n;
                         m->interface = c->interface;
                         m->member = v->x.property.member;
                         m->vtable = v;
@@ -1891,7 +1905,7 @@ static int emit_properties_changed_on_interface(
         if (r < 0)
                 return r;
 
-        key.path = prefix;
+        key.node = n;
         key.interface = interface;
 
         LIST_FOREACH(vtables, c, n->vtables) {
@@ -2017,7 +2031,7 @@ static int emit_properties_changed_on_interface(
         return 1;
 }
 
-_public_ int sd_bus_emit_properties_changed_strv(
+static int emit_properties_changed_now(
                 sd_bus *bus,
                 const char *path,
                 const char *interface,
@@ -2027,14 +2041,9 @@ _public_ int sd_bus_emit_properties_changed_strv(
         char *prefix;
         int r;
 
-        assert_return(bus, -EINVAL);
-        assert_return(object_path_is_valid(path), -EINVAL);
-        assert_return(interface_name_is_valid(interface), -EINVAL);
-        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
-
-        if (strv_isempty(names))
-                return 0;
+        assert(bus);
+        assert(path);
+        assert(interface);
 
         do {
                 bus->nodes_modified = false;
@@ -2059,6 +2068,181 @@ _public_ int sd_bus_emit_properties_changed_strv(
         return -ENOENT;
 }
 
+struct properties_changed {
+        char *id;
+        char *path;
+        char *interface;
+        char **names;
+};
+
+static void properties_changed_free(struct properties_changed *c) {
+        if (!c)
+                return;
+
+        free(c->id);
+        free(c->path);
+        free(c->interface);
+        strv_free(c->names);
+        free(c);
+}
+
+void bus_properties_changed_free(sd_bus *bus) {
+        struct properties_changed *c;
+
+        assert(bus);
+
+        while ((c = hashmap_steal_first(bus->properties_changed)))
+                properties_changed_free(c);
+
+        hashmap_free(bus->properties_changed);
+        bus->properties_changed = NULL;
+}
+
+int bus_properties_changed_flush(sd_bus *bus) {
+        struct properties_changed *c;
+        int r = 0;
+
+        assert(bus);
+
+        /* The hashmap iterates in insertion order, hence signals go
+         * out in the order they were first requested, with the
+         * property values as they are now. */
+
+        while ((c = hashmap_steal_first(bus->properties_changed))) {
+                int k;
+
+                if (BUS_IS_OPEN(bus->state)) {
+                        k = emit_properties_changed_now(bus, c->path, c->interface, c->names);
+
+                        /* The object might have gone away since the
+                         * change was queued, that's fine. */
+                        if (k < 0 && k != -ENOENT && r >= 0)
+                                r = k;
+                }
+
+                properties_changed_free(c);
+        }
+
+        return r;
+}
+
+static int properties_changed_dispatch(sd_event_source *s, void *userdata) {
+        sd_bus *bus = userdata;
+        int r;
+
+        assert(bus);
+
+        r = bus_properties_changed_flush(bus);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int queue_properties_changed(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                char **names) {
+
+        struct properties_changed *c;
+        _cleanup_free_ char *id = NULL;
+        char **property;
+        int r;
+
+        assert(bus);
+        assert(bus->event);
+        assert(path);
+        assert(interface);
+
+        STRV_FOREACH(property, names)
+                assert_return(member_name_is_valid(*property), -EINVAL);
+
+        /* Neither object paths nor interface names may contain a
+         * space, so this is unique */
+        id = strjoin(path, " ", interface, NULL);
+        if (!id)
+                return -ENOMEM;
+
+        c = hashmap_get(bus->properties_changed, id);
+        if (c) {
+                STRV_FOREACH(property, names) {
+                        if (strv_contains(c->names, *property))
+                                continue;
+
+                        r = strv_extend(&c->names, *property);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 1;
+        }
+
+        r = hashmap_ensure_allocated(&bus->properties_changed, string_hash_func, string_compare_func);
+        if (r < 0)
+                return r;
+
+        if (!bus->properties_changed_event_source) {
+                r = sd_event_add_defer(bus->event, properties_changed_dispatch, bus, &bus->properties_changed_event_source);
+                if (r < 0)
+                        return r;
+
+                /* Run after everything else that is pending, so that
+                 * all changes made in the meantime are merged */
+                r = sd_event_source_set_priority(bus->properties_changed_event_source, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0)
+                        return r;
+        } else {
+                r = sd_event_source_set_enabled(bus->properties_changed_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        return r;
+        }
+
+        c = new0(struct properties_changed, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->path = strdup(path);
+        c->interface = strdup(interface);
+        c->names = strv_copy(names);
+        if (!c->path || !c->interface || !c->names) {
+                properties_changed_free(c);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(bus->properties_changed, id, c);
+        if (r < 0) {
+                properties_changed_free(c);
+                return r;
+        }
+
+        c->id = id;
+        id = NULL;
+
+        return 1;
+}
+
+_public_ int sd_bus_emit_properties_changed_strv(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                char **names) {
+
+        assert_return(bus, -EINVAL);
+        assert_return(object_path_is_valid(path), -EINVAL);
+        assert_return(interface_name_is_valid(interface), -EINVAL);
+        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (strv_isempty(names))
+                return 0;
+
+        if (bus->coalesce_properties && bus->event)
+                return queue_properties_changed(bus, path, interface, names);
+
+        return emit_properties_changed_now(bus, path, interface, names);
+}
+
 _public_ int sd_bus_emit_properties_changed(
                 sd_bus *bus,
                 const char *path,
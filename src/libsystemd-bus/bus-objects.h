@@ -24,3 +24,6 @@
 #include "bus-internal.h"
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
+
+int bus_properties_changed_flush(sd_bus *bus);
+void bus_properties_changed_free(sd_bus *bus);
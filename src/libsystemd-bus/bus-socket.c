@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/poll.h>
+#include <sys/ioctl.h>
 #include <byteswap.h>
 
 #include "util.h"
@@ -38,6 +39,23 @@
 #include "bus-internal.h"
 #include "bus-message.h"
 
+/* If both sides agreed on NEGOTIATE_MEMFD_PAYLOAD during
+ * authentication, sealed memfd body parts of at least MEMFD_MIN_SIZE
+ * are not copied into the stream, but passed along as file
+ * descriptors, following the message's own ones in the same
+ * SCM_RIGHTS control message. Such messages carry this flag in the
+ * header and are followed, right after the header fields, by a
+ * native endian table of the body ranges that have been cut out of
+ * the stream, prefixed by the number of entries. The receiver glues
+ * the body parts back together, hence none of this is visible on the
+ * message level. */
+#define BUS_MESSAGE_MEMFD_PAYLOAD 0x80
+
+struct bus_memfd_payload {
+        uint64_t offset;
+        uint64_t size;
+} _packed_;
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -166,16 +184,27 @@ static int bus_socket_write_auth(sd_bus *b) {
         return 1;
 }
 
+static bool bus_socket_offer_memfd_payload(sd_bus *b) {
+        assert(b);
+
+        /* Passing memfds instead of inline payload is our own
+         * extension and only makes sense between two sd-bus peers
+         * talking directly to each other. A bus broker would have to
+         * understand it too, hence don't bother offering it there. */
+
+        return (b->hello_flags & KDBUS_HELLO_ACCEPT_FD) && !b->bus_client;
+}
+
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *e, *f, *start;
+        char *e, *f, *g, *start;
         sd_id128_t peer;
         unsigned i;
         int r;
 
         assert(b);
 
-        /* We expect two response lines: "OK" and possibly
-         * "AGREE_UNIX_FD" */
+        /* We expect up to three response lines: "OK" and possibly
+         * "AGREE_UNIX_FD" and "AGREE_MEMFD_PAYLOAD" */
 
         e = memmem(b->rbuffer, b->rbuffer_size, "\r\n", 2);
         if (!e)
@@ -192,6 +221,15 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 start = e + 2;
         }
 
+        if (bus_socket_offer_memfd_payload(b)) {
+                g = memmem(f + 2, b->rbuffer_size - (f - (char*) b->rbuffer) - 2, "\r\n", 2);
+                if (!g)
+                        return 0;
+
+                start = g + 2;
+        } else
+                g = NULL;
+
         /* Nice! We got all the lines we need. First check the OK
          * line */
 
@@ -228,6 +266,14 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         (f - e == sizeof("\r\nAGREE_UNIX_FD") - 1) &&
                         memcmp(e + 2, "AGREE_UNIX_FD", sizeof("AGREE_UNIX_FD") - 1) == 0;
 
+        /* And the third one */
+
+        if (g)
+                b->can_memfd_payload =
+                        b->can_fds &&
+                        (g - f == sizeof("\r\nAGREE_MEMFD_PAYLOAD") - 1) &&
+                        memcmp(f + 2, "AGREE_MEMFD_PAYLOAD", sizeof("AGREE_MEMFD_PAYLOAD") - 1) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -470,6 +516,13 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD_PAYLOAD")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd_payload = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD_PAYLOAD\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -653,7 +706,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (!b->auth_buffer)
                 return -ENOMEM;
 
-        if (b->hello_flags & KDBUS_HELLO_ACCEPT_FD)
+        if (bus_socket_offer_memfd_payload(b))
+                auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nNEGOTIATE_MEMFD_PAYLOAD\r\nBEGIN\r\n";
+        else if (b->hello_flags & KDBUS_HELLO_ACCEPT_FD)
                 auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n";
         else
                 auth_suffix = "\r\nBEGIN\r\n";
@@ -779,56 +834,201 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
+static bool part_is_memfd_payload(sd_bus *bus, struct bus_body_part *part) {
+        assert(bus);
+        assert(part);
+
+        return bus->can_memfd_payload &&
+                part->memfd >= 0 &&
+                part->sealed &&
+                part->size >= MEMFD_MIN_SIZE;
+}
+
+static unsigned message_count_memfd_payload(sd_bus *bus, sd_bus_message *m, uint64_t *size) {
+        struct bus_body_part *part;
+        unsigned i, n = 0;
+        uint64_t sz = 0;
+
+        assert(bus);
+        assert(m);
+
+        if (!bus->can_memfd_payload)
+                goto finish;
+
+        MESSAGE_FOREACH_PART(part, i, m)
+                if (part_is_memfd_payload(bus, part)) {
+                        sz += part->size;
+                        n++;
+                }
+
+finish:
+        if (size)
+                *size = sz;
+
+        return n;
+}
+
+size_t bus_socket_message_size(sd_bus *bus, sd_bus_message *m) {
+        uint64_t sz;
+        unsigned n;
+
+        assert(bus);
+        assert(m);
+
+        /* Returns the number of bytes the message takes up in the
+         * stream */
+
+        n = message_count_memfd_payload(bus, m, &sz);
+        if (n <= 0)
+                return BUS_MESSAGE_SIZE(m);
+
+        return BUS_MESSAGE_SIZE(m) - sz + sizeof(uint64_t) + n * sizeof(struct bus_memfd_payload);
+}
+
+static int bus_message_setup_iovec_memfd_payload(
+                sd_bus *bus,
+                sd_bus_message *m,
+                struct bus_header *header,
+                uint64_t *table,
+                struct iovec *iov,
+                unsigned *n_iov,
+                int *fds) {
+
+        struct bus_memfd_payload *t;
+        struct bus_body_part *part;
+        size_t offset = 0;
+        unsigned i, n = 0, k = 0;
+        int r;
+
+        assert(bus);
+        assert(m);
+        assert(header);
+        assert(table);
+        assert(iov);
+        assert(n_iov);
+        assert(fds);
+
+        /* We copy the fixed header here, since we only want to set
+         * the flag for this stream, and the very same message might
+         * be sent to other peers as well */
+        memcpy(header, m->header, sizeof(struct bus_header));
+        header->flags |= BUS_MESSAGE_MEMFD_PAYLOAD;
+
+        iov[k].iov_base = header;
+        iov[k++].iov_len = sizeof(struct bus_header);
+
+        iov[k].iov_base = (uint8_t*) m->header + sizeof(struct bus_header);
+        iov[k++].iov_len = BUS_MESSAGE_BODY_BEGIN(m) - sizeof(struct bus_header);
+
+        iov[k++].iov_base = table;
+
+        t = (struct bus_memfd_payload*) (table + 1);
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+
+                if (part_is_memfd_payload(bus, part)) {
+                        t[n].offset = offset;
+                        t[n].size = part->size;
+                        fds[n] = part->memfd;
+                        n++;
+                } else if (part->size > 0) {
+                        r = bus_body_part_map(part);
+                        if (r < 0)
+                                return r;
+
+                        iov[k].iov_base = part->data;
+                        iov[k++].iov_len = part->size;
+                }
+
+                offset += part->size;
+        }
+
+        assert(n > 0);
+
+        table[0] = n;
+        iov[2].iov_len = sizeof(uint64_t) + n * sizeof(struct bus_memfd_payload);
+
+        *n_iov = k;
+        return 0;
+}
+
 int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         struct iovec *iov;
         ssize_t k;
         size_t n;
-        unsigned j;
-        int r;
+        unsigned j, n_iov, n_payload;
+        int *fds, r;
 
         assert(bus);
         assert(m);
         assert(idx);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        if (*idx >= bus_socket_message_size(bus, m))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        n_payload = message_count_memfd_payload(bus, m, NULL);
+        if (n_payload > 0) {
+                struct bus_header *header;
+                uint64_t *table;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy(iov, m->iovec, n);
+                header = alloca(sizeof(struct bus_header));
+                table = alloca(sizeof(uint64_t) + n_payload * sizeof(struct bus_memfd_payload));
+                iov = alloca((3 + m->n_body_parts) * sizeof(struct iovec));
+                fds = alloca((m->n_fds + n_payload) * sizeof(int));
+
+                r = bus_message_setup_iovec_memfd_payload(bus, m, header, table, iov, &n_iov, fds + m->n_fds);
+                if (r < 0) {
+                        m->poisoned = true;
+                        return r;
+                }
+
+                memcpy(fds, m->fds, sizeof(int) * m->n_fds);
+        } else {
+                r = bus_message_setup_iovec(m);
+                if (r < 0)
+                        return r;
+
+                n = m->n_iovec * sizeof(struct iovec);
+                iov = alloca(n);
+                memcpy(iov, m->iovec, n);
+                n_iov = m->n_iovec;
+
+                fds = m->fds;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iov);
         else {
                 struct msghdr mh;
+                unsigned n_fds;
                 zero(mh);
 
-                if (m->n_fds > 0) {
+                /* The fds are attached to the first byte of the
+                 * message only */
+                n_fds = *idx > 0 ? 0 : m->n_fds + n_payload;
+
+                if (n_fds > 0) {
                         struct cmsghdr *control;
-                        control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
+                        control = alloca(CMSG_SPACE(sizeof(int) * n_fds));
 
                         mh.msg_control = control;
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+                        memcpy(CMSG_DATA(control), fds, sizeof(int) * n_fds);
                 }
 
                 mh.msg_iov = iov;
-                mh.msg_iovlen = m->n_iovec;
+                mh.msg_iovlen = n_iov;
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iov);
                 }
         }
 
@@ -884,6 +1084,48 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return -EBADMSG;
 
         sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
+
+        if (((const uint8_t*) bus->rbuffer)[2] & BUS_MESSAGE_MEMFD_PAYLOAD) {
+                const struct bus_memfd_payload *t;
+                uint64_t begin, n, i, end = 0;
+
+                if (!bus->can_memfd_payload)
+                        return -EBADMSG;
+
+                /* The payload table follows the header fields,
+                 * hence we need to read that first, before we know
+                 * how much is actually left in the stream */
+
+                begin = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8);
+                if (bus->rbuffer_size < begin + sizeof(uint64_t)) {
+                        *need = (size_t) (begin + sizeof(uint64_t));
+                        return 0;
+                }
+
+                n = *(const uint64_t*) ((const uint8_t*) bus->rbuffer + begin);
+                if (n <= 0 || n > BUS_FDS_MAX)
+                        return -EBADMSG;
+
+                begin += sizeof(uint64_t);
+                if (bus->rbuffer_size < begin + n * sizeof(struct bus_memfd_payload)) {
+                        *need = (size_t) (begin + n * sizeof(struct bus_memfd_payload));
+                        return 0;
+                }
+
+                t = (const struct bus_memfd_payload*) ((const uint8_t*) bus->rbuffer + begin);
+                for (i = 0; i < n; i++) {
+                        if (t[i].size <= 0 ||
+                            t[i].offset < end ||
+                            t[i].offset + t[i].size > a)
+                                return -EBADMSG;
+
+                        end = t[i].offset + t[i].size;
+                        sum -= t[i].size;
+                }
+
+                sum += sizeof(uint64_t) + n * sizeof(struct bus_memfd_payload);
+        }
+
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
 
@@ -891,6 +1133,125 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
+static int bus_socket_make_memfd_payload_message(sd_bus *bus, size_t size, sd_bus_message **ret) {
+        const struct bus_memfd_payload *t;
+        struct bus_body_part *part;
+        struct bus_header *h;
+        sd_bus_message *m;
+        size_t begin, body;
+        uint64_t offset = 0;
+        unsigned n, j;
+        int *fds, r;
+
+        assert(bus);
+        assert(ret);
+
+        h = bus->rbuffer;
+
+        /* Clear the flag again, since this message might be
+         * forwarded to a peer that does not know about it */
+        h->flags &= ~BUS_MESSAGE_MEMFD_PAYLOAD;
+
+        r = bus_message_from_header(bus, h, sizeof(struct bus_header), NULL, 0,
+                                    bus->ucred_valid ? &bus->ucred : NULL,
+                                    bus->label[0] ? bus->label : NULL,
+                                    0, &m);
+        if (r < 0)
+                return r;
+
+        /* bus_socket_read_message_need() already validated the
+         * table, but the fds for it need to be there, too. They are
+         * the last ones passed. */
+        begin = BUS_MESSAGE_BODY_BEGIN(m);
+        n = (unsigned) *(const uint64_t*) ((const uint8_t*) bus->rbuffer + begin);
+        t = (const struct bus_memfd_payload*) ((const uint8_t*) bus->rbuffer + begin + sizeof(uint64_t));
+        body = begin + sizeof(uint64_t) + n * sizeof(struct bus_memfd_payload);
+
+        if (bus->n_fds < n) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        m->fds = bus->fds;
+        m->n_fds = bus->n_fds - n;
+        fds = bus->fds + m->n_fds;
+
+        for (j = 0; j <= n; j++) {
+                uint64_t next, sz = 0;
+                int sealed = 0;
+
+                /* Inline material before the next memfd, or after
+                 * the last one */
+                next = j < n ? t[j].offset : BUS_MESSAGE_BODY_SIZE(m);
+                if (next > offset) {
+                        if (body + (next - offset) > size) {
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        part = message_append_part(m);
+                        if (!part) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        part->data = (uint8_t*) bus->rbuffer + body;
+                        part->size = next - offset;
+                        part->sealed = true;
+
+                        body += next - offset;
+                        offset = next;
+                }
+
+                if (j >= n)
+                        break;
+
+                /* Only accept sealed memfds, so that the sender
+                 * cannot modify the payload after the fact */
+                if (ioctl(fds[j], KDBUS_CMD_MEMFD_SEAL_GET, &sealed) < 0 || !sealed ||
+                    ioctl(fds[j], KDBUS_CMD_MEMFD_SIZE_GET, &sz) < 0 || sz != t[j].size) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                part = message_append_part(m);
+                if (!part) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                part->memfd = fds[j];
+                part->size = t[j].size;
+                part->sealed = true;
+
+                offset += t[j].size;
+        }
+
+        if (body != size) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        r = bus_message_parse_fields(m);
+        if (r < 0)
+                goto fail;
+
+        /* We take possession of the memory and fds now */
+        m->free_header = true;
+        m->free_fds = true;
+
+        *ret = m;
+        return 0;
+
+fail:
+        /* On failure the fds stay with the bus object */
+        MESSAGE_FOREACH_PART(part, j, m)
+                part->memfd = -1;
+
+        sd_bus_message_unref(m);
+        return r;
+}
+
 static int bus_socket_make_message(sd_bus *bus, size_t size) {
         sd_bus_message *t;
         void *b;
@@ -912,12 +1273,15 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         } else
                 b = NULL;
 
-        r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
-                                    bus->ucred_valid ? &bus->ucred : NULL,
-                                    bus->label[0] ? bus->label : NULL,
-                                    &t);
+        if (((struct bus_header*) bus->rbuffer)->flags & BUS_MESSAGE_MEMFD_PAYLOAD)
+                r = bus_socket_make_memfd_payload_message(bus, size, &t);
+        else
+                r = bus_message_from_malloc(bus,
+                                            bus->rbuffer, size,
+                                            bus->fds, bus->n_fds,
+                                            bus->ucred_valid ? &bus->ucred : NULL,
+                                            bus->label[0] ? bus->label : NULL,
+                                            &t);
         if (r < 0) {
                 free(b);
                 return r;
@@ -1010,7 +1374,7 @@ int bus_socket_read_message(sd_bus *bus) {
                                         return -EIO;
                                 }
 
-                                f = realloc(bus->fds, sizeof(int) + (bus->n_fds + n));
+                                f = realloc(bus->fds, sizeof(int) * (bus->n_fds + n));
                                 if (!f) {
                                         close_many((int*) CMSG_DATA(cmsg), n);
                                         return -ENOMEM;
@@ -123,6 +123,7 @@ static void bus_free(sd_bus *b) {
 
         assert(b);
 
+        bus_properties_changed_free(b);
         sd_bus_detach_event(b);
 
         bus_close_fds(b);
@@ -318,6 +319,20 @@ _public_ int sd_bus_set_anonymous(sd_bus *bus, int b) {
         return 0;
 }
 
+_public_ int sd_bus_set_coalesce_properties(sd_bus *bus, int b) {
+        int r = 0;
+
+        assert_return(bus, -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->coalesce_properties = !!b;
+
+        if (!bus->coalesce_properties)
+                r = bus_properties_changed_flush(bus);
+
+        return r;
+}
+
 static int hello_callback(sd_bus *bus, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
         const char *s;
         int r;
@@ -1308,7 +1323,7 @@ static int dispatch_wqueue(sd_bus *bus) {
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->is_kernel || bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
+                else if (bus->is_kernel || bus->windex >= bus_socket_message_size(bus, bus->wqueue[0])) {
                         /* Fully written. Let's drop the entry from
                          * the queue.
                          *
@@ -1429,7 +1444,7 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *serial) {
                                 bus_enter_closing(bus);
 
                         return r;
-                } else if (!bus->is_kernel && idx < BUS_MESSAGE_SIZE(m))  {
+                } else if (!bus->is_kernel && idx < bus_socket_message_size(bus, m))  {
                         /* Wasn't fully written. So let's remember how
                          * much was written. Note that the first entry
                          * of the wqueue array is always allocated so
@@ -2343,6 +2358,10 @@ _public_ int sd_bus_flush(sd_bus *bus) {
         if (r < 0)
                 return r;
 
+        r = bus_properties_changed_flush(bus);
+        if (r < 0)
+                return r;
+
         if (bus->wqueue_size <= 0)
                 return 0;
 
@@ -2627,6 +2646,15 @@ _public_ int sd_bus_detach_event(sd_bus *bus) {
         assert_return(bus, -EINVAL);
         assert_return(bus->event, -ENXIO);
 
+        /* Without the event loop nothing would dispatch the queued
+         * signals anymore, hence send them out now */
+        bus_properties_changed_flush(bus);
+
+        if (bus->properties_changed_event_source) {
+                sd_event_source_set_enabled(bus->properties_changed_event_source, SD_EVENT_OFF);
+                bus->properties_changed_event_source = sd_event_source_unref(bus->properties_changed_event_source);
+        }
+
         if (bus->input_io_event_source) {
                 sd_event_source_set_enabled(bus->input_io_event_source, SD_EVENT_OFF);
                 bus->input_io_event_source = sd_event_source_unref(bus->input_io_event_source);
@@ -0,0 +1,199 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "util.h"
+#include "log.h"
+#include "time-util.h"
+
+#include "sd-bus.h"
+#include "bus-internal.h"
+#include "bus-util.h"
+
+/* Resolves Get() calls on many objects exported via a fallback
+ * vtable, the way PID1 exposes one object per unit */
+
+#define UNIT_PREFIX "/org/freedesktop/systemd1/unit"
+#define N_OBJECTS_DEFAULT 10000
+#define BATCH 256
+
+static unsigned arg_n_objects = N_OBJECTS_DEFAULT;
+
+static int unit_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        uint32_t *units = userdata;
+        const char *e;
+        unsigned i;
+
+        e = startswith(path, UNIT_PREFIX "/u");
+        if (!e)
+                return 0;
+
+        if (safe_atou(e, &i) < 0 || i >= arg_n_objects)
+                return 0;
+
+        *found = units + i;
+        return 1;
+}
+
+static int manager_exit(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        bool *quit = userdata;
+
+        *quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable unit_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Id", "u", NULL, 0, 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable manager_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Exit", NULL, NULL, manager_exit, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void server(int fd) {
+        _cleanup_free_ uint32_t *units = NULL;
+        sd_bus *bus;
+        sd_id128_t id;
+        bool quit = false;
+        unsigned i;
+        int r;
+
+        units = new(uint32_t, arg_n_objects);
+        assert_se(units);
+
+        for (i = 0; i < arg_n_objects; i++)
+                units[i] = i;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+
+        assert_se(sd_bus_add_object_vtable(bus, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager", manager_vtable, &quit) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, UNIT_PREFIX, "org.freedesktop.systemd1.Unit", unit_vtable, unit_object_find, units) >= 0);
+
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (!quit) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        sd_bus_flush(bus);
+        sd_bus_unref(bus);
+}
+
+static int get_reply(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n_replies = userdata;
+        uint32_t u;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+        assert_se(sd_bus_message_read(m, "v", "u", &u) > 0);
+
+        (*n_replies)++;
+        return 0;
+}
+
+static void client(int fd) {
+        _cleanup_bus_unref_ sd_bus *bus = NULL;
+        unsigned i, n_replies = 0;
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_n_objects; i++) {
+                _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+                char path[sizeof(UNIT_PREFIX "/u") + DECIMAL_STR_MAX(unsigned)];
+
+                snprintf(path, sizeof(path), UNIT_PREFIX "/u%u", i);
+
+                assert_se(sd_bus_message_new_method_call(bus, NULL, path, "org.freedesktop.DBus.Properties", "Get", &m) >= 0);
+                assert_se(sd_bus_message_append(m, "ss", "org.freedesktop.systemd1.Unit", "Id") >= 0);
+                assert_se(sd_bus_call_async(bus, m, get_reply, &n_replies, 0, NULL) >= 0);
+
+                /* Keep a bounded number of calls in flight */
+                while (i + 1 - n_replies >= BATCH ||
+                       (i + 1 == arg_n_objects && n_replies < arg_n_objects)) {
+                        int r;
+
+                        r = sd_bus_process(bus, NULL);
+                        assert_se(r >= 0);
+
+                        if (r == 0)
+                                assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+                }
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        printf("Get() on %u fallback objects: %s, %llu calls/s\n",
+               arg_n_objects,
+               format_timespan(ts, sizeof(ts), t, 0),
+               (unsigned long long) (arg_n_objects * USEC_PER_SEC / MAX(t, 1ULL)));
+        fflush(stdout);
+
+        assert_se(sd_bus_call_method(bus, NULL, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager", "Exit", NULL, NULL, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        int pair[2];
+        pid_t pid;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_objects) >= 0 && arg_n_objects > 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                close_nointr_nofail(pair[0]);
+                client(pair[1]);
+                _exit(0);
+        }
+
+        close_nointr_nofail(pair[1]);
+        server(pair[0]);
+
+        assert_se(waitpid(pid, NULL, 0) == pid);
+
+        return 0;
+}
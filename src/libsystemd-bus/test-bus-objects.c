@@ -31,10 +31,12 @@
 #include "strv.h"
 
 #include "sd-bus.h"
+#include "sd-event.h"
 #include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-util.h"
 #include "bus-dump.h"
+#include "event-util.h"
 
 struct context {
         int fds[2];
@@ -143,6 +145,21 @@ static int notify_test(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_er
         return 1;
 }
 
+static int notify_coalesced(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned i;
+        int r;
+
+        for (i = 0; i < 3; i++) {
+                assert_se(sd_bus_emit_properties_changed(bus, "/value/a", "org.freedesktop.systemd.ValueTest", "Value", NULL) >= 0);
+                assert_se(sd_bus_emit_properties_changed(bus, "/value/b", "org.freedesktop.systemd.ValueTest", "Value", NULL) >= 0);
+        }
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
 static int emit_interfaces_added(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
         int r;
 
@@ -181,6 +198,7 @@ static const sd_bus_vtable vtable[] = {
 static const sd_bus_vtable vtable2[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("NotifyTest", "", "", notify_test, 0),
+        SD_BUS_METHOD("NotifyCoalesced", "", "", notify_coalesced, 0),
         SD_BUS_PROPERTY("Value", "s", value_handler, 10, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_VTABLE_END
 };
@@ -437,12 +455,81 @@ static int client(struct context *c) {
         return 0;
 }
 
+struct coalesce_test {
+        unsigned n_signals;
+        bool replied;
+};
+
+static int coalesce_filter(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct coalesce_test *t = userdata;
+
+        if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Properties", "PropertiesChanged")) {
+                bus_message_dump(m, stdout, true);
+                t->n_signals++;
+        }
+
+        return 0;
+}
+
+static int coalesce_reply(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct coalesce_test *t = userdata;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+        t->replied = true;
+
+        return 1;
+}
+
+static void test_coalesce(void) {
+        _cleanup_event_unref_ sd_event *e = NULL;
+        _cleanup_bus_unref_ sd_bus *server = NULL, *client = NULL;
+        _cleanup_bus_message_unref_ sd_bus_message *m = NULL;
+        struct coalesce_test t = {};
+        sd_id128_t id;
+        int fds[2];
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&server) >= 0);
+        assert_se(sd_bus_set_fd(server, fds[0], fds[0]) >= 0);
+        assert_se(sd_bus_set_server(server, 1, id) >= 0);
+        assert_se(sd_bus_set_coalesce_properties(server, 1) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(server, "/value", "org.freedesktop.systemd.ValueTest", vtable2, NULL, UINT_TO_PTR(20)) >= 0);
+        assert_se(sd_bus_start(server) >= 0);
+        assert_se(sd_bus_attach_event(server, e, 0) >= 0);
+
+        assert_se(sd_bus_new(&client) >= 0);
+        assert_se(sd_bus_set_fd(client, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_add_filter(client, coalesce_filter, &t) >= 0);
+        assert_se(sd_bus_start(client) >= 0);
+        assert_se(sd_bus_attach_event(client, e, 0) >= 0);
+
+        assert_se(sd_bus_message_new_method_call(client, NULL, "/value/a", "org.freedesktop.systemd.ValueTest", "NotifyCoalesced", &m) >= 0);
+        assert_se(sd_bus_call_async(client, m, coalesce_reply, &t, 0, NULL) >= 0);
+
+        while (!t.replied || t.n_signals < 2)
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 0);
+
+        /* Six changes on two objects, merged into one signal each */
+        while (sd_event_run(e, 0) > 0)
+                ;
+
+        assert_se(t.n_signals == 2);
+
+        sd_bus_detach_event(client);
+        sd_bus_detach_event(server);
+}
+
 int main(int argc, char *argv[]) {
         struct context c = {};
         pthread_t s;
         void *p;
         int r, q;
 
+        test_coalesce();
+
         zero(c);
 
         c.automatic_integer_property = 4711;
@@ -0,0 +1,324 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "util.h"
+#include "log.h"
+#include "time-util.h"
+
+#include "sd-bus.h"
+#include "bus-internal.h"
+#include "bus-util.h"
+
+/* Measures the sd-bus hot paths over the AF_UNIX socket
+ * transport. The server side is a forked peer in server mode,
+ * standing in for the bus daemon. Output is one tab separated line
+ * per measurement: benchmark, parameter, operations per second and
+ * microseconds per operation. */
+
+#define MAX_SIZE (4*1024*1024)
+#define MAX_MATCHES 1024
+#define SIGNALS_PER_CALL 64
+
+static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
+
+static int method_ping(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_work(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        const void *p;
+        size_t sz;
+        int r;
+
+        r = sd_bus_message_read_array(m, 'y', &p, &sz);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_emit(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        uint32_t i, n;
+        int r;
+
+        r = sd_bus_message_read(m, "u", &n);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++) {
+                r = sd_bus_emit_signal(bus, "/benchmark", "benchmark.server", "Changed", "u", i);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_exit(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        bool *quit = userdata;
+
+        *quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int property_get_u(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "u", 4711);
+}
+
+static int property_get_s(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "s", property);
+}
+
+#define PROPERTY_PAIR(n)                                                \
+        SD_BUS_PROPERTY("Number" #n, "u", property_get_u, 0, 0),        \
+        SD_BUS_PROPERTY("String" #n, "s", property_get_s, 0, 0)
+
+static const sd_bus_vtable server_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Ping", NULL, NULL, method_ping, 0),
+        SD_BUS_METHOD("Work", "ay", NULL, method_work, 0),
+        SD_BUS_METHOD("Emit", "u", NULL, method_emit, 0),
+        SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
+        PROPERTY_PAIR(0), PROPERTY_PAIR(1), PROPERTY_PAIR(2), PROPERTY_PAIR(3),
+        PROPERTY_PAIR(4), PROPERTY_PAIR(5), PROPERTY_PAIR(6), PROPERTY_PAIR(7),
+        PROPERTY_PAIR(8), PROPERTY_PAIR(9), PROPERTY_PAIR(10), PROPERTY_PAIR(11),
+        PROPERTY_PAIR(12), PROPERTY_PAIR(13), PROPERTY_PAIR(14), PROPERTY_PAIR(15),
+        SD_BUS_VTABLE_END
+};
+
+static void server(int fd) {
+        sd_bus *bus;
+        sd_id128_t id;
+        bool quit = false;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, "/benchmark", "benchmark.server", server_vtable, &quit) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (!quit) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        sd_bus_flush(bus);
+        sd_bus_unref(bus);
+}
+
+static void report(const char *benchmark, size_t parameter, unsigned n, usec_t t) {
+        t = MAX(t, 1ULL);
+
+        printf("%s\t%zu\t%llu\t%.3f\n",
+               benchmark,
+               parameter,
+               (unsigned long long) (n * USEC_PER_SEC / t),
+               (double) t / n);
+        fflush(stdout);
+}
+
+static unsigned run(sd_bus *b, size_t parameter, void (*op)(sd_bus *b, size_t parameter), usec_t *ret) {
+        usec_t t, n;
+        unsigned i;
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 1;; i++) {
+                op(b, parameter);
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= t + arg_loop_usec)
+                        break;
+        }
+
+        *ret = n - t;
+        return i;
+}
+
+static void op_ping(sd_bus *b, size_t parameter) {
+        assert_se(sd_bus_call_method(b, NULL, "/benchmark", "benchmark.server", "Ping", NULL, NULL, NULL) >= 0);
+}
+
+static void op_work(sd_bus *b, size_t sz) {
+        _cleanup_bus_message_unref_ sd_bus_message *m = NULL, *reply = NULL;
+        uint8_t *p;
+
+        assert_se(sd_bus_message_new_method_call(b, NULL, "/benchmark", "benchmark.server", "Work", &m) >= 0);
+        assert_se(sd_bus_message_append_array_space(m, 'y', sz, (void**) &p) >= 0);
+
+        memset(p, 0x80, sz);
+
+        assert_se(sd_bus_call(b, m, 0, NULL, &reply) >= 0);
+}
+
+static void op_emit(sd_bus *b, size_t n_matches) {
+        int r;
+
+        assert_se(sd_bus_call_method(b, NULL, "/benchmark", "benchmark.server", "Emit", NULL, NULL, "u", (uint32_t) SIGNALS_PER_CALL) >= 0);
+
+        /* The signals arrived before the reply and got queued, now
+         * dispatch them against the match rules */
+        while ((r = sd_bus_process(b, NULL)) > 0)
+                ;
+
+        assert_se(r == 0);
+}
+
+static void op_get_all(sd_bus *b, size_t parameter) {
+        _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
+        unsigned n = 0;
+        int r;
+
+        assert_se(sd_bus_call_method(b, NULL, "/benchmark", "org.freedesktop.DBus.Properties", "GetAll", NULL, &reply, "s", "benchmark.server") >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+
+        while ((r = sd_bus_message_enter_container(reply, 'e', "sv")) > 0) {
+                const char *name, *contents;
+                char type;
+
+                assert_se(sd_bus_message_read(reply, "s", &name) > 0);
+                assert_se(sd_bus_message_peek_type(reply, &type, &contents) > 0);
+                assert_se(type == 'v');
+
+                assert_se(sd_bus_message_enter_container(reply, 'v', contents) > 0);
+
+                if (streq(contents, "u")) {
+                        uint32_t u;
+
+                        assert_se(sd_bus_message_read(reply, "u", &u) > 0);
+                        assert_se(u == 4711);
+                } else {
+                        const char *s;
+
+                        assert_se(sd_bus_message_read(reply, "s", &s) > 0);
+                        assert_se(streq(s, name));
+                }
+
+                assert_se(sd_bus_message_exit_container(reply) > 0);
+                assert_se(sd_bus_message_exit_container(reply) > 0);
+                n++;
+        }
+
+        assert_se(r == 0);
+        assert_se(sd_bus_message_exit_container(reply) > 0);
+        assert_se(n == (ELEMENTSOF(server_vtable) - 6));
+}
+
+static int match_other(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        assert_not_reached("Unexpected match");
+}
+
+static int match_changed(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n_signals = userdata;
+
+        (*n_signals)++;
+        return 0;
+}
+
+static void client(int fd) {
+        _cleanup_bus_unref_ sd_bus *b = NULL;
+        unsigned n, n_matches = 0, n_signals = 0;
+        size_t csize, m;
+        usec_t t;
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, fd, fd) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        op_ping(b, 0);
+
+        printf("BENCHMARK\tPARAMETER\tOPS/S\tUSEC/OP\n");
+
+        n = run(b, 0, op_ping, &t);
+        report("latency", 0, n, t);
+
+        for (csize = 1; csize <= MAX_SIZE; csize *= 4) {
+                n = run(b, csize, op_work, &t);
+                report("throughput", csize, n, t);
+        }
+
+        n = run(b, 0, op_get_all, &t);
+        report("getall", ELEMENTSOF(server_vtable) - 6, n, t);
+
+        assert_se(sd_bus_add_match(b, "type='signal',interface='benchmark.server',member='Changed'", match_changed, &n_signals) >= 0);
+        n_matches = 1;
+
+        for (m = 1; m <= MAX_MATCHES; m *= 4) {
+
+                /* Add matches that never fire, so that the signals
+                 * have to be dispatched against m match rules */
+                for (; n_matches < m; n_matches++) {
+                        char match[sizeof("type='signal',interface='benchmark.server',member='Other'") + DECIMAL_STR_MAX(unsigned)];
+
+                        snprintf(match, sizeof(match), "type='signal',interface='benchmark.server',member='Other%u'", n_matches);
+                        assert_se(sd_bus_add_match(b, match, match_other, NULL) >= 0);
+                }
+
+                n_signals = 0;
+                n = run(b, m, op_emit, &t);
+                assert_se(n_signals == n * SIGNALS_PER_CALL);
+
+                report("fanout", m, n_signals, t);
+        }
+
+        assert_se(sd_bus_call_method(b, NULL, "/benchmark", "benchmark.server", "Exit", NULL, NULL, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        int pair[2];
+        pid_t pid;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(parse_sec(argv[1], &arg_loop_usec) >= 0);
+
+        assert_se(arg_loop_usec > 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                close_nointr_nofail(pair[1]);
+                server(pair[0]);
+                _exit(0);
+        }
+
+        close_nointr_nofail(pair[0]);
+        client(pair[1]);
+
+        assert_se(waitpid(pid, NULL, 0) == pid);
+
+        return 0;
+}
@@ -21,12 +21,14 @@
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 
 #include "util.h"
 #include "log.h"
 
 #include "sd-bus.h"
 #include "sd-memfd.h"
+#include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-error.h"
 #include "bus-kernel.h"
@@ -37,6 +39,111 @@
 
 #define STRING_SIZE 123
 
+#define PAYLOAD_SIZE (MEMFD_MIN_SIZE * 2)
+
+static void test_socket(void) {
+        struct bus_body_part *part;
+        sd_bus_message *m;
+        sd_bus *a, *b;
+        sd_id128_t id;
+        sd_memfd *f;
+        int pair[2], r;
+        const uint8_t *q;
+        uint32_t u32;
+        uint8_t *p;
+        size_t i, l;
+        unsigned j;
+
+        /* Sends a large memfd array over a socketpair, which should
+         * be passed as fd rather than copied into the stream */
+
+        r = sd_memfd_new_and_map(&f, PAYLOAD_SIZE, (void**) &p);
+        if (r == -ENOENT) {
+                log_info("Kernel memfds not available, skipping socket test.");
+                return;
+        }
+
+        assert_se(r >= 0);
+
+        for (i = 0; i < PAYLOAD_SIZE; i++)
+                p[i] = (uint8_t) i;
+        munmap(p, PAYLOAD_SIZE);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&a) >= 0);
+        assert_se(sd_bus_set_fd(a, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(a, 1, id) >= 0);
+        assert_se(sd_bus_start(a) >= 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        r = sd_bus_message_new_method_call(b, NULL, "/a/path", "an.inter.face", "AMethod", &m);
+        assert_se(r >= 0);
+
+        r = sd_bus_message_append(m, "u", 4711);
+        assert_se(r >= 0);
+
+        r = sd_bus_message_append_array_memfd(m, 'y', f);
+        assert_se(r >= 0);
+
+        sd_memfd_free(f);
+
+        r = sd_bus_message_append(m, "u", 815);
+        assert_se(r >= 0);
+
+        r = sd_bus_send(b, m, NULL);
+        assert_se(r >= 0);
+
+        sd_bus_message_unref(m);
+        m = NULL;
+
+        while (!m) {
+                r = sd_bus_process(b, NULL);
+                assert_se(r >= 0);
+
+                r = sd_bus_process(a, &m);
+                assert_se(r >= 0);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(a, 100 * USEC_PER_MSEC) >= 0);
+        }
+
+        assert_se(a->can_memfd_payload);
+        assert_se(b->can_memfd_payload);
+        assert_se(m->n_fds == 0);
+
+        /* The array should have arrived as memfd */
+        MESSAGE_FOREACH_PART(part, j, m)
+                if (part->memfd >= 0)
+                        break;
+        assert_se(j < m->n_body_parts);
+        assert_se(part->size == PAYLOAD_SIZE);
+
+        r = sd_bus_message_read(m, "u", &u32);
+        assert_se(r > 0);
+        assert_se(u32 == 4711);
+
+        r = sd_bus_message_read_array(m, 'y', (const void**) &q, &l);
+        assert_se(r > 0);
+        assert_se(l == PAYLOAD_SIZE);
+
+        for (i = 0; i < l; i++)
+                assert_se(q[i] == (uint8_t) i);
+
+        r = sd_bus_message_read(m, "u", &u32);
+        assert_se(r > 0);
+        assert_se(u32 == 815);
+
+        sd_bus_message_unref(m);
+
+        sd_bus_unref(a);
+        sd_bus_unref(b);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_free_ char *bus_name = NULL, *address = NULL;
         uint8_t *p;
@@ -51,6 +158,8 @@ int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
 
+        test_socket();
+
         bus_ref = bus_kernel_create_bus("deine-mutter", &bus_name);
         if (bus_ref == -ENOENT)
                 return EXIT_TEST_SKIP;
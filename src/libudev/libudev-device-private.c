@@ -82,6 +82,47 @@ int udev_device_tag_index(struct udev_device *dev, struct udev_device *dev_old,
         return 0;
 }
 
+/*
+ * Index of the devices udev has handled, by subsystem. Every entry is a
+ * symlink to the devpath, so enumerating a subsystem needs no lookup in
+ * /sys.
+ */
+int udev_device_subsystem_index(struct udev_device *dev, bool add)
+{
+        const char *id;
+        const char *subsystem;
+        const char *devpath_old;
+        char filename[UTIL_PATH_SIZE];
+
+        id = udev_device_get_id_filename(dev);
+        subsystem = udev_device_get_subsystem(dev);
+        if (id == NULL || subsystem == NULL)
+                return -1;
+        strscpyl(filename, sizeof(filename), "/run/udev/subsystem/", subsystem, "/", id, NULL);
+
+        if (!add) {
+                unlink(filename);
+                return 0;
+        }
+
+        /* a renamed device without device number or ifindex leaves the entry of its old name behind */
+        devpath_old = udev_device_get_devpath_old(dev);
+        if (id[0] == '+' && devpath_old != NULL) {
+                const char *sysname_old = strrchr(devpath_old, '/');
+                char filename_old[UTIL_PATH_SIZE];
+
+                if (sysname_old != NULL) {
+                        strscpyl(filename_old, sizeof(filename_old), "/run/udev/subsystem/", subsystem,
+                                 "/+", subsystem, ":", sysname_old + 1, NULL);
+                        if (!streq(filename_old, filename))
+                                unlink(filename_old);
+                }
+        }
+
+        mkdir_parents(filename, 0755);
+        return symlink_atomic(udev_device_get_devpath(dev), filename);
+}
+
 static bool device_has_info(struct udev_device *udev_device)
 {
         struct udev_list_entry *list_entry;
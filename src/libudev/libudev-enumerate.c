@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <stdbool.h>
 #include <sys/stat.h>
@@ -67,6 +68,7 @@ struct udev_enumerate {
         unsigned int devices_max;
         bool devices_uptodate:1;
         bool match_is_initialized;
+        bool match_is_handled;
 };
 
 /**
@@ -214,7 +216,7 @@ static int syspath_cmp(const void *p1, const void *p2)
 }
 
 /* For devices that should be moved to the absolute end of the list */
-static bool devices_delay_end(struct udev *udev, const char *syspath)
+bool udev_enumerate_delay_end(const char *syspath)
 {
         static const char *delay_device_list[] = {
                 "/block/md",
@@ -233,7 +235,7 @@ static bool devices_delay_end(struct udev *udev, const char *syspath)
 /* For devices that should just be moved a little bit later, just
  * before the point where some common path prefix changes. Returns the
  * number of characters that make up that common prefix */
-static size_t devices_delay_later(struct udev *udev, const char *syspath)
+size_t udev_enumerate_delay_later(const char *syspath)
 {
         const char *c;
 
@@ -290,7 +292,7 @@ _public_ struct udev_list_entry *udev_enumerate_get_list_entry(struct udev_enume
                         prev = entry;
 
                         /* skip to be delayed devices, and add them to the end of the list */
-                        if (devices_delay_end(udev_enumerate->udev, entry->syspath)) {
+                        if (udev_enumerate_delay_end(entry->syspath)) {
                                 syspath_add(udev_enumerate, entry->syspath);
                                 /* need to update prev here for the case realloc() gives a different address */
                                 prev = &udev_enumerate->devices[i];
@@ -301,7 +303,7 @@ _public_ struct udev_list_entry *udev_enumerate_get_list_entry(struct udev_enume
                          * the point where the prefix changes. We can
                          * only move one item at a time. */
                         if (move_later == -1) {
-                                move_later_prefix = devices_delay_later(udev_enumerate->udev, entry->syspath);
+                                move_later_prefix = udev_enumerate_delay_later(entry->syspath);
 
                                 if (move_later_prefix > 0) {
                                         move_later = i;
@@ -532,6 +534,31 @@ _public_ int udev_enumerate_add_match_is_initialized(struct udev_enumerate *udev
         return 0;
 }
 
+/**
+ * udev_enumerate_add_match_is_handled:
+ * @udev_enumerate: context
+ *
+ * Match only devices udev has handled an event for. This implies
+ * udev_enumerate_add_match_is_initialized(), and also skips devices
+ * without device node or network interface, which still have their
+ * first event pending.
+ *
+ * While udevd's index of handled devices is complete, the devices are
+ * looked up in the index instead of in /sys, which is a lot cheaper. The
+ * index is complete after all devices are triggered, usually at coldplug.
+ * Until then, this behaves like udev_enumerate_add_match_is_initialized().
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ */
+_public_ int udev_enumerate_add_match_is_handled(struct udev_enumerate *udev_enumerate)
+{
+        if (udev_enumerate == NULL)
+                return -EINVAL;
+        udev_enumerate->match_is_initialized = true;
+        udev_enumerate->match_is_handled = true;
+        return 0;
+}
+
 /**
  * udev_enumerate_add_match_sysname:
  * @udev_enumerate: context
@@ -831,6 +858,94 @@ nomatch:
         return 0;
 }
 
+static int scan_devices_index(struct udev_enumerate *udev_enumerate)
+{
+        DIR *dir;
+        struct dirent *dent;
+        bool match_device;
+
+        /*
+         * Lookup devices udev has handled in the subsystem index, instead of searching all devices in /sys.
+         * The index is only complete, when udevd has handled events of all devices since it started
+         * maintaining it; it marks it after a full trigger, otherwise we need to search /sys.
+         */
+        if (access("/run/udev/subsystem.complete", F_OK) < 0)
+                return -errno;
+
+        dir = opendir("/run/udev/subsystem");
+        if (dir == NULL)
+                return -errno;
+
+        /* only these matches need to look at the device itself */
+        match_device = udev_list_get_entry(&udev_enumerate->properties_match_list) != NULL ||
+                       udev_list_get_entry(&udev_enumerate->sysattr_match_list) != NULL ||
+                       udev_list_get_entry(&udev_enumerate->sysattr_nomatch_list) != NULL;
+
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                DIR *dir2;
+                struct dirent *dent2;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+                if (!match_subsystem(udev_enumerate, dent->d_name))
+                        continue;
+
+                dir2 = fdopendir(openat(dirfd(dir), dent->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC));
+                if (dir2 == NULL)
+                        continue;
+                for (dent2 = readdir(dir2); dent2 != NULL; dent2 = readdir(dir2)) {
+                        char syspath[UTIL_PATH_SIZE];
+                        char *devpath;
+                        ssize_t len;
+                        struct udev_device *dev;
+
+                        if (dent2->d_name[0] == '.')
+                                continue;
+
+                        /* the entry points to the devpath */
+                        devpath = stpcpy(syspath, "/sys");
+                        len = readlinkat(dirfd(dir2), dent2->d_name, devpath, sizeof(syspath) - strlen("/sys") - 1);
+                        if (len <= 0 || devpath[0] != '/')
+                                continue;
+                        devpath[len] = '\0';
+
+                        if (!match_sysname(udev_enumerate, strrchr(devpath, '/') + 1))
+                                continue;
+                        if (udev_enumerate->parent_match != NULL) {
+                                const char *child;
+
+                                /* the parent itself, or a device below it */
+                                child = startswith(devpath, udev_device_get_devpath(udev_enumerate->parent_match));
+                                if (child == NULL || (child[0] != '\0' && child[0] != '/'))
+                                        continue;
+                        }
+
+                        /* devices which are gone, but whose "remove" event is still queued, are
+                         * returned like from a scan of /sys racing with the removal */
+                        if (!match_device) {
+                                syspath_add(udev_enumerate, syspath);
+                                continue;
+                        }
+
+                        dev = udev_device_new_from_syspath(udev_enumerate->udev, syspath);
+                        if (dev == NULL)
+                                continue;
+
+                        if (!match_property(udev_enumerate, dev))
+                                goto nomatch;
+                        if (!match_sysattr(udev_enumerate, dev))
+                                goto nomatch;
+
+                        syspath_add(udev_enumerate, udev_device_get_syspath(dev));
+nomatch:
+                        udev_device_unref(dev);
+                }
+                closedir(dir2);
+        }
+        closedir(dir);
+        return 0;
+}
+
 static int parent_add_child(struct udev_enumerate *enumerate, const char *path)
 {
         struct udev_device *dev;
@@ -926,6 +1041,10 @@ _public_ int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate)
         if (udev_list_get_entry(&udev_enumerate->tags_match_list) != NULL)
                 return scan_devices_tags(udev_enumerate);
 
+        /* only devices udev has handled are asked for, use its index if it is complete */
+        if (udev_enumerate->match_is_handled && scan_devices_index(udev_enumerate) >= 0)
+                return 0;
+
         /* walk the subtree of one parent device only */
         if (udev_enumerate->parent_match != NULL)
                 return scan_devices_children(udev_enumerate);
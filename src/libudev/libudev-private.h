@@ -90,6 +90,7 @@ void udev_device_set_db_persist(struct udev_device *udev_device);
 int udev_device_update_db(struct udev_device *udev_device);
 int udev_device_delete_db(struct udev_device *udev_device);
 int udev_device_tag_index(struct udev_device *dev, struct udev_device *dev_old, bool add);
+int udev_device_subsystem_index(struct udev_device *dev, bool add);
 
 /* libudev-monitor.c - netlink/unix socket communication  */
 int udev_monitor_disconnect(struct udev_monitor *udev_monitor);
@@ -135,6 +136,10 @@ void udev_list_entry_set_num(struct udev_list_entry *list_entry, int num);
              entry != NULL; \
              entry = tmp, tmp = udev_list_entry_get_next(tmp))
 
+/* libudev-enumerate.c */
+bool udev_enumerate_delay_end(const char *syspath);
+size_t udev_enumerate_delay_later(const char *syspath);
+
 /* libudev-queue.c */
 unsigned long long int udev_get_kernel_seqnum(struct udev *udev);
 int udev_queue_read_seqnum(FILE *queue_file, unsigned long long int *seqnum);
@@ -150,17 +150,17 @@ int config_item_perf_lookup(
 }
 
 /* Run the user supplied parser for an assignment */
-static int next_assignment(const char *unit,
-                           const char *filename,
-                           unsigned line,
-                           ConfigItemLookup lookup,
-                           void *table,
-                           const char *section,
-                           unsigned section_line,
-                           const char *lvalue,
-                           const char *rvalue,
-                           bool relaxed,
-                           void *userdata) {
+int config_parse_assignment(const char *unit,
+                            const char *filename,
+                            unsigned line,
+                            ConfigItemLookup lookup,
+                            void *table,
+                            const char *section,
+                            unsigned section_line,
+                            const char *lvalue,
+                            const char *rvalue,
+                            bool relaxed,
+                            void *userdata) {
 
         ConfigParserCallback func = NULL;
         int ltype = 0;
@@ -205,6 +205,8 @@ static int parse_line(const char* unit,
                       char **section,
                       unsigned *section_line,
                       char *l,
+                      ConfigParserRecorder recorder,
+                      void *recorder_data,
                       void *userdata) {
 
         char *e;
@@ -235,6 +237,15 @@ static int parse_line(const char* unit,
                 if (!fn)
                         return -ENOMEM;
 
+                /* The included file is not tracked by the recorder */
+                if (recorder) {
+                        int r;
+
+                        r = recorder(line, *section, *section_line, NULL, NULL, recorder_data);
+                        if (r < 0)
+                                return r;
+                }
+
                 return config_parse(unit, fn, NULL, sections, lookup, table, relaxed, false, userdata);
         }
 
@@ -292,29 +303,42 @@ static int parse_line(const char* unit,
         *e = 0;
         e++;
 
-        return next_assignment(unit,
-                               filename,
-                               line,
-                               lookup,
-                               table,
-                               *section,
-                               *section_line,
-                               strstrip(l),
-                               strstrip(e),
-                               relaxed,
-                               userdata);
+        l = strstrip(l);
+        e = strstrip(e);
+
+        if (recorder) {
+                int r;
+
+                r = recorder(line, *section, *section_line, l, e, recorder_data);
+                if (r < 0)
+                        return r;
+        }
+
+        return config_parse_assignment(unit,
+                                       filename,
+                                       line,
+                                       lookup,
+                                       table,
+                                       *section,
+                                       *section_line,
+                                       l,
+                                       e,
+                                       relaxed,
+                                       userdata);
 }
 
 /* Go through the file and parse each line */
-int config_parse(const char *unit,
-                 const char *filename,
-                 FILE *f,
-                 const char *sections,
-                 ConfigItemLookup lookup,
-                 void *table,
-                 bool relaxed,
-                 bool allow_include,
-                 void *userdata) {
+int config_parse_full(const char *unit,
+                      const char *filename,
+                      FILE *f,
+                      const char *sections,
+                      ConfigItemLookup lookup,
+                      void *table,
+                      bool relaxed,
+                      bool allow_include,
+                      ConfigParserRecorder recorder,
+                      void *recorder_data,
+                      void *userdata) {
 
         _cleanup_free_ char *section = NULL, *continuation = NULL;
         _cleanup_fclose_ FILE *ours = NULL;
@@ -389,6 +413,8 @@ int config_parse(const char *unit,
                                &section,
                                &section_line,
                                p,
+                               recorder,
+                               recorder_data,
                                userdata);
                 free(c);
 
@@ -399,6 +425,20 @@ int config_parse(const char *unit,
         return 0;
 }
 
+int config_parse(const char *unit,
+                 const char *filename,
+                 FILE *f,
+                 const char *sections,
+                 ConfigItemLookup lookup,
+                 void *table,
+                 bool relaxed,
+                 bool allow_include,
+                 void *userdata) {
+
+        return config_parse_full(unit, filename, f, sections, lookup, table,
+                                 relaxed, allow_include, NULL, NULL, userdata);
+}
+
 #define DEFINE_PARSER(type, vartype, conv_func)                         \
         int config_parse_##type(const char *unit,                       \
                                 const char *filename,                   \
@@ -63,6 +63,19 @@ typedef struct ConfigPerfItem {
 /* Prototype for a low-level gperf lookup function */
 typedef const ConfigPerfItem* (*ConfigPerfItemLookup)(const char *section_and_lvalue, unsigned length);
 
+/* Prototype for a function that is told about every assignment the
+ * parser dispatches, after comments, continuation lines and section
+ * headers have been dealt with, so that the assignments can be replayed
+ * with config_parse_assignment() later without reading the file again.
+ * A NULL lvalue denotes an .include line, whose file is not recorded. */
+typedef int (*ConfigParserRecorder)(
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                const char *rvalue,
+                void *recorder_data);
+
 /* Prototype for a generic high-level lookup function */
 typedef int (*ConfigItemLookup)(
                 void *table,
@@ -91,6 +104,31 @@ int config_parse(const char *unit,
                  bool allow_include,
                  void *userdata);
 
+int config_parse_full(const char *unit,
+                      const char *filename,
+                      FILE *f,
+                      const char *sections,  /* nulstr */
+                      ConfigItemLookup lookup,
+                      void *table,
+                      bool relaxed,
+                      bool allow_include,
+                      ConfigParserRecorder recorder,
+                      void *recorder_data,
+                      void *userdata);
+
+/* Look up and run the parser of a single assignment */
+int config_parse_assignment(const char *unit,
+                            const char *filename,
+                            unsigned line,
+                            ConfigItemLookup lookup,
+                            void *table,
+                            const char *section,
+                            unsigned section_line,
+                            const char *lvalue,
+                            const char *rvalue,
+                            bool relaxed,
+                            void *userdata);
+
 /* Generic parsers */
 int config_parse_int(const char *unit, const char *filename, unsigned line, const char *section, unsigned section_line, const char *lvalue, int ltype, const char *rvalue, void *data, void *userdata);
 int config_parse_unsigned(const char *unit, const char *filename, unsigned line, const char *section, unsigned section_line, const char *lvalue, int ltype, const char *rvalue, void *data, void *userdata);
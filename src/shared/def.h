@@ -34,6 +34,8 @@
 
 #define SYSTEMD_CGROUP_CONTROLLER "name=systemd"
 
+#define CGROUPS_AGENT_SOCKET "/run/systemd/cgroups-agent"
+
 #define SIGNALS_CRASH_HANDLER SIGSEGV,SIGILL,SIGFPE,SIGBUS,SIGQUIT,SIGABRT
 #define SIGNALS_IGNORE SIGPIPE
 
@@ -0,0 +1,343 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ptrset.h"
+#include "macro.h"
+
+struct PtrSet {
+        unsigned n_items, n_allocated;
+        unsigned next_seq;
+        /* n_allocated pointers in insertion order, followed by as
+         * many insertion sequence numbers, followed by as many
+         * positions of the pointers, sorted by pointer value */
+        void *items[];
+};
+
+#define ITEM_SIZE (sizeof(void*) + 2 * sizeof(unsigned))
+
+static unsigned *seqs(PtrSet *s) {
+        return (unsigned*) (s->items + s->n_allocated);
+}
+
+static unsigned *order(PtrSet *s) {
+        return seqs(s) + s->n_allocated;
+}
+
+/* Returns the index in the order array of the first entry not below p */
+static unsigned bisect(PtrSet *s, const void *p) {
+        unsigned *o = order(s);
+        unsigned lo = 0, hi = s->n_items;
+
+        while (lo < hi) {
+                unsigned mid = lo + (hi - lo) / 2;
+
+                if ((uintptr_t) s->items[o[mid]] < (uintptr_t) p)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        return lo;
+}
+
+static bool find(PtrSet *s, const void *p, unsigned *k) {
+        *k = bisect(s, p);
+
+        return *k < s->n_items && s->items[order(s)[*k]] == p;
+}
+
+static int resize(PtrSet **s, unsigned n) {
+        PtrSet *t = *s;
+
+        assert(s);
+        assert(n > 0);
+
+        if (t && n < t->n_allocated) {
+                unsigned *old_seqs = seqs(t), *old_order = order(t);
+
+                assert(n >= t->n_items);
+
+                /* Move the arrays down first. If shrinking the
+                 * allocation fails, we simply keep the larger one. */
+                t->n_allocated = n;
+                memmove(seqs(t), old_seqs, t->n_items * sizeof(unsigned));
+                memmove(order(t), old_order, t->n_items * sizeof(unsigned));
+
+                t = realloc(t, offsetof(PtrSet, items) + n * ITEM_SIZE);
+                if (t)
+                        *s = t;
+
+                return 0;
+        }
+
+        t = realloc(t, offsetof(PtrSet, items) + n * ITEM_SIZE);
+        if (!t)
+                return -ENOMEM;
+
+        if (*s) {
+                unsigned *old_seqs = seqs(t), *old_order = order(t);
+
+                /* Move the arrays up, the topmost one first */
+                t->n_allocated = n;
+                memmove(order(t), old_order, t->n_items * sizeof(unsigned));
+                memmove(seqs(t), old_seqs, t->n_items * sizeof(unsigned));
+        } else {
+                t->n_items = 0;
+                t->next_seq = 0;
+                t->n_allocated = n;
+        }
+
+        *s = t;
+
+        return 0;
+}
+
+static void append(PtrSet *s, unsigned k, void *p) {
+        unsigned *o = order(s);
+        unsigned pos = s->n_items;
+
+        assert(s->n_items < s->n_allocated);
+
+        /* Sequence numbers only need to grow along the array, start
+         * over if they ran out */
+        if (s->next_seq == UINT_MAX - 1) {
+                unsigned j;
+
+                for (j = 0; j < s->n_items; j++)
+                        seqs(s)[j] = j;
+                s->next_seq = s->n_items;
+        }
+
+        s->items[pos] = p;
+        seqs(s)[pos] = s->next_seq++;
+
+        memmove(o + k + 1, o + k, (s->n_items - k) * sizeof(unsigned));
+        o[k] = pos;
+
+        s->n_items++;
+}
+
+static void remove_at(PtrSet *s, unsigned k) {
+        unsigned *o = order(s);
+        unsigned pos = o[k], j;
+
+        memmove(s->items + pos, s->items + pos + 1, (s->n_items - pos - 1) * sizeof(void*));
+        memmove(seqs(s) + pos, seqs(s) + pos + 1, (s->n_items - pos - 1) * sizeof(unsigned));
+
+        memmove(o + k, o + k + 1, (s->n_items - k - 1) * sizeof(unsigned));
+        s->n_items--;
+
+        for (j = 0; j < s->n_items; j++)
+                if (o[j] > pos)
+                        o[j]--;
+}
+
+void ptrset_free(PtrSet *s) {
+        free(s);
+}
+
+int ptrset_put(PtrSet **s, void *p) {
+        unsigned k = 0;
+        int r;
+
+        assert(s);
+        assert(p);
+
+        if (*s && find(*s, p, &k))
+                return 0;
+
+        /* Most sets stay very small, hence start with a single
+         * entry */
+        if (!*s || (*s)->n_items >= (*s)->n_allocated) {
+                r = resize(s, *s ? (*s)->n_items * 2 : 1);
+                if (r < 0)
+                        return r;
+        }
+
+        append(*s, k, p);
+        return 1;
+}
+
+void *ptrset_remove(PtrSet **s, void *p) {
+        unsigned k;
+
+        assert(s);
+
+        if (!*s || !find(*s, p, &k))
+                return NULL;
+
+        remove_at(*s, k);
+
+        if ((*s)->n_items == 0) {
+                free(*s);
+                *s = NULL;
+        } else if ((*s)->n_items * 4 <= (*s)->n_allocated)
+                resize(s, (*s)->n_items * 2);
+
+        return p;
+}
+
+int ptrset_remove_and_put(PtrSet **s, void *old_p, void *new_p) {
+        unsigned k;
+
+        assert(s);
+        assert(new_p);
+
+        if (!*s || !find(*s, old_p, &k))
+                return -ENOENT;
+
+        if (ptrset_contains(*s, new_p))
+                return -EEXIST;
+
+        /* Reuses the slot, hence cannot fail. Like for Set, the new
+         * entry goes to the end. */
+        remove_at(*s, k);
+        append(*s, bisect(*s, new_p), new_p);
+
+        return 0;
+}
+
+int ptrset_move(PtrSet **s, PtrSet **other) {
+        PtrSet *b;
+        unsigned j;
+        int r;
+
+        assert(s);
+        assert(other);
+
+        /* Moves all entries of other into s, and frees other. Like
+         * for Set, the new entries are added in their order in
+         * other. */
+
+        if (!*other)
+                return 0;
+
+        if (!*s) {
+                *s = *other;
+                *other = NULL;
+                return 0;
+        }
+
+        b = *other;
+
+        if ((*s)->n_items + b->n_items > (*s)->n_allocated) {
+                r = resize(s, (*s)->n_items + b->n_items);
+                if (r < 0)
+                        return r;
+        }
+
+        for (j = 0; j < b->n_items; j++) {
+                unsigned k;
+
+                if (!find(*s, b->items[j], &k))
+                        append(*s, k, b->items[j]);
+        }
+
+        free(b);
+        *other = NULL;
+
+        return 0;
+}
+
+int ptrset_reserve(PtrSet **s, unsigned n) {
+        assert(s);
+
+        /* Makes room for n more entries, so that a following
+         * ptrset_move() of that many entries cannot fail. Empty sets
+         * are left alone, moving into them takes the other set over
+         * as it is. */
+
+        if (!*s || n == 0)
+                return 0;
+
+        if ((*s)->n_items + n <= (*s)->n_allocated)
+                return 0;
+
+        return resize(s, (*s)->n_items + n);
+}
+
+bool ptrset_contains(PtrSet *s, const void *p) {
+        unsigned k;
+
+        if (!s)
+                return false;
+
+        return find(s, p, &k);
+}
+
+unsigned ptrset_size(PtrSet *s) {
+
+        if (!s)
+                return 0;
+
+        return s->n_items;
+}
+
+bool ptrset_isempty(PtrSet *s) {
+        return ptrset_size(s) == 0;
+}
+
+void *ptrset_first(PtrSet *s) {
+
+        if (!s)
+                return NULL;
+
+        return s->items[0];
+}
+
+void *ptrset_iterate(PtrSet *s, Iterator *i) {
+        unsigned lo = 0, hi, last;
+
+        assert(i);
+
+        if (!s || *i == ITERATOR_LAST)
+                goto at_end;
+
+        /* The iterator is the sequence number of the entry returned
+         * last, plus one, so that we find our way even if the array
+         * changed in between */
+        last = PTR_TO_UINT(*i);
+        hi = s->n_items;
+
+        while (lo < hi) {
+                unsigned mid = lo + (hi - lo) / 2;
+
+                if (seqs(s)[mid] + 1 <= last)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        if (lo >= s->n_items)
+                goto at_end;
+
+        *i = (Iterator) UINT_TO_PTR(seqs(s)[lo] + 1);
+        return s->items[lo];
+
+at_end:
+        *i = ITERATOR_LAST;
+        return NULL;
+}
@@ -0,0 +1,57 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* A compact set of pointers, kept as an array in insertion order
+ * together with an index sorted by pointer value, in a single
+ * allocation. Lookups are binary searches, insertion and removal move
+ * the following entries. Meant for the many small sets of which a
+ * hashmap with its bucket array would be a multiple of the size.
+ *
+ * Like for Set, a NULL set is an empty set for all read operations.
+ * Since the array is reallocated as it grows and shrinks, and freed
+ * when it becomes empty, all write operations take a pointer to the
+ * variable holding the set.
+ *
+ * Like for Set, iteration is in insertion order. Entries may be
+ * added or removed while iterating. */
+
+#include "hashmap.h"
+#include "util.h"
+
+typedef struct PtrSet PtrSet;
+
+void ptrset_free(PtrSet *s);
+
+int ptrset_put(PtrSet **s, void *p);
+void *ptrset_remove(PtrSet **s, void *p);
+int ptrset_remove_and_put(PtrSet **s, void *old_p, void *new_p);
+int ptrset_move(PtrSet **s, PtrSet **other);
+int ptrset_reserve(PtrSet **s, unsigned n);
+
+bool ptrset_contains(PtrSet *s, const void *p);
+unsigned ptrset_size(PtrSet *s);
+bool ptrset_isempty(PtrSet *s);
+void *ptrset_first(PtrSet *s);
+
+void *ptrset_iterate(PtrSet *s, Iterator *i);
+
+#define PTRSET_FOREACH(e, s, i) \
+        for ((i) = ITERATOR_FIRST, (e) = ptrset_iterate((s), &(i)); (e); (e) = ptrset_iterate((s), &(i)))
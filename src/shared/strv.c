@@ -598,6 +598,17 @@ bool strv_overlap(char **a, char **b) {
         return false;
 }
 
+bool strv_equal(char **a, char **b) {
+        if (strv_isempty(a) || strv_isempty(b))
+                return strv_isempty(a) == strv_isempty(b);
+
+        for ( ; *a || *b; a++, b++)
+                if (!streq_ptr(*a, *b))
+                        return false;
+
+        return true;
+}
+
 static int str_compare(const void *_a, const void *_b) {
         const char **a = (const char**) _a, **b = (const char**) _b;
 
@@ -70,6 +70,7 @@ char **strv_parse_nulstr(const char *s, size_t l);
 char **strv_split_nulstr(const char *s);
 
 bool strv_overlap(char **a, char **b) _pure_;
+bool strv_equal(char **a, char **b) _pure_;
 
 #define STRV_FOREACH(s, l)                      \
         for ((s) = (l); (s) && *(s); (s)++)
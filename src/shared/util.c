@@ -3700,15 +3700,92 @@ bool dirent_is_file_with_suffix(const struct dirent *de, const char *suffix) {
         return endswith(de->d_name, suffix);
 }
 
-void execute_directory(const char *directory, DIR *d, char *argv[]) {
+typedef struct ExecuteChild {
+        char *path;
+        usec_t start;
+} ExecuteChild;
+
+static void execute_child_free(ExecuteChild *c) {
+        if (!c)
+                return;
+
+        free(c->path);
+        free(c);
+}
+
+static pid_t execute_child_spawn(const char *directory, const char *name, char *argv[], pid_t pgid, Hashmap *pids) {
+        ExecuteChild *c;
+        pid_t pid;
+        int k;
+
+        c = new0(ExecuteChild, 1);
+        if (!c) {
+                log_oom();
+                return -1;
+        }
+
+        if (asprintf(&c->path, "%s/%s", directory, name) < 0) {
+                free(c);
+                log_oom();
+                return -1;
+        }
+
+        c->start = now(CLOCK_MONOTONIC);
+
+        if ((pid = fork()) < 0) {
+                log_error("Failed to fork: %m");
+                execute_child_free(c);
+                return -1;
+        }
+
+        if (pid == 0) {
+                char *_argv[2];
+                /* Child */
+
+                /* All children share one process group, so that
+                 * they can be reaped in the order they exit without
+                 * touching other children of ours */
+                setpgid(0, pgid);
+
+                if (!argv) {
+                        _argv[0] = c->path;
+                        _argv[1] = NULL;
+                        argv = _argv;
+                } else
+                        argv[0] = c->path;
+
+                execv(c->path, argv);
+
+                log_error("Failed to execute %s: %m", c->path);
+                _exit(EXIT_FAILURE);
+        }
+
+        /* Again from the parent, to not race against the child */
+        setpgid(pid, pgid);
+
+        log_debug("Spawned %s as %lu", c->path, (unsigned long) pid);
+
+        if ((k = hashmap_put(pids, UINT_TO_PTR(pid), c)) < 0) {
+                log_error("Failed to add PID to set: %s", strerror(-k));
+                execute_child_free(c);
+        }
+
+        return pid;
+}
+
+void execute_directory_full(const char *directory, DIR *d, char *argv[], unsigned n_parallel, execute_callback_t callback, void *userdata) {
         DIR *_d = NULL;
         struct dirent *de;
         Hashmap *pids = NULL;
+        ExecuteChild *c;
+        pid_t pgid = 0;
+        bool done = false;
 
         assert(directory);
 
-        /* Executes all binaries in a directory in parallel and
-         * waits for them to finish. */
+        /* Executes all binaries in a directory in parallel, at most
+         * n_parallel at a time unless that is 0, and waits for them
+         * to finish. The callback is told how long each one took. */
 
         if (!d) {
                 if (!(_d = opendir(directory))) {
@@ -3728,83 +3805,91 @@ void execute_directory(const char *directory, DIR *d, char *argv[]) {
                 goto finish;
         }
 
-        while ((de = readdir(d))) {
-                char *path;
-                pid_t pid;
+        for (;;) {
+                siginfo_t si = {};
+                usec_t finish;
                 int k;
 
-                if (!dirent_is_file(de))
-                        continue;
-
-                if (asprintf(&path, "%s/%s", directory, de->d_name) < 0) {
-                        log_oom();
-                        continue;
-                }
-
-                if ((pid = fork()) < 0) {
-                        log_error("Failed to fork: %m");
-                        free(path);
-                        continue;
-                }
-
-                if (pid == 0) {
-                        char *_argv[2];
-                        /* Child */
+                while (!done && (n_parallel == 0 || hashmap_size(pids) < n_parallel)) {
+                        pid_t pid;
 
-                        if (!argv) {
-                                _argv[0] = path;
-                                _argv[1] = NULL;
-                                argv = _argv;
-                        } else
-                                argv[0] = path;
+                        de = readdir(d);
+                        if (!de) {
+                                done = true;
+                                break;
+                        }
 
-                        execv(path, argv);
+                        if (!dirent_is_file(de))
+                                continue;
 
-                        log_error("Failed to execute %s: %m", path);
-                        _exit(EXIT_FAILURE);
+                        pid = execute_child_spawn(directory, de->d_name, argv, pgid, pids);
+                        if (pid > 0 && pgid == 0)
+                                pgid = pid;
                 }
 
-                log_debug("Spawned %s as %lu", path, (unsigned long) pid);
-
-                if ((k = hashmap_put(pids, UINT_TO_PTR(pid), path)) < 0) {
-                        log_error("Failed to add PID to set: %s", strerror(-k));
-                        free(path);
-                }
-        }
-
-        while (!hashmap_isempty(pids)) {
-                pid_t pid = PTR_TO_UINT(hashmap_first_key(pids));
-                siginfo_t si = {};
-                char *path;
-
-                if (waitid(P_PID, pid, &si, WEXITED) < 0) {
+                if (hashmap_isempty(pids))
+                        break;
 
+                if (pgid > 0)
+                        k = waitid(P_PGID, pgid, &si, WEXITED);
+                else
+                        k = waitid(P_PID, PTR_TO_UINT(hashmap_first_key(pids)), &si, WEXITED);
+                if (k < 0) {
                         if (errno == EINTR)
                                 continue;
 
+                        if (errno == ECHILD && pgid > 0) {
+                                /* Whatever is left did not make it
+                                 * into the process group, wait for
+                                 * it one by one */
+                                pgid = 0;
+                                continue;
+                        }
+
                         log_error("waitid() failed: %m");
                         goto finish;
                 }
 
-                if ((path = hashmap_remove(pids, UINT_TO_PTR(si.si_pid)))) {
+                finish = now(CLOCK_MONOTONIC);
+
+                if ((c = hashmap_remove(pids, UINT_TO_PTR(si.si_pid)))) {
+                        char ts[FORMAT_TIMESPAN_MAX];
+
                         if (!is_clean_exit(si.si_code, si.si_status, NULL)) {
                                 if (si.si_code == CLD_EXITED)
-                                        log_error("%s exited with exit status %i.", path, si.si_status);
+                                        log_error("%s exited with exit status %i.", c->path, si.si_status);
                                 else
-                                        log_error("%s terminated by signal %s.", path, signal_to_string(si.si_status));
+                                        log_error("%s terminated by signal %s.", c->path, signal_to_string(si.si_status));
                         } else
-                                log_debug("%s exited successfully.", path);
+                                log_debug("%s exited successfully after %s.", c->path,
+                                          format_timespan(ts, sizeof(ts), finish - c->start, USEC_PER_MSEC));
+
+                        if (callback)
+                                callback(c->path, c->start, finish, userdata);
 
-                        free(path);
+                        execute_child_free(c);
                 }
+
+                /* Once all of the group are gone, the next child
+                 * starts a new one */
+                if (hashmap_isempty(pids))
+                        pgid = 0;
         }
 
 finish:
         if (_d)
                 closedir(_d);
 
-        if (pids)
-                hashmap_free_free(pids);
+        if (pids) {
+                while ((c = hashmap_steal_first(pids)))
+                        execute_child_free(c);
+
+                hashmap_free(pids);
+        }
+}
+
+void execute_directory(const char *directory, DIR *d, char *argv[]) {
+        execute_directory_full(directory, d, argv, 0, NULL, NULL);
 }
 
 int kill_and_sigcont(pid_t pid, int sig) {
@@ -433,7 +433,10 @@ bool tty_is_console(const char *tty) _pure_;
 int vtnr_from_tty(const char *tty);
 const char *default_term_for_tty(const char *tty);
 
+typedef void (*execute_callback_t)(const char *path, usec_t start, usec_t finish, void *userdata);
+
 void execute_directory(const char *directory, DIR *_d, char *argv[]);
+void execute_directory_full(const char *directory, DIR *_d, char *argv[], unsigned n_parallel, execute_callback_t callback, void *userdata);
 
 int kill_and_sigcont(pid_t pid, int sig);
 
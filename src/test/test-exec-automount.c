@@ -0,0 +1,111 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <linux/auto_fs4.h>
+
+#include "execute.h"
+#include "exit-status.h"
+#include "util.h"
+
+/* Spawns a process with its working directory on an automount point,
+ * which we serve ourselves, like PID 1 does. If we were suspended until
+ * the child looked up the directory, we would never get to answer, and
+ * the alarm kills us. */
+
+static void test_exec_automount(void) {
+        char dir[] = "/tmp/test-exec-automount.XXXXXX";
+        char *argv[] = { (char*) "/bin/true", NULL };
+        ExecCommand command = {
+                .path = (char*) "/bin/true",
+                .argv = argv,
+        };
+        ExecContext context = {};
+        union autofs_v5_packet_union packet;
+        char options[128];
+        int p[2], fd;
+        siginfo_t status;
+        pid_t pid;
+
+        assert_se(mkdtemp(dir));
+        assert_se(pipe2(p, O_CLOEXEC) >= 0);
+
+        snprintf(options, sizeof(options), "fd=%i,pgrp=%u,minproto=5,maxproto=5,direct", p[1], (unsigned) getpgrp());
+        char_array_0(options);
+
+        if (mount("test-exec-automount", dir, "autofs", 0, options) < 0) {
+                log_info("Cannot mount autofs, skipping: %m");
+                close_pipe(p);
+                assert_se(rmdir(dir) >= 0);
+                return;
+        }
+
+        close_nointr_nofail(p[1]);
+
+        exec_context_init(&context);
+        context.working_directory = dir;
+
+        alarm(10);
+
+        assert_se(exec_spawn(&command, NULL, &context, NULL, 0, NULL,
+                             false, false, false, false,
+                             0, NULL, "automount.service",
+                             NULL, NULL, &pid) >= 0);
+
+        /* The child is waiting for the automount now */
+        assert_se(loop_read(p[0], &packet, sizeof(packet), true) == sizeof(packet));
+        assert_se(packet.hdr.type == autofs_ptype_missing_direct);
+
+        /* As our process group is the one of the automount daemon, this
+         * does not trigger the automount */
+        fd = open(dir, O_RDONLY|O_CLOEXEC|O_DIRECTORY);
+        assert_se(fd >= 0);
+        assert_se(ioctl(fd, AUTOFS_IOC_FAIL, packet.v5_packet.wait_queue_token) >= 0);
+
+        assert_se(wait_for_terminate(pid, &status) >= 0);
+        assert_se(status.si_code == CLD_EXITED);
+        assert_se(status.si_status == EXIT_CHDIR);
+
+        alarm(0);
+
+        close_nointr_nofail(fd);
+        close_nointr_nofail(p[0]);
+        assert_se(umount2(dir, MNT_DETACH) >= 0);
+        assert_se(rmdir(dir) >= 0);
+
+        context.working_directory = NULL;
+        exec_context_done(&context);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        if (geteuid() > 0)
+                return EXIT_SUCCESS;
+
+        test_exec_automount();
+
+        return EXIT_SUCCESS;
+}
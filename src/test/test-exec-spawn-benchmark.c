@@ -0,0 +1,101 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "execute.h"
+#include "util.h"
+#include "time-util.h"
+
+/* Spawns /bin/true over and over, once in a child sharing our memory,
+ * and once in a forked child, while we have a large amount of memory
+ * mapped, like PID 1 on a big system. Output is one tab separated line
+ * per measurement: method, memory in MiB, spawns and microseconds per
+ * spawn. The number of spawns and the memory in MiB may be passed as
+ * arguments. */
+
+static void benchmark(const char *name, ExecContext *context, int *idle_pipe, unsigned n, size_t mib) {
+        char *argv[] = { (char*) "/bin/true", NULL };
+        ExecCommand command = {
+                .path = (char*) "/bin/true",
+                .argv = argv,
+        };
+        unsigned i;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                siginfo_t status;
+                pid_t pid;
+
+                assert_se(exec_spawn(&command, argv, context, NULL, 0, NULL,
+                                     false, false, false, false,
+                                     0, NULL, "benchmark.service",
+                                     idle_pipe, NULL, &pid) >= 0);
+
+                assert_se(wait_for_terminate(pid, &status) >= 0);
+                assert_se(status.si_code == CLD_EXITED);
+                assert_se(status.si_status == EXIT_SUCCESS);
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        printf("%s\t%zu\t%u\t%.3f\n", name, mib, n, (double) t / n);
+        fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+        ExecContext context = {};
+        /* Forces the forked child, without waiting for anything */
+        int idle_pipe[4] = { -1, -1, -1, -1 };
+        unsigned n = 1000;
+        size_t mib = 256;
+        char *memory;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0);
+        if (argc > 2) {
+                unsigned u;
+
+                assert_se(safe_atou(argv[2], &u) >= 0);
+                mib = u;
+        }
+
+        log_set_max_level(LOG_INFO);
+
+        /* Touch every page, so that fork() has to copy the page
+         * tables */
+        memory = malloc(mib * 1024 * 1024);
+        assert_se(memory);
+        memset(memory, 1, mib * 1024 * 1024);
+
+        exec_context_init(&context);
+
+        printf("METHOD\tMIB\tSPAWNS\tUSEC/SPAWN\n");
+
+        benchmark("shared", &context, NULL, n, mib);
+        benchmark("fork", &context, idle_pipe, n, mib);
+
+        exec_context_done(&context);
+        free(memory);
+
+        return EXIT_SUCCESS;
+}
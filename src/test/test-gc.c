@@ -0,0 +1,126 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "manager.h"
+#include "util.h"
+#include "macro.h"
+
+/* Enough units for a GC run of several batches */
+#define N_UNITS (2*GC_QUEUE_BATCH_MAX + GC_QUEUE_BATCH_MAX/2)
+
+/* Every third unit is referenced by a unit that is kept */
+static bool referenced(unsigned i) {
+        return i % 3 == 0;
+}
+
+int main(int argc, char *argv[]) {
+        char unit_dir[] = "/tmp/test-gc.XXXXXX";
+        Manager *m = NULL;
+        Unit *root = NULL, *u;
+        UnitRef ref = {};
+        Iterator it;
+        uint64_t examined, collected;
+        unsigned i, n_referenced = 0, batches = 0;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(unit_dir));
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        r = manager_new(SYSTEMD_USER, &m);
+        if (r == -EPERM || r == -EACCES || r == -EADDRINUSE || r == -EHOSTDOWN) {
+                printf("Skipping test: manager_new: %s", strerror(-r));
+                rmdir(unit_dir);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+
+        printf("Load:\n");
+        assert_se(manager_load_unit(m, "gc-root.target", NULL, NULL, &root) >= 0);
+        unit_ref_set(&ref, root);
+
+        for (i = 0; i < N_UNITS; i++) {
+                char name[UNIT_NAME_MAX];
+
+                snprintf(name, sizeof(name), "gc-%u.target", i);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+
+                if (referenced(i)) {
+                        assert_se(unit_add_dependency(root, UNIT_WANTS, u, true) >= 0);
+                        n_referenced++;
+                }
+        }
+
+        /* Run the queue like the event loop does, a batch per
+         * iteration, and free what was collected in between */
+        printf("Collect:\n");
+        examined = m->n_gc_examined;
+        collected = m->n_gc_collected;
+
+        HASHMAP_FOREACH(u, m->units, it)
+                unit_add_to_gc_queue(u);
+        assert_se(m->n_in_gc_queue == N_UNITS + 1);
+
+        while (m->gc_queue) {
+                manager_dispatch_gc_queue(m);
+                manager_dispatch_cleanup_queue(m);
+                batches++;
+
+                assert_se(batches <= N_UNITS);
+        }
+
+        printf("%u batches, %" PRIu64 " units examined, %" PRIu64 " collected\n",
+               batches, m->n_gc_examined - examined, m->n_gc_collected - collected);
+
+        assert_se(batches > 2);
+        assert_se(!m->gc_in_progress);
+
+        for (i = 0; i < N_UNITS; i++) {
+                char name[UNIT_NAME_MAX];
+
+                snprintf(name, sizeof(name), "gc-%u.target", i);
+                u = manager_get_unit(m, name);
+
+                if (referenced(i)) {
+                        assert_se(u);
+                        assert_se(ptrset_contains(root->dependencies[UNIT_WANTS], u));
+                } else
+                        assert_se(!u);
+        }
+
+        assert_se(manager_get_unit(m, "gc-root.target") == root);
+        assert_se(hashmap_size(m->units) == n_referenced + 1);
+
+        /* Each unit is looked at exactly once per run */
+        assert_se(m->n_gc_examined - examined == N_UNITS + 1);
+        assert_se(m->n_gc_collected - collected == N_UNITS - n_referenced);
+
+        unit_ref_unset(&ref);
+        manager_free(m);
+
+        rmdir(unit_dir);
+
+        return 0;
+}
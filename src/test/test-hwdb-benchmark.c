@@ -0,0 +1,154 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2012 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "util.h"
+#include "strv.h"
+#include "time-util.h"
+
+/* Looks up every match of the hwdb source files in /etc/udev/hwdb.bin,
+ * to compare node layouts of the file. Output is one tab separated line
+ * per round: round, number of keys, keys per second and microseconds per
+ * key. Without arguments, the installed hwdb files are used. */
+
+#define ROUNDS 5
+
+static char **keys;
+static unsigned int keys_count;
+
+static void keys_read(const char *filename) {
+        FILE *f;
+        char line[LINE_MAX];
+
+        f = fopen(filename, "re");
+        if (!f) {
+                log_error("error reading %s: %m", filename);
+                return;
+        }
+
+        while (fgets(line, sizeof(line), f)) {
+                char *key;
+                char *k;
+                const char *l;
+
+                /* match lines start at the first column */
+                if (line[0] == '\0' || line[0] == '#' || line[0] == ' ' || line[0] == '\n')
+                        continue;
+                line[strcspn(line, "\n")] = '\0';
+                if (strpbrk(line, "?["))
+                        continue;
+
+                /* a glob matches the empty string */
+                key = new(char, strlen(line) + 1);
+                assert_se(key);
+                for (l = line, k = key; *l; l++)
+                        if (*l != '*')
+                                *k++ = *l;
+                *k = '\0';
+
+                assert_se(strv_extend(&keys, key) >= 0);
+                free(key);
+                keys_count++;
+        }
+
+        fclose(f);
+}
+
+static void keys_read_dir(const char *path) {
+        DIR *dir;
+        struct dirent *dent;
+
+        dir = opendir(path);
+        if (!dir)
+                return;
+
+        for (dent = readdir(dir); dent; dent = readdir(dir)) {
+                _cleanup_free_ char *filename = NULL;
+
+                if (!endswith(dent->d_name, ".hwdb"))
+                        continue;
+                filename = strjoin(path, "/", dent->d_name, NULL);
+                assert_se(filename);
+                keys_read(filename);
+        }
+        closedir(dir);
+}
+
+static void report(unsigned int round, unsigned int n, usec_t t) {
+        t = MAX(t, 1ULL);
+
+        printf("%u\t%u\t%llu\t%.3f\n",
+               round,
+               n,
+               (unsigned long long) (n * USEC_PER_SEC / t),
+               (double) t / n);
+        fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+        struct udev *udev;
+        struct udev_hwdb *hwdb;
+        unsigned int i, round;
+        usec_t t;
+
+        udev = udev_new();
+        assert_se(udev);
+
+        hwdb = udev_hwdb_new(udev);
+        if (!hwdb) {
+                log_error("error opening /etc/udev/hwdb.bin");
+                return EXIT_FAILURE;
+        }
+
+        if (argc > 1)
+                for (i = 1; i < (unsigned int) argc; i++)
+                        keys_read(argv[i]);
+        else
+                keys_read_dir(UDEVLIBEXECDIR "/hwdb.d");
+
+        if (keys_count == 0) {
+                log_error("no hwdb matches found");
+                return EXIT_FAILURE;
+        }
+
+        printf("ROUND\tKEYS\tKEYS/S\tUSEC/KEY\n");
+
+        for (round = 1; round <= ROUNDS; round++) {
+                unsigned int found = 0;
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0; i < keys_count; i++)
+                        if (udev_hwdb_get_properties_list_entry(hwdb, keys[i], 0))
+                                found++;
+                report(round, keys_count, now(CLOCK_MONOTONIC) - t);
+                assert_se(found > 0);
+        }
+
+        strv_free(keys);
+        udev_hwdb_unref(hwdb);
+        udev_unref(udev);
+        return EXIT_SUCCESS;
+}
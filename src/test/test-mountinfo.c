@@ -0,0 +1,132 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "manager.h"
+#include "mount.h"
+#include "fileio.h"
+#include "util.h"
+#include "macro.h"
+
+#define LINE_PROC "15 1 0:3 / /proc rw,nosuid,nodev,noexec - proc proc rw\n"
+#define LINE_AUTOFS "16 1 0:31 / /srv/auto rw,relatime - autofs systemd-1 rw,fd=22,pgrp=1\n"
+#define LINE_DATA "20 1 8:1 / /srv/data rw,relatime - ext4 /dev/sda1 rw,data=ordered\n"
+#define LINE_DATA_TMPFS "21 20 0:32 / /srv/data rw,relatime - tmpfs tmpfs rw\n"
+#define LINE_OTHER "22 1 8:2 / /srv/other rw,relatime - xfs /dev/sda2 rw\n"
+
+static Mount *get_mount(Manager *m, const char *name) {
+        Unit *u;
+
+        u = manager_get_unit(m, name);
+        return u ? MOUNT(u) : NULL;
+}
+
+int main(int argc, char *argv[]) {
+        char fixture[] = "/tmp/test-mountinfo.XXXXXX";
+        char unit_dir[] = "/tmp/test-mountinfo-units.XXXXXX";
+        Manager *m = NULL;
+        Mount *data, *other;
+        int fd, r;
+
+        log_parse_environment();
+        log_open();
+
+        fd = mkostemp(fixture, O_CLOEXEC);
+        assert_se(fd >= 0);
+        close_nointr_nofail(fd);
+
+        assert_se(mkdtemp(unit_dir));
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        r = manager_new(SYSTEMD_USER, &m);
+        if (r == -EPERM || r == -EACCES || r == -EADDRINUSE || r == -EHOSTDOWN) {
+                printf("Skipping test: manager_new: %s", strerror(-r));
+                unlink(fixture);
+                rmdir(unit_dir);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+
+        /* API file systems and autofs mounts have no unit, and a
+         * mount point may show up more than once */
+        assert_se(write_string_file(fixture, LINE_PROC LINE_AUTOFS LINE_DATA LINE_DATA_TMPFS LINE_OTHER) >= 0);
+
+        m->proc_self_mountinfo = fopen(fixture, "re");
+        assert_se(m->proc_self_mountinfo);
+
+        printf("Enumerate:\n");
+        assert_se(mount_vtable.enumerate(m) >= 0);
+        manager_dispatch_load_queue(m);
+
+        assert_se(!manager_get_unit(m, "proc.mount"));
+        assert_se(!manager_get_unit(m, "srv-auto.mount"));
+
+        data = get_mount(m, "srv-data.mount");
+        assert_se(data);
+        assert_se(data->from_proc_self_mountinfo);
+        assert_se(data->n_mountinfo_lines == 2);
+        assert_se(streq(data->parameters_proc_self_mountinfo.fstype, "tmpfs"));
+
+        other = get_mount(m, "srv-other.mount");
+        assert_se(other);
+        assert_se(other->n_mountinfo_lines == 1);
+
+        /* Lines without unit vanish, and the top of the stack goes
+         * away */
+        printf("Unmount top of stack:\n");
+        assert_se(write_string_file(fixture, LINE_AUTOFS LINE_DATA LINE_OTHER) >= 0);
+        mount_process_proc_self_mountinfo(m);
+
+        assert_se(!manager_get_unit(m, "proc.mount"));
+        assert_se(data->n_mountinfo_lines == 1);
+        assert_se(data->state == MOUNT_MOUNTED);
+        assert_se(streq(data->parameters_proc_self_mountinfo.fstype, "ext4"));
+        assert_se(streq(data->parameters_proc_self_mountinfo.what, "/dev/sda1"));
+        assert_se(other->n_mountinfo_lines == 1);
+
+        /* Ignored lines show up again */
+        printf("Remount API file system:\n");
+        assert_se(write_string_file(fixture, LINE_PROC LINE_AUTOFS LINE_DATA LINE_OTHER) >= 0);
+        mount_process_proc_self_mountinfo(m);
+
+        assert_se(!manager_get_unit(m, "proc.mount"));
+        assert_se(data->n_mountinfo_lines == 1);
+        assert_se(other->n_mountinfo_lines == 1);
+
+        printf("Unmount:\n");
+        assert_se(write_string_file(fixture, LINE_PROC LINE_OTHER) >= 0);
+        mount_process_proc_self_mountinfo(m);
+
+        assert_se(data->n_mountinfo_lines == 0);
+        assert_se(!data->from_proc_self_mountinfo);
+        assert_se(data->state == MOUNT_DEAD);
+        assert_se(other->n_mountinfo_lines == 1);
+
+        manager_free(m);
+
+        unlink(fixture);
+        rmdir(unit_dir);
+
+        return 0;
+}
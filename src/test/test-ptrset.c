@@ -0,0 +1,203 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+
+#include "util.h"
+#include "ptrset.h"
+
+static int items[64], extra;
+
+static void test_ptrset_put_remove(void) {
+        PtrSet *s = NULL;
+        unsigned i;
+
+        assert_se(ptrset_isempty(s));
+        assert_se(!ptrset_contains(s, &items[0]));
+        assert_se(!ptrset_first(s));
+        assert_se(!ptrset_remove(&s, &items[0]));
+
+        /* Out of order, to exercise the sorting */
+        for (i = 0; i < ELEMENTSOF(items); i++)
+                assert_se(ptrset_put(&s, &items[(i * 7) % ELEMENTSOF(items)]) == 1);
+
+        assert_se(ptrset_size(s) == ELEMENTSOF(items));
+        assert_se(ptrset_put(&s, &items[3]) == 0);
+        assert_se(ptrset_size(s) == ELEMENTSOF(items));
+        assert_se(ptrset_first(s) == &items[0]);
+
+        for (i = 0; i < ELEMENTSOF(items); i++)
+                assert_se(ptrset_contains(s, &items[i]));
+
+        for (i = 0; i < ELEMENTSOF(items); i += 2)
+                assert_se(ptrset_remove(&s, &items[i]) == &items[i]);
+
+        assert_se(ptrset_size(s) == ELEMENTSOF(items) / 2);
+        for (i = 0; i < ELEMENTSOF(items); i++)
+                assert_se(ptrset_contains(s, &items[i]) == (i % 2 == 1));
+
+        for (i = 1; i < ELEMENTSOF(items); i += 2)
+                assert_se(ptrset_remove(&s, &items[i]) == &items[i]);
+
+        /* Empty sets are freed */
+        assert_se(!s);
+}
+
+static void test_ptrset_remove_and_put(void) {
+        PtrSet *s = NULL;
+
+        assert_se(ptrset_remove_and_put(&s, &items[0], &items[1]) == -ENOENT);
+
+        assert_se(ptrset_put(&s, &items[5]) == 1);
+        assert_se(ptrset_put(&s, &items[9]) == 1);
+
+        assert_se(ptrset_remove_and_put(&s, &items[1], &items[2]) == -ENOENT);
+        assert_se(ptrset_remove_and_put(&s, &items[5], &items[9]) == -EEXIST);
+        assert_se(ptrset_remove_and_put(&s, &items[9], &items[1]) == 0);
+
+        /* The new entry goes to the end */
+        assert_se(ptrset_size(s) == 2);
+        assert_se(ptrset_first(s) == &items[5]);
+        assert_se(ptrset_contains(s, &items[5]));
+        assert_se(!ptrset_contains(s, &items[9]));
+
+        ptrset_free(s);
+}
+
+static void test_ptrset_move(void) {
+        static const unsigned order[] = { 1, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 0, 2, 3, 4 };
+        PtrSet *a = NULL, *b = NULL;
+        Iterator j;
+        int *p;
+        unsigned i;
+
+        assert_se(ptrset_move(&a, &b) == 0);
+        assert_se(!a && !b);
+
+        assert_se(ptrset_put(&b, &items[1]) == 1);
+        assert_se(ptrset_move(&a, &b) == 0);
+        assert_se(!b);
+        assert_se(ptrset_size(a) == 1);
+
+        for (i = 0; i < 10; i++)
+                assert_se(ptrset_put(&b, &items[i]) >= 0);
+        for (i = 5; i < 20; i++)
+                assert_se(ptrset_put(&a, &items[i]) >= 0);
+
+        assert_se(ptrset_move(&a, &b) == 0);
+        assert_se(!b);
+        assert_se(ptrset_size(a) == 20);
+
+        for (i = 0; i < 20; i++)
+                assert_se(ptrset_contains(a, &items[i]));
+
+        /* The entries of a come first, then the new ones of b */
+        i = 0;
+        PTRSET_FOREACH(p, a, j) {
+                assert_se(p == &items[order[i]]);
+                i++;
+        }
+
+        ptrset_free(a);
+}
+
+static void test_ptrset_reserve(void) {
+        PtrSet *a = NULL, *b = NULL;
+        unsigned i;
+
+        assert_se(ptrset_reserve(&a, 10) == 0);
+        assert_se(!a);
+
+        assert_se(ptrset_put(&a, &items[0]) == 1);
+        assert_se(ptrset_reserve(&a, 0) == 0);
+        assert_se(ptrset_reserve(&a, 20) == 0);
+        assert_se(ptrset_size(a) == 1);
+        assert_se(ptrset_contains(a, &items[0]));
+
+        for (i = 1; i <= 20; i++)
+                assert_se(ptrset_put(&b, &items[i]) == 1);
+
+        assert_se(ptrset_move(&a, &b) == 0);
+        assert_se(!b);
+        assert_se(ptrset_size(a) == 21);
+
+        for (i = 0; i <= 20; i++)
+                assert_se(ptrset_contains(a, &items[i]));
+
+        ptrset_free(a);
+}
+
+static void test_ptrset_iterate(void) {
+        PtrSet *s = NULL;
+        Iterator i;
+        int *p, *last = NULL;
+        unsigned k, n = 0;
+
+        PTRSET_FOREACH(p, s, i)
+                assert_not_reached("Empty set is not empty");
+
+        /* Out of order, to make sure insertion order wins */
+        for (k = 0; k < ELEMENTSOF(items); k++)
+                assert_se(ptrset_put(&s, &items[(k * 7) % ELEMENTSOF(items)]) == 1);
+
+        k = 0;
+        PTRSET_FOREACH(p, s, i) {
+                assert_se(p == &items[(k * 7) % ELEMENTSOF(items)]);
+                k++;
+        }
+        assert_se(k == ELEMENTSOF(items));
+
+        ptrset_free(s);
+        s = NULL;
+
+        for (k = 0; k < ELEMENTSOF(items); k++)
+                assert_se(ptrset_put(&s, &items[ELEMENTSOF(items) - k - 1]) == 1);
+
+        /* In order, and removing entries while iterating is safe */
+        PTRSET_FOREACH(p, s, i) {
+                n++;
+
+                assert_se(ptrset_remove(&s, p) == p);
+                if (p == &extra)
+                        continue;
+
+                assert_se(!last || p < last);
+                last = p;
+
+                if (p > items)
+                        assert_se(ptrset_remove(&s, p - 1) == p - 1);
+
+                /* Added entries are visited too */
+                if (p == &items[ELEMENTSOF(items) - 1])
+                        assert_se(ptrset_put(&s, &extra) == 1);
+        }
+
+        assert_se(n == ELEMENTSOF(items) / 2 + 1);
+        assert_se(!s);
+}
+
+int main(int argc, const char *argv[]) {
+        test_ptrset_put_remove();
+        test_ptrset_remove_and_put();
+        test_ptrset_move();
+        test_ptrset_reserve();
+        test_ptrset_iterate();
+
+        return 0;
+}
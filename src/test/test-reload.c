@@ -0,0 +1,205 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "manager.h"
+#include "fileio.h"
+#include "util.h"
+#include "macro.h"
+
+static char unit_dir[] = "/tmp/test-reload.XXXXXX";
+static time_t mtime;
+
+/* Writes a unit file, with a new timestamp each time, so that it is
+ * seen as modified even within the same second */
+static void write_unit(const char *name, const char *contents) {
+        _cleanup_free_ char *p = NULL;
+        struct timespec ts[2] = {};
+
+        p = strjoin(unit_dir, "/", name, NULL);
+        assert_se(p);
+        assert_se(write_string_file(p, contents) >= 0);
+
+        ts[0].tv_sec = ts[1].tv_sec = ++mtime;
+        assert_se(utimensat(AT_FDCWD, p, ts, 0) >= 0);
+}
+
+static void remove_unit(const char *name) {
+        _cleanup_free_ char *p = NULL;
+
+        p = strjoin(unit_dir, "/", name, NULL);
+        assert_se(p);
+        assert_se(unlink(p) >= 0);
+}
+
+static void reload(Manager *m) {
+        /* Keep the path cache for the next reload, like manager_loop() */
+        set_free_free(m->unit_path_snapshot);
+        m->unit_path_snapshot = m->unit_path_cache;
+        m->unit_path_cache = NULL;
+
+        assert_se(manager_reload(m) >= 0);
+        manager_dispatch_load_queue(m);
+}
+
+static Unit *load(Manager *m, const char *name) {
+        Unit *u = NULL;
+
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        assert_se(u);
+        return u;
+}
+
+/* a.service wants and is ordered after b.service */
+static void check_dependencies(Unit *a, Unit *b) {
+        assert_se(ptrset_contains(a->dependencies[UNIT_WANTS], b));
+        assert_se(ptrset_contains(a->dependencies[UNIT_AFTER], b));
+        assert_se(ptrset_contains(b->dependencies[UNIT_BEFORE], a));
+}
+
+int main(int argc, char *argv[]) {
+        Manager *m = NULL;
+        Unit *a, *b, *c, *d, *alias;
+        UnitRef ref = {};
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        mtime = time(NULL) - 1000;
+
+        assert_se(mkdtemp(unit_dir));
+        write_unit("a.service",
+                   "[Unit]\n"
+                   "Wants=b.service\n"
+                   "After=b.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        write_unit("b.service",
+                   "[Unit]\n"
+                   "Description=b\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        write_unit("c.service",
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        write_unit("d.service",
+                   "[Unit]\n"
+                   "Before=c.service\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        r = manager_new(SYSTEMD_USER, &m);
+        if (r == -EPERM || r == -EACCES || r == -EADDRINUSE || r == -EHOSTDOWN) {
+                printf("Skipping test: manager_new: %s", strerror(-r));
+                rm_rf_dangerous(unit_dir, false, true, false);
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+
+        m->incremental_reload = true;
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        printf("Load:\n");
+        a = load(m, "a.service");
+        b = load(m, "b.service");
+        c = load(m, "c.service");
+        d = load(m, "d.service");
+        check_dependencies(a, b);
+        assert_se(ptrset_contains(c->dependencies[UNIT_AFTER], d));
+
+        /* Units whose configuration did not change stay untouched,
+         * and keep the dependencies on the reloaded unit their
+         * configuration asked for */
+        printf("Test1: (Changed)\n");
+        unit_ref_set(&ref, a);
+        write_unit("b.service",
+                   "[Unit]\n"
+                   "Description=b changed\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        reload(m);
+
+        assert_se(UNIT_DEREF(ref) == a);
+        assert_se(manager_get_unit(m, "a.service") == a);
+        b = manager_get_unit(m, "b.service");
+        assert_se(b);
+        assert_se(b->load_state == UNIT_LOADED);
+        assert_se(streq(b->description, "b changed"));
+        check_dependencies(a, b);
+        assert_se(manager_get_unit(m, "d.service") == d);
+        unit_ref_unset(&ref);
+
+        printf("Test2: (Removed)\n");
+        unit_ref_set(&ref, d);
+        remove_unit("c.service");
+        reload(m);
+
+        assert_se(UNIT_DEREF(ref) == d);
+        c = manager_get_unit(m, "c.service");
+        assert_se(c);
+        assert_se(c->load_state == UNIT_NOT_FOUND);
+        assert_se(ptrset_contains(c->dependencies[UNIT_AFTER], d));
+        assert_se(ptrset_contains(d->dependencies[UNIT_BEFORE], c));
+        unit_ref_unset(&ref);
+
+        /* A new alias merges two units, which needs a full reload */
+        printf("Test3: (Merged)\n");
+        unit_ref_set(&ref, a);
+        assert_se(symlinkat("b.service", AT_FDCWD, strappenda(unit_dir, "/alias.service")) >= 0);
+        reload(m);
+
+        assert_se(!UNIT_DEREF(ref));
+        a = manager_get_unit(m, "a.service");
+        b = manager_get_unit(m, "b.service");
+        assert_se(a && b);
+        alias = load(m, "alias.service");
+        assert_se(unit_follow_merge(alias) == b);
+        assert_se(set_size(b->names) == 2);
+        check_dependencies(a, b);
+
+        /* Units with more than one name are not reloaded on their own */
+        printf("Test4: (Changed, Merged)\n");
+        unit_ref_set(&ref, a);
+        write_unit("b.service",
+                   "[Unit]\n"
+                   "Description=b changed again\n"
+                   "[Service]\n"
+                   "ExecStart=/bin/true\n");
+        reload(m);
+
+        assert_se(!UNIT_DEREF(ref));
+        a = manager_get_unit(m, "a.service");
+        b = manager_get_unit(m, "b.service");
+        assert_se(a && b);
+        assert_se(streq(b->description, "b changed again"));
+        check_dependencies(a, b);
+
+        manager_free(m);
+
+        rm_rf_dangerous(unit_dir, false, true, false);
+
+        return 0;
+}
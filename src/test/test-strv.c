@@ -405,6 +405,16 @@ static void test_strv_from_stdarg_alloca(void) {
         test_strv_from_stdarg_alloca_one(STRV_MAKE_EMPTY, NULL);
 }
 
+static void test_strv_equal(void) {
+        assert_se(strv_equal(NULL, NULL));
+        assert_se(strv_equal(NULL, STRV_MAKE_EMPTY));
+        assert_se(strv_equal(STRV_MAKE("foo", "bar"), STRV_MAKE("foo", "bar")));
+        assert_se(!strv_equal(STRV_MAKE("foo"), NULL));
+        assert_se(!strv_equal(STRV_MAKE("foo", "bar"), STRV_MAKE("foo")));
+        assert_se(!strv_equal(STRV_MAKE("foo"), STRV_MAKE("foo", "bar")));
+        assert_se(!strv_equal(STRV_MAKE("foo", "bar"), STRV_MAKE("foo", "baz")));
+}
+
 int main(int argc, char *argv[]) {
         test_specifier_printf();
         test_strv_foreach();
@@ -443,6 +453,7 @@ int main(int argc, char *argv[]) {
         test_strv_merge_concat();
         test_strv_append();
         test_strv_from_stdarg_alloca();
+        test_strv_equal();
 
         return 0;
 }
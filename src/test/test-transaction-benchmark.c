@@ -0,0 +1,147 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "manager.h"
+#include "fileio.h"
+#include "util.h"
+#include "time-util.h"
+
+/* Generates a target pulling in a large number of services, each of
+ * which requires and is ordered after two others, and measures how
+ * long loading them takes, building and activating a start and an
+ * isolate transaction for the target, and a stop transaction for the
+ * service everything else requires. Output is one tab separated
+ * line per measurement: step, units, milliseconds and the resident
+ * memory of the process in KiB after the step. The number of services
+ * may be passed as argument. */
+
+static void generate(const char *dir, unsigned n) {
+        _cleanup_free_ char *wants = NULL, *target = NULL;
+        unsigned i;
+
+        target = strappend(dir, "/bench.target");
+        wants = strappend(dir, "/bench.target.wants");
+        assert_se(target && wants);
+
+        assert_se(write_string_file(target, "[Unit]\n"
+                                    "Description=Benchmark\n"
+                                    "DefaultDependencies=no\n"
+                                    "AllowIsolate=yes\n") == 0);
+        assert_se(mkdir(wants, 0755) == 0);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *fn = NULL, *link = NULL, *to = NULL, *contents = NULL;
+
+                assert_se(asprintf(&fn, "%s/bench-%u.service", dir, i) >= 0);
+                assert_se(asprintf(&link, "%s/bench-%u.service", wants, i) >= 0);
+                assert_se(asprintf(&to, "../bench-%u.service", i) >= 0);
+
+                if (i == 0)
+                        contents = strdup("[Unit]\n"
+                                          "DefaultDependencies=no\n"
+                                          "[Service]\n"
+                                          "ExecStart=/bin/true\n");
+                else
+                        assert_se(asprintf(&contents,
+                                           "[Unit]\n"
+                                           "DefaultDependencies=no\n"
+                                           "Requires=bench-%u.service bench-%u.service\n"
+                                           "After=bench-%u.service bench-%u.service\n"
+                                           "[Service]\n"
+                                           "ExecStart=/bin/true\n",
+                                           i / 2, i / 3, i / 2, i / 3) >= 0);
+                assert_se(contents);
+
+                assert_se(write_string_file(fn, contents) == 0);
+                assert_se(symlink(to, link) == 0);
+        }
+}
+
+static unsigned long rss(void) {
+        _cleanup_free_ char *field = NULL;
+        unsigned long kib;
+
+        assert_se(get_status_field("/proc/self/status", "\nVmRSS:", &field) == 0);
+        assert_se(sscanf(field, "%lu", &kib) == 1);
+
+        return kib;
+}
+
+static void report(const char *step, unsigned n, usec_t t) {
+        printf("%s\t%u\t%.3f\t%lu\n", step, n, (double) t / USEC_PER_MSEC, rss());
+        fflush(stdout);
+}
+
+static void benchmark(Manager *m, Unit *u, const char *step, JobType type, JobMode mode, unsigned n) {
+        Job *j;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, type, u, mode, false, NULL, &j) == 0);
+        report(step, n, now(CLOCK_MONOTONIC) - t);
+
+        manager_clear_jobs(m);
+}
+
+int main(int argc, char *argv[]) {
+        char dir[] = "/tmp/test-transaction-benchmark.XXXXXX";
+        Manager *m = NULL;
+        Unit *target = NULL, *first = NULL;
+        unsigned n = 10000;
+        usec_t t;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0);
+
+        log_set_max_level(LOG_WARNING);
+
+        assert_se(mkdtemp(dir));
+        generate(dir, n);
+
+        printf("STEP\tUNITS\tMSEC\tRSS_KIB\n");
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(set_unit_path(dir) >= 0);
+        assert_se(manager_new(SYSTEMD_SYSTEM, &m) >= 0);
+        assert_se(lookup_paths_init(&m->lookup_paths, m->running_as, true, NULL, NULL, NULL) >= 0);
+        report("manager", n, now(CLOCK_MONOTONIC) - t);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_unit(m, "bench.target", NULL, NULL, &target) >= 0);
+        report("load", n, now(CLOCK_MONOTONIC) - t);
+
+        assert_se(first = manager_get_unit(m, "bench-0.service"));
+
+        benchmark(m, target, "start", JOB_START, JOB_REPLACE, n);
+        benchmark(m, target, "isolate", JOB_START, JOB_ISOLATE, n);
+
+        /* Pulls in a stop job for every unit, all of which are
+         * redundant, since nothing is running */
+        benchmark(m, first, "stop", JOB_STOP, JOB_REPLACE, n);
+
+        manager_free(m);
+        rm_rf_dangerous(dir, false, true, false);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2004-2012 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "udev.h"
+#include "util.h"
+#include "time-util.h"
+
+/* Injects a synthetic burst of uevents, like a coldplug of a large
+ * SAN, into the udevd event index and measures the dependency
+ * checks. The linear queue scan udevd used before serves as the
+ * reference for the results, and is measured for the smaller bursts.
+ * Output is one tab separated line per measurement: benchmark, number
+ * of queued events, operations per second and microseconds per
+ * operation. */
+
+#define MAX_EVENTS (64*1024)
+#define MAX_SCAN_EVENTS (16*1024)
+#define MAX_VERIFY_EVENTS (4*1024)
+
+void udev_main_log(struct udev *udev, int priority,
+                   const char *file, int line, const char *fn,
+                   const char *format, va_list args) {}
+
+struct event {
+        struct udev_device *dev;
+        struct udev_event_index_entry *entry;
+        bool queued;
+};
+
+static struct udev_device *device_new(struct udev *udev, unsigned long long int seqnum, unsigned int i, unsigned int luns) {
+        struct udev_device *dev;
+        unsigned int lun = (i / 4) % luns;
+        char buf[UTIL_PATH_SIZE];
+
+        dev = udev_device_new(udev);
+        assert_se(dev);
+
+        /* every LUN gets a scsi device, its disk, a partition and a network interface */
+        switch (i % 4) {
+        case 0:
+                snprintf(buf, sizeof(buf), "DEVPATH=/devices/pci0000:00/0000:00:03.0/host%u/target%u:0:%u/%u:0:%u:%u",
+                         lun / 256, lun / 256, lun / 16, lun / 256, lun / 16, lun % 16);
+                udev_device_add_property_from_string_parse(dev, buf);
+                udev_device_add_property_from_string_parse(dev, "SUBSYSTEM=scsi");
+                break;
+        case 1:
+        case 2:
+                snprintf(buf, sizeof(buf), "DEVPATH=/devices/pci0000:00/0000:00:03.0/host%u/target%u:0:%u/%u:0:%u:%u/block/sd%u%s",
+                         lun / 256, lun / 256, lun / 16, lun / 256, lun / 16, lun % 16, lun, i % 4 == 2 ? "/part1" : "");
+                udev_device_add_property_from_string_parse(dev, buf);
+                udev_device_add_property_from_string_parse(dev, "SUBSYSTEM=block");
+                udev_device_add_property_from_string_parse(dev, "MAJOR=259");
+                snprintf(buf, sizeof(buf), "MINOR=%u", lun * 2 + (i % 4 == 2));
+                udev_device_add_property_from_string_parse(dev, buf);
+                break;
+        case 3:
+                snprintf(buf, sizeof(buf), "DEVPATH=/devices/virtual/net/veth%u", lun);
+                udev_device_add_property_from_string_parse(dev, buf);
+                udev_device_add_property_from_string_parse(dev, "SUBSYSTEM=net");
+                snprintf(buf, sizeof(buf), "IFINDEX=%u", lun + 1);
+                udev_device_add_property_from_string_parse(dev, buf);
+                if (lun % 8 == 0) {
+                        snprintf(buf, sizeof(buf), "DEVPATH_OLD=/devices/virtual/net/veth%u", lun + 1);
+                        udev_device_add_property_from_string_parse(dev, buf);
+                }
+                break;
+        }
+
+        snprintf(buf, sizeof(buf), "SEQNUM=%llu", seqnum);
+        udev_device_add_property_from_string_parse(dev, buf);
+        udev_device_add_property_from_string_parse(dev, "ACTION=add");
+        assert_se(udev_device_add_property_from_string_parse_finish(dev) >= 0);
+        udev_device_set_info_loaded(dev);
+
+        return dev;
+}
+
+/* the queue walk udevd did for every event before it had the index */
+static bool scan_is_busy(struct event *events, unsigned int n, unsigned int k) {
+        struct udev_device *dev = events[k].dev;
+        const char *devpath = udev_device_get_devpath(dev);
+        const char *devpath_old = udev_device_get_devpath_old(dev);
+        size_t devpath_len = strlen(devpath);
+        dev_t devnum = udev_device_get_devnum(dev);
+        bool is_block = streq(udev_device_get_subsystem(dev), "block");
+        int ifindex = udev_device_get_ifindex(dev);
+        unsigned int i;
+
+        for (i = 0; i < k; i++) {
+                struct udev_device *loop_dev = events[i].dev;
+                const char *loop_devpath;
+                size_t loop_devpath_len, common;
+                dev_t loop_devnum;
+                bool loop_is_block;
+
+                if (!events[i].queued)
+                        continue;
+
+                loop_devpath = udev_device_get_devpath(loop_dev);
+                loop_devpath_len = strlen(loop_devpath);
+                loop_devnum = udev_device_get_devnum(loop_dev);
+                loop_is_block = streq(udev_device_get_subsystem(loop_dev), "block");
+
+                if (major(devnum) != 0 && devnum == loop_devnum && is_block == loop_is_block)
+                        return true;
+
+                if (ifindex != 0 && ifindex == udev_device_get_ifindex(loop_dev))
+                        return true;
+
+                if (devpath_old != NULL && streq(loop_devpath, devpath_old))
+                        return true;
+
+                common = MIN(loop_devpath_len, devpath_len);
+                if (memcmp(loop_devpath, devpath, common) != 0)
+                        continue;
+
+                if (loop_devpath_len == devpath_len) {
+                        if (major(devnum) != 0 && (devnum != loop_devnum || is_block != loop_is_block))
+                                continue;
+                        if (ifindex != 0 && ifindex != udev_device_get_ifindex(loop_dev))
+                                continue;
+                        return true;
+                }
+
+                if (devpath[common] == '/' || loop_devpath[common] == '/')
+                        return true;
+        }
+
+        return false;
+}
+
+static void report(const char *benchmark, unsigned int n, unsigned int ops, usec_t t) {
+        t = MAX(t, 1ULL);
+
+        printf("%s\t%u\t%llu\t%.3f\n",
+               benchmark,
+               n,
+               (unsigned long long) (ops * USEC_PER_SEC / t),
+               (double) t / ops);
+        fflush(stdout);
+}
+
+static void verify(struct udev_event_index *index, struct event *events, unsigned int n) {
+        unsigned int i;
+
+        for (i = 0; i < n; i++)
+                if (events[i].queued)
+                        assert_se(udev_event_index_is_busy(index, events[i].entry) == scan_is_busy(events, n, i));
+}
+
+static void burst(struct udev *udev, unsigned int n) {
+        struct udev_event_index *index;
+        struct event *events;
+        unsigned int i, busy, removed;
+        usec_t t;
+
+        index = udev_event_index_new();
+        assert_se(index);
+
+        events = new0(struct event, n);
+        assert_se(events);
+
+        for (i = 0; i < n; i++)
+                events[i].dev = device_new(udev, 1000 + i, i, MAX(n / 8, 1U));
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                assert_se(udev_event_index_add(index, events[i].dev, &events[i].entry) >= 0);
+                events[i].queued = true;
+        }
+        report("insert", n, n, now(CLOCK_MONOTONIC) - t);
+
+        /* one pass of udevd over the queue after the burst arrived */
+        busy = 0;
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                busy += udev_event_index_is_busy(index, events[i].entry);
+        report("busy-index", n, n, now(CLOCK_MONOTONIC) - t);
+
+        if (n <= MAX_SCAN_EVENTS) {
+                unsigned int busy_scan = 0;
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0; i < n; i++)
+                        busy_scan += scan_is_busy(events, n, i);
+                report("busy-scan", n, n, now(CLOCK_MONOTONIC) - t);
+
+                assert_se(busy == busy_scan);
+        }
+
+        if (n <= MAX_VERIFY_EVENTS) {
+                verify(index, events, n);
+
+                /* finish every third event, then every other one */
+                for (i = 0; i < n; i += 3) {
+                        udev_event_index_remove(index, events[i].entry);
+                        events[i].queued = false;
+                }
+                verify(index, events, n);
+
+                for (i = 1; i < n; i += 2) {
+                        if (!events[i].queued)
+                                continue;
+                        udev_event_index_remove(index, events[i].entry);
+                        events[i].queued = false;
+                }
+                verify(index, events, n);
+        }
+
+        removed = 0;
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                if (events[i].queued) {
+                        udev_event_index_remove(index, events[i].entry);
+                        removed++;
+                }
+        report("remove", n, removed, now(CLOCK_MONOTONIC) - t);
+
+        for (i = 0; i < n; i++)
+                udev_device_unref(events[i].dev);
+        free(events);
+        udev_event_index_free(index);
+}
+
+int main(int argc, char *argv[]) {
+        struct udev *udev;
+        unsigned int n;
+
+        udev = udev_new();
+        assert_se(udev);
+
+        printf("BENCHMARK\tEVENTS\tOPS/S\tUSEC/OP\n");
+
+        for (n = 1024; n <= MAX_EVENTS; n *= 4)
+                burst(udev, n);
+
+        udev_unref(udev);
+        return 0;
+}
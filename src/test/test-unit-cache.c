@@ -0,0 +1,153 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unit-cache.h"
+#include "conf-parser.h"
+#include "fileio.h"
+#include "util.h"
+#include "macro.h"
+
+static char *description = NULL;
+static char *exec_start = NULL;
+
+static const ConfigTableItem items[] = {
+        { "Unit",    "Description", config_parse_string, 0, &description },
+        { "Service", "ExecStart",   config_parse_string, 0, &exec_start  },
+        {}
+};
+
+static void reset(void) {
+        free(description);
+        description = NULL;
+        free(exec_start);
+        exec_start = NULL;
+}
+
+static int parse(UnitCache *c, const char *fn, bool at_eof) {
+        _cleanup_fclose_ FILE *f = NULL;
+
+        reset();
+
+        f = fopen(fn, "re");
+        assert_se(f);
+
+        /* A file positioned at its end has no assignments to read, so
+         * whatever shows up must have been replayed from the cache */
+        if (at_eof)
+                assert_se(fseek(f, 0, SEEK_END) == 0);
+
+        return unit_cache_parse(c, "foo.service", fn, f, "Unit\0Service\0",
+                                config_item_table_lookup, (void*) items, true, NULL);
+}
+
+int main(int argc, char *argv[]) {
+        char dir[] = "/tmp/test-unit-cache.XXXXXX";
+        _cleanup_free_ char *cache = NULL, *fn = NULL, *inc = NULL;
+        UnitCache *c;
+
+        assert_se(mkdtemp(dir));
+        cache = strappend(dir, "/cache/unit-cache");
+        fn = strappend(dir, "/foo.service");
+        inc = strappend(dir, "/bar.service");
+        assert_se(cache && fn && inc);
+
+        assert_se(write_string_file(fn,
+                                    "[Unit]\n"
+                                    "Description=foo \\\n"
+                                    "  bar\n"
+                                    "# comment\n"
+                                    "[Install]\n"
+                                    "WantedBy=baz.target\n"
+                                    "[Service]\n"
+                                    "ExecStart=/bin/true\n") == 0);
+
+        /* Nothing cached yet */
+        assert_se(unit_cache_new(&c, cache) == 0);
+        assert_se(parse(c, fn, false) == 0);
+        assert_se(streq(description, "foo    bar"));
+        assert_se(streq(exec_start, "/bin/true"));
+
+        /* Recorded in memory */
+        assert_se(parse(c, fn, true) == 0);
+        assert_se(streq(description, "foo    bar"));
+        assert_se(streq(exec_start, "/bin/true"));
+
+        assert_se(unit_cache_flush(c) == 0);
+        assert_se(access(cache, F_OK) == 0);
+        unit_cache_free(c);
+
+        /* Replayed from the cache file */
+        assert_se(unit_cache_new(&c, cache) == 0);
+        assert_se(parse(c, fn, true) == 0);
+        assert_se(streq(description, "foo    bar"));
+        assert_se(streq(exec_start, "/bin/true"));
+
+        /* Used files are written out again */
+        assert_se(unit_cache_flush(c) == 0);
+        assert_se(parse(c, fn, true) == 0);
+        assert_se(streq(description, "foo    bar"));
+
+        /* Unused files are dropped */
+        assert_se(unit_cache_flush(c) == 0);
+        assert_se(unit_cache_flush(c) == 0);
+        assert_se(parse(c, fn, true) == 0);
+        assert_se(!description && !exec_start);
+
+        /* A changed file is parsed again */
+        assert_se(write_string_file(fn,
+                                    "[Unit]\n"
+                                    "Description=changed\n") == 0);
+        assert_se(parse(c, fn, false) == 0);
+        assert_se(streq(description, "changed"));
+        assert_se(!exec_start);
+        assert_se(parse(c, fn, true) == 0);
+        assert_se(streq(description, "changed"));
+        assert_se(!exec_start);
+
+        /* Files with .include are not cached */
+        assert_se(write_string_file(inc, "[Service]\nExecStart=/bin/false\n") == 0);
+        assert_se(write_string_file(fn,
+                                    ".include bar.service\n"
+                                    "[Unit]\n"
+                                    "Description=included\n") == 0);
+        assert_se(parse(c, fn, false) == 0);
+        assert_se(streq(description, "included"));
+        assert_se(streq(exec_start, "/bin/false"));
+        assert_se(parse(c, fn, true) == 0);
+        assert_se(!description && !exec_start);
+
+        unit_cache_free(c);
+
+        /* A corrupted cache file is ignored */
+        assert_se(write_string_file(cache, "garbage") == 0);
+        assert_se(unit_cache_new(&c, cache) == 0);
+        assert_se(parse(c, fn, false) == 0);
+        assert_se(streq(description, "included"));
+        unit_cache_free(c);
+
+        reset();
+        rm_rf_dangerous(dir, false, true, false);
+
+        return 0;
+}
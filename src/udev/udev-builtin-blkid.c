@@ -26,10 +26,38 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <blkid/blkid.h>
 
 #include "udev.h"
+#include "mkdir.h"
+
+/*
+ * Probe results are cached in /run/udev/blkid/<disk>/<device>, to answer
+ * rescans of devices which have not been written to, without reading their
+ * superblocks and partition tables again. Entries are only written for
+ * devices probed before, not on their first "add". Only disks udev watches
+ * for writes are cached; udevd removes the directory of a disk when the disk
+ * or one of its partitions is closed after writing, and "change" events of
+ * new media or a new size remove it too. Disks used by stacked devices or
+ * mounted filesystems can be written to without using the node, their
+ * entries are dropped instead of used. Rules can disable the cache with
+ * --nocache.
+ */
+
+#define BLKID_CACHE_MAGIC 0xb1c1d001
+
+struct blkid_cache_key {
+        uint32_t magic;
+        uint32_t noraid;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t mtime_sec;
+        uint64_t mtime_nsec;
+        uint64_t disk_mtime_sec;
+        uint64_t disk_mtime_nsec;
+};
 
 static void print_property(struct udev_device *dev, bool test, const char *name, const char *value)
 {
@@ -100,6 +128,265 @@ static void print_property(struct udev_device *dev, bool test, const char *name,
         }
 }
 
+/* the disk a block device belongs to */
+static struct udev_device *cache_get_disk(struct udev_device *dev)
+{
+        struct udev_device *disk;
+
+        if (streq_ptr(udev_device_get_devtype(dev), "partition")) {
+                disk = udev_device_get_parent_with_subsystem_devtype(dev, "block", "disk");
+                if (disk == NULL)
+                        return NULL;
+        } else {
+                disk = dev;
+        }
+
+        /* read the current database, not the one of the event */
+        return udev_device_new_from_syspath(udev_device_get_udev(dev), udev_device_get_syspath(disk));
+}
+
+static void cache_get_dir(struct udev_device *disk, char *path, size_t size)
+{
+        strscpyl(path, size, "/run/udev/blkid/", udev_device_get_id_filename(disk), NULL);
+}
+
+/* remove the cached results of the disk and all its partitions */
+void udev_builtin_blkid_cache_invalidate(struct udev_device *dev)
+{
+        struct udev_device *disk;
+        char path[UTIL_PATH_SIZE];
+
+        if (!streq_ptr(udev_device_get_subsystem(dev), "block"))
+                return;
+
+        disk = cache_get_disk(dev);
+        if (disk == NULL)
+                return;
+
+        cache_get_dir(disk, path, sizeof(path));
+        rm_rf(path, false, true, false);
+        udev_device_unref(disk);
+}
+
+/* the disk or one of its partitions is written to without using the node */
+static bool cache_disk_in_use(struct udev_device *disk)
+{
+        struct udev *udev = udev_device_get_udev(disk);
+        struct udev_enumerate *udev_enumerate;
+        struct udev_list_entry *list_entry;
+        dev_t devnums[256];
+        unsigned int n = 0;
+        FILE *f = NULL;
+        char line[LINE_MAX];
+        bool in_use = true;
+
+        /* devices stacked on top, like device-mapper, multipath or md */
+        udev_enumerate = udev_enumerate_new(udev);
+        if (udev_enumerate == NULL)
+                return true;
+        udev_enumerate_add_match_parent(udev_enumerate, disk);
+        udev_enumerate_add_match_subsystem(udev_enumerate, "block");
+        if (udev_enumerate_scan_devices(udev_enumerate) < 0)
+                goto out;
+        udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(udev_enumerate)) {
+                struct udev_device *d;
+                char path[UTIL_PATH_SIZE];
+
+                strscpyl(path, sizeof(path), udev_list_entry_get_name(list_entry), "/holders", NULL);
+                if (dir_is_empty(path) == 0)
+                        goto out;
+
+                /* remember the device numbers of the disk and its partitions */
+                if (n >= ELEMENTSOF(devnums))
+                        goto out;
+                d = udev_device_new_from_syspath(udev, udev_list_entry_get_name(list_entry));
+                if (d == NULL)
+                        goto out;
+                devnums[n++] = udev_device_get_devnum(d);
+                udev_device_unref(d);
+        }
+
+        /* mounted filesystems, which can change their label or UUID online */
+        f = fopen("/proc/self/mountinfo", "re");
+        if (f == NULL)
+                goto out;
+        while (fgets(line, sizeof(line), f) != NULL) {
+                unsigned int maj, min;
+                dev_t devnum;
+                const char *fields;
+                char *source;
+                struct stat st;
+                unsigned int i;
+
+                if (sscanf(line, "%*s %*s %u:%u", &maj, &min) != 2)
+                        continue;
+                devnum = makedev(maj, min);
+
+                /* filesystems like btrfs have an anonymous device number, use the source device */
+                if (maj == 0) {
+                        fields = strstr(line, " - ");
+                        if (fields == NULL || sscanf(fields, " - %*s %ms", &source) != 1)
+                                continue;
+                        if (startswith(source, "/dev/") && stat(source, &st) == 0 && S_ISBLK(st.st_mode))
+                                devnum = st.st_rdev;
+                        free(source);
+                        if (major(devnum) == 0)
+                                continue;
+                }
+
+                for (i = 0; i < n; i++)
+                        if (devnums[i] == devnum)
+                                goto out;
+        }
+        in_use = false;
+out:
+        if (f != NULL)
+                fclose(f);
+        udev_enumerate_unref(udev_enumerate);
+        return in_use;
+}
+
+/* find the cache file of the device, if its results can be cached */
+static bool cache_get_path(struct udev_device *dev, struct udev_device *disk, char *path, size_t size, struct blkid_cache_key *key)
+{
+        const char *removable;
+        struct stat st;
+        size_t l;
+
+        /* virtual devices like loop or device-mapper change their content without writes to the node */
+        if (startswith(udev_device_get_devpath(disk), "/devices/virtual/"))
+                return false;
+
+        /* media might be swapped */
+        removable = udev_device_get_sysattr_value(disk, "removable");
+        if (removable == NULL || !streq(removable, "0"))
+                return false;
+
+        /* writes would go unnoticed */
+        if (udev_device_get_watch_handle(disk) < 0)
+                return false;
+
+        /* writes to the disk change the content of its partitions */
+        if (stat(udev_device_get_devnode(disk), &st) < 0)
+                return false;
+        key->disk_mtime_sec = st.st_mtim.tv_sec;
+        key->disk_mtime_nsec = st.st_mtim.tv_nsec;
+
+        cache_get_dir(disk, path, size);
+        l = strlen(path);
+        strscpyl(path + l, size - l, "/", udev_device_get_id_filename(dev), NULL);
+        return true;
+}
+
+/* the device was probed before, this is a rescan */
+static bool cache_device_known(struct udev_device *dev)
+{
+        struct udev_device *d;
+        bool known;
+
+        /* read the current database, not the one of the event */
+        d = udev_device_new_from_syspath(udev_device_get_udev(dev), udev_device_get_syspath(dev));
+        if (d == NULL)
+                return false;
+        known = udev_device_get_is_initialized(d) > 0;
+        udev_device_unref(d);
+        return known;
+}
+
+/* new media or a new size */
+static bool cache_event_is_stale(struct udev_device *dev)
+{
+        if (!streq_ptr(udev_device_get_action(dev), "change"))
+                return false;
+
+        return streq_ptr(udev_device_get_property_value(dev, "DISK_MEDIA_CHANGE"), "1") ||
+               streq_ptr(udev_device_get_property_value(dev, "RESIZE"), "1");
+}
+
+static bool cache_read(struct udev_device *dev, struct udev_device *disk, bool test,
+                       const char *path, const struct blkid_cache_key *key, bool *in_use)
+{
+        char buf[64 * 1024];
+        struct blkid_cache_key *cached = (struct blkid_cache_key *) buf;
+        ssize_t len;
+        size_t pos;
+        int fd;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOFOLLOW);
+        if (fd < 0)
+                return false;
+        len = read(fd, buf, sizeof(buf));
+        close(fd);
+
+        if (len < (ssize_t) sizeof(struct blkid_cache_key) || len == sizeof(buf))
+                return false;
+        if (memcmp(cached, key, sizeof(struct blkid_cache_key)) != 0)
+                return false;
+        if (buf[len-1] != '\0' && len > (ssize_t) sizeof(struct blkid_cache_key))
+                return false;
+
+        /* only checked for entries we would use, it is not cheap */
+        if (cache_disk_in_use(disk)) {
+                log_debug("%s in use, dropping cached probe\n", udev_device_get_devnode(dev));
+                unlink(path);
+                *in_use = true;
+                return false;
+        }
+
+        /* name and value pairs of the probe */
+        pos = sizeof(struct blkid_cache_key);
+        while (pos < (size_t) len) {
+                const char *name = &buf[pos];
+                const char *value;
+
+                pos += strlen(name) + 1;
+                if (pos >= (size_t) len)
+                        break;
+                value = &buf[pos];
+                pos += strlen(value) + 1;
+
+                print_property(dev, test, name, value);
+        }
+
+        log_debug("probe %s cached\n", udev_device_get_devnode(dev));
+        return true;
+}
+
+static void cache_write(blkid_probe pr, const char *path, const struct blkid_cache_key *key)
+{
+        char path_tmp[UTIL_PATH_SIZE];
+        FILE *f;
+        int nvals;
+        int i;
+
+        strscpyl(path_tmp, sizeof(path_tmp), path, ".tmp", NULL);
+        mkdir_parents(path_tmp, 0755);
+        f = fopen(path_tmp, "we");
+        if (f == NULL)
+                return;
+
+        fwrite(key, sizeof(struct blkid_cache_key), 1, f);
+
+        nvals = blkid_probe_numof_values(pr);
+        for (i = 0; i < nvals; i++) {
+                const char *name;
+                const char *data;
+                size_t len;
+
+                if (blkid_probe_get_value(pr, i, &name, &data, &len))
+                        continue;
+                len = strnlen(data, len);
+                fwrite(name, strlen(name) + 1, 1, f);
+                fwrite(data, len, 1, f);
+                fputc('\0', f);
+        }
+
+        fflush(f);
+        if (ferror(f) || rename(path_tmp, path) < 0)
+                unlink(path_tmp);
+        fclose(f);
+}
+
 static int probe_superblocks(blkid_probe pr)
 {
         struct stat st;
@@ -136,6 +423,7 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
 {
         int64_t offset = 0;
         bool noraid = false;
+        bool nocache = false;
         int fd = -1;
         blkid_probe pr;
         const char *data;
@@ -144,17 +432,24 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         int i;
         size_t len;
         int err = 0;
+        char cache_path[UTIL_PATH_SIZE];
+        struct udev_device *disk = NULL;
+        bool cache = false;
+        bool in_use = false;
+        struct blkid_cache_key key = {};
+        struct stat st;
 
         static const struct option options[] = {
                 { "offset", optional_argument, NULL, 'o' },
                 { "noraid", no_argument, NULL, 'R' },
+                { "nocache", no_argument, NULL, 'C' },
                 {}
         };
 
         for (;;) {
                 int option;
 
-                option = getopt_long(argc, argv, "oR", options, NULL);
+                option = getopt_long(argc, argv, "oRC", options, NULL);
                 if (option == -1)
                         break;
 
@@ -165,6 +460,9 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 case 'R':
                         noraid = true;
                         break;
+                case 'C':
+                        nocache = true;
+                        break;
                 }
         }
 
@@ -190,13 +488,34 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         if (err < 0)
                 goto out;
 
+        /* results of devices which have not been written to, are still valid */
+        if (!test && !nocache && fstat(fd, &st) == 0)
+                disk = cache_get_disk(dev);
+        if (disk != NULL && cache_get_path(dev, disk, cache_path, sizeof(cache_path), &key)) {
+                cache = true;
+                key.magic = BLKID_CACHE_MAGIC;
+                key.noraid = noraid;
+                key.offset = offset;
+                key.size = blkid_probe_get_size(pr);
+                key.mtime_sec = st.st_mtim.tv_sec;
+                key.mtime_nsec = st.st_mtim.tv_nsec;
+
+                if (cache_event_is_stale(dev))
+                        udev_builtin_blkid_cache_invalidate(dev);
+                else if (cache_read(dev, disk, test, cache_path, &key, &in_use))
+                        goto out_free;
+        }
+
         log_debug("probe %s %sraid offset=%llu\n",
                   udev_device_get_devnode(dev),
                   noraid ? "no" : "", (unsigned long long) offset);
 
         err = probe_superblocks(pr);
-        if (err < 0)
+        if (err < 0) {
+                if (cache)
+                        unlink(cache_path);
                 goto out;
+        }
 
         nvals = blkid_probe_numof_values(pr);
         for (i = 0; i < nvals; i++) {
@@ -206,8 +525,13 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 print_property(dev, test, name, (char *) data);
         }
 
+        if (cache && !in_use && cache_device_known(dev))
+                cache_write(pr, cache_path, &key);
+out_free:
         blkid_free_probe(pr);
 out:
+        if (disk != NULL)
+                udev_device_unref(disk);
         if (fd > 0)
                 close(fd);
         if (err < 0)
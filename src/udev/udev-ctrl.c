@@ -35,6 +35,7 @@ enum udev_ctrl_msg_type {
         UDEV_CTRL_SET_CHILDREN_MAX,
         UDEV_CTRL_PING,
         UDEV_CTRL_EXIT,
+        UDEV_CTRL_SETTLE,
 };
 
 struct udev_ctrl_msg_wire {
@@ -44,6 +45,11 @@ struct udev_ctrl_msg_wire {
         union {
                 int intval;
                 char buf[256];
+                struct {
+                        unsigned long long int seqnum_start;
+                        unsigned long long int seqnum_end;
+                        char subsystem[128];
+                } settle;
         };
 };
 
@@ -241,20 +247,17 @@ struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connect
         return NULL;
 }
 
-static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout)
+static void ctrl_msg_wire_init(struct udev_ctrl_msg_wire *ctrl_msg_wire, enum udev_ctrl_msg_type type)
 {
-        struct udev_ctrl_msg_wire ctrl_msg_wire;
-        int err = 0;
-
-        memset(&ctrl_msg_wire, 0x00, sizeof(struct udev_ctrl_msg_wire));
-        strcpy(ctrl_msg_wire.version, "udev-" VERSION);
-        ctrl_msg_wire.magic = UDEV_CTRL_MAGIC;
-        ctrl_msg_wire.type = type;
+        memset(ctrl_msg_wire, 0x00, sizeof(struct udev_ctrl_msg_wire));
+        strcpy(ctrl_msg_wire->version, "udev-" VERSION);
+        ctrl_msg_wire->magic = UDEV_CTRL_MAGIC;
+        ctrl_msg_wire->type = type;
+}
 
-        if (buf != NULL)
-                strscpy(ctrl_msg_wire.buf, sizeof(ctrl_msg_wire.buf), buf);
-        else
-                ctrl_msg_wire.intval = intval;
+static int ctrl_send_wire(struct udev_ctrl *uctrl, struct udev_ctrl_msg_wire *ctrl_msg_wire, int timeout)
+{
+        int err = 0;
 
         if (!uctrl->connected) {
                 if (connect(uctrl->sock, (struct sockaddr *)&uctrl->saddr, uctrl->addrlen) < 0) {
@@ -263,7 +266,7 @@ static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int
                 }
                 uctrl->connected = true;
         }
-        if (send(uctrl->sock, &ctrl_msg_wire, sizeof(ctrl_msg_wire), 0) < 0) {
+        if (send(uctrl->sock, ctrl_msg_wire, sizeof(struct udev_ctrl_msg_wire), 0) < 0) {
                 err = -errno;
                 goto out;
         }
@@ -296,6 +299,20 @@ out:
         return err;
 }
 
+static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout)
+{
+        struct udev_ctrl_msg_wire ctrl_msg_wire;
+
+        ctrl_msg_wire_init(&ctrl_msg_wire, type);
+
+        if (buf != NULL)
+                strscpy(ctrl_msg_wire.buf, sizeof(ctrl_msg_wire.buf), buf);
+        else
+                ctrl_msg_wire.intval = intval;
+
+        return ctrl_send_wire(uctrl, &ctrl_msg_wire, timeout);
+}
+
 int udev_ctrl_send_set_log_level(struct udev_ctrl *uctrl, int priority, int timeout)
 {
         return ctrl_send(uctrl, UDEV_CTRL_SET_LOG_LEVEL, priority, NULL, timeout);
@@ -336,6 +353,50 @@ int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout)
         return ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL, timeout);
 }
 
+/*
+ * Wait until the daemon has handled all events up to the given sequence
+ * number; with a subsystem, only the events of that subsystem. A zero end
+ * sequence number asks for everything the kernel has sent so far. The
+ * daemon answers when the events are handled, daemons which do not know
+ * the message just close the connection, which returns -EOPNOTSUPP. A
+ * timeout of zero or less waits forever.
+ */
+int udev_ctrl_send_settle(struct udev_ctrl *uctrl, const char *subsystem,
+                          unsigned long long int seqnum_start, unsigned long long int seqnum_end, int timeout)
+{
+        struct udev_ctrl_msg_wire ctrl_msg_wire;
+        ssize_t size;
+        int err;
+
+        ctrl_msg_wire_init(&ctrl_msg_wire, UDEV_CTRL_SETTLE);
+        ctrl_msg_wire.settle.seqnum_start = seqnum_start;
+        ctrl_msg_wire.settle.seqnum_end = seqnum_end;
+        if (subsystem != NULL)
+                strscpy(ctrl_msg_wire.settle.subsystem, sizeof(ctrl_msg_wire.settle.subsystem), subsystem);
+
+        err = ctrl_send_wire(uctrl, &ctrl_msg_wire, timeout > 0 ? timeout : -1);
+        if (err < 0)
+                return err;
+
+        size = recv(uctrl->sock, &ctrl_msg_wire, sizeof(struct udev_ctrl_msg_wire), MSG_DONTWAIT);
+        if (size < 0)
+                return -errno;
+        if (size != sizeof(struct udev_ctrl_msg_wire) ||
+            ctrl_msg_wire.magic != UDEV_CTRL_MAGIC || ctrl_msg_wire.type != UDEV_CTRL_SETTLE)
+                return -EOPNOTSUPP;
+        return 0;
+}
+
+int udev_ctrl_connection_send_settled(struct udev_ctrl_connection *conn)
+{
+        struct udev_ctrl_msg_wire ctrl_msg_wire;
+
+        ctrl_msg_wire_init(&ctrl_msg_wire, UDEV_CTRL_SETTLE);
+        if (send(conn->sock, &ctrl_msg_wire, sizeof(struct udev_ctrl_msg_wire), MSG_DONTWAIT|MSG_NOSIGNAL) < 0)
+                return -errno;
+        return 0;
+}
+
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn)
 {
         struct udev_ctrl_msg *uctrl_msg;
@@ -483,3 +544,19 @@ int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg)
                 return 1;
         return -1;
 }
+
+int udev_ctrl_get_settle(struct udev_ctrl_msg *ctrl_msg, const char **subsystem,
+                         unsigned long long int *seqnum_start, unsigned long long int *seqnum_end)
+{
+        if (ctrl_msg->ctrl_msg_wire.type != UDEV_CTRL_SETTLE)
+                return -1;
+
+        ctrl_msg->ctrl_msg_wire.settle.subsystem[sizeof(ctrl_msg->ctrl_msg_wire.settle.subsystem)-1] = '\0';
+        if (ctrl_msg->ctrl_msg_wire.settle.subsystem[0] != '\0')
+                *subsystem = ctrl_msg->ctrl_msg_wire.settle.subsystem;
+        else
+                *subsystem = NULL;
+        *seqnum_start = ctrl_msg->ctrl_msg_wire.settle.seqnum_start;
+        *seqnum_end = ctrl_msg->ctrl_msg_wire.settle.seqnum_end;
+        return 1;
+}
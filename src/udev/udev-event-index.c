@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2004-2012 Kay Sievers <kay@vrfy.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "udev.h"
+#include "hashmap.h"
+
+/*
+ * Index of the queued and running events, to find the events a new
+ * event has to wait for without walking the whole queue.
+ *
+ * Every event is linked into the bucket of its devpath, of its device
+ * number and of its interface index, and into the list of events below
+ * the bucket of every parent devpath. Events are added in the order of
+ * their sequence numbers, the first event in a list is the oldest one.
+ */
+
+struct bucket {
+        char *key;
+        /* events with this devpath, device number or interface index */
+        struct udev_list_node events;
+        /* events with a devpath below this devpath */
+        struct udev_list_node below;
+};
+
+struct link {
+        struct udev_list_node node;
+        struct udev_event_index_entry *entry;
+        struct bucket *bucket;
+};
+
+enum {
+        LINK_DEVPATH,
+        LINK_DEVNUM,
+        LINK_IFINDEX,
+        _LINK_PARENTS,
+};
+
+struct udev_event_index_entry {
+        unsigned long long int seqnum;
+        dev_t devnum;
+        int ifindex;
+        bool is_block;
+        bool nodelay;
+        const char *devpath_old;
+        unsigned int links_count;
+        struct link links[];
+};
+
+struct udev_event_index {
+        Hashmap *buckets;
+};
+
+static inline struct link *node_to_link(struct udev_list_node *node)
+{
+        return container_of(node, struct link, node);
+}
+
+struct udev_event_index *udev_event_index_new(void)
+{
+        struct udev_event_index *index;
+
+        index = calloc(1, sizeof(struct udev_event_index));
+        if (index == NULL)
+                return NULL;
+
+        index->buckets = hashmap_new(string_hash_func, string_compare_func);
+        if (index->buckets == NULL) {
+                free(index);
+                return NULL;
+        }
+
+        return index;
+}
+
+static void bucket_free(struct bucket *bucket)
+{
+        free(bucket->key);
+        free(bucket);
+}
+
+void udev_event_index_free(struct udev_event_index *index)
+{
+        struct bucket *bucket;
+
+        if (index == NULL)
+                return;
+
+        while ((bucket = hashmap_steal_first(index->buckets)))
+                bucket_free(bucket);
+        hashmap_free(index->buckets);
+        free(index);
+}
+
+static int index_link(struct udev_event_index *index, struct udev_event_index_entry *entry,
+                      struct link *link, const char *key, bool below)
+{
+        struct bucket *bucket;
+
+        bucket = hashmap_get(index->buckets, key);
+        if (bucket == NULL) {
+                int r;
+
+                bucket = calloc(1, sizeof(struct bucket));
+                if (bucket == NULL)
+                        return -ENOMEM;
+
+                bucket->key = strdup(key);
+                if (bucket->key == NULL) {
+                        free(bucket);
+                        return -ENOMEM;
+                }
+                udev_list_node_init(&bucket->events);
+                udev_list_node_init(&bucket->below);
+
+                r = hashmap_put(index->buckets, bucket->key, bucket);
+                if (r < 0) {
+                        bucket_free(bucket);
+                        return r;
+                }
+        }
+
+        link->entry = entry;
+        link->bucket = bucket;
+        udev_list_node_append(&link->node, below ? &bucket->below : &bucket->events);
+        return 0;
+}
+
+static void index_unlink(struct udev_event_index *index, struct link *link)
+{
+        struct bucket *bucket = link->bucket;
+
+        if (bucket == NULL)
+                return;
+
+        udev_list_node_remove(&link->node);
+        link->bucket = NULL;
+
+        if (udev_list_node_is_empty(&bucket->events) && udev_list_node_is_empty(&bucket->below)) {
+                hashmap_remove(index->buckets, bucket->key);
+                bucket_free(bucket);
+        }
+}
+
+int udev_event_index_add(struct udev_event_index *index, struct udev_device *dev, struct udev_event_index_entry **ret)
+{
+        struct udev_event_index_entry *entry;
+        const char *devpath;
+        char *path, *pos;
+        unsigned int parents = 0;
+        int r;
+
+        devpath = udev_device_get_devpath(dev);
+        if (devpath == NULL)
+                return -EINVAL;
+
+        for (pos = strchr(devpath + 1, '/'); pos != NULL; pos = strchr(pos + 1, '/'))
+                parents++;
+
+        entry = calloc(1, sizeof(struct udev_event_index_entry) + (_LINK_PARENTS + parents) * sizeof(struct link));
+        if (entry == NULL)
+                return -ENOMEM;
+
+        entry->seqnum = udev_device_get_seqnum(dev);
+        entry->devnum = udev_device_get_devnum(dev);
+        entry->is_block = streq_ptr("block", udev_device_get_subsystem(dev));
+        entry->ifindex = udev_device_get_ifindex(dev);
+        entry->devpath_old = udev_device_get_devpath_old(dev);
+#ifdef HAVE_FIRMWARE
+        if (streq_ptr(udev_device_get_subsystem(dev), "firmware"))
+                entry->nodelay = true;
+#endif
+        entry->links_count = _LINK_PARENTS + parents;
+
+        r = index_link(index, entry, &entry->links[LINK_DEVPATH], devpath, false);
+        if (r < 0)
+                goto fail;
+
+        if (major(entry->devnum) != 0) {
+                char key[64];
+
+                snprintf(key, sizeof(key), "%c%u:%u", entry->is_block ? 'b' : 'c',
+                         major(entry->devnum), minor(entry->devnum));
+                r = index_link(index, entry, &entry->links[LINK_DEVNUM], key, false);
+                if (r < 0)
+                        goto fail;
+        }
+
+        if (entry->ifindex > 0) {
+                char key[64];
+
+                snprintf(key, sizeof(key), "n%i", entry->ifindex);
+                r = index_link(index, entry, &entry->links[LINK_IFINDEX], key, false);
+                if (r < 0)
+                        goto fail;
+        }
+
+        /* link the event below every parent devpath */
+        path = strdupa(devpath);
+        parents = 0;
+        for (pos = strchr(path + 1, '/'); pos != NULL; pos = strchr(pos + 1, '/')) {
+                pos[0] = '\0';
+                r = index_link(index, entry, &entry->links[_LINK_PARENTS + parents], path, true);
+                pos[0] = '/';
+                if (r < 0)
+                        goto fail;
+                parents++;
+        }
+
+        *ret = entry;
+        return 0;
+fail:
+        udev_event_index_remove(index, entry);
+        return r;
+}
+
+void udev_event_index_remove(struct udev_event_index *index, struct udev_event_index_entry *entry)
+{
+        unsigned int i;
+
+        if (entry == NULL)
+                return;
+
+        for (i = 0; i < entry->links_count; i++)
+                index_unlink(index, &entry->links[i]);
+        free(entry);
+}
+
+/* the oldest event in the list was queued before the given sequence number */
+static bool list_has_earlier(struct udev_list_node *list, unsigned long long int seqnum)
+{
+        if (udev_list_node_is_empty(list))
+                return false;
+
+        return node_to_link(list->next)->entry->seqnum < seqnum;
+}
+
+/* lookup earlier event for identical, parent, child device */
+bool udev_event_index_is_busy(struct udev_event_index *index, struct udev_event_index_entry *entry)
+{
+        struct bucket *bucket;
+        struct udev_list_node *loop;
+        unsigned int i;
+
+        /* check major/minor */
+        if (entry->links[LINK_DEVNUM].bucket != NULL &&
+            list_has_earlier(&entry->links[LINK_DEVNUM].bucket->events, entry->seqnum))
+                return true;
+
+        /* check network device ifindex */
+        if (entry->links[LINK_IFINDEX].bucket != NULL &&
+            list_has_earlier(&entry->links[LINK_IFINDEX].bucket->events, entry->seqnum))
+                return true;
+
+        /* check our old name */
+        if (entry->devpath_old != NULL) {
+                bucket = hashmap_get(index->buckets, entry->devpath_old);
+                if (bucket != NULL && list_has_earlier(&bucket->events, entry->seqnum))
+                        return true;
+        }
+
+        /* identical device event found */
+        bucket = entry->links[LINK_DEVPATH].bucket;
+        udev_list_node_foreach(loop, &bucket->events) {
+                struct udev_event_index_entry *loop_entry = node_to_link(loop)->entry;
+
+                /* found ourself, no later event can block us */
+                if (loop_entry->seqnum >= entry->seqnum)
+                        break;
+
+                /* devices names might have changed/swapped in the meantime */
+                if (major(entry->devnum) != 0 && (entry->devnum != loop_entry->devnum || entry->is_block != loop_entry->is_block))
+                        continue;
+                if (entry->ifindex != 0 && entry->ifindex != loop_entry->ifindex)
+                        continue;
+                return true;
+        }
+
+        /* allow to bypass the dependency tracking */
+        if (entry->nodelay)
+                return false;
+
+        /* child device event found */
+        if (list_has_earlier(&bucket->below, entry->seqnum))
+                return true;
+
+        /* parent device event found */
+        for (i = _LINK_PARENTS; i < entry->links_count; i++)
+                if (list_has_earlier(&entry->links[i].bucket->events, entry->seqnum))
+                        return true;
+
+        return false;
+}
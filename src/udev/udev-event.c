@@ -786,6 +786,7 @@ int udev_event_execute_rules(struct udev_event *event, struct udev_rules *rules,
                 udev_device_read_db(dev, NULL);
                 udev_device_delete_db(dev);
                 udev_device_tag_index(dev, NULL, false);
+                udev_device_subsystem_index(dev, false);
 
                 if (major(udev_device_get_devnum(dev)) != 0)
                         udev_watch_end(event->udev, dev);
@@ -874,6 +875,7 @@ int udev_event_execute_rules(struct udev_event *event, struct udev_rules *rules,
                 /* (re)write database file */
                 udev_device_update_db(dev);
                 udev_device_tag_index(dev, event->dev_db, true);
+                udev_device_subsystem_index(dev, true);
                 udev_device_set_is_initialized(dev);
 
                 udev_device_unref(event->dev_db);
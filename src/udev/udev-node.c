@@ -125,6 +125,36 @@ exit:
         return err;
 }
 
+/*
+ * Every device claiming a link has an entry in the stack directory of the
+ * link, named by its device id. The entry is a symlink to
+ * "<priority>:<devnode>", so the stack can be resolved without reading
+ * the database of every claimant.
+ */
+static int link_stack_entry_read(int dfd, const char *name, int *priority, char *devnode, size_t size)
+{
+        char buf[UTIL_PATH_SIZE];
+        ssize_t len;
+        char *colon;
+
+        len = readlinkat(dfd, name, buf, sizeof(buf));
+        if (len < 0)
+                return -errno;
+        if (len >= (ssize_t)sizeof(buf))
+                return -ENAMETOOLONG;
+        buf[len] = '\0';
+
+        colon = strchr(buf, ':');
+        if (colon == NULL || colon[1] == '\0')
+                return -EBADMSG;
+        colon[0] = '\0';
+        if (safe_atoi(buf, priority) < 0)
+                return -EBADMSG;
+
+        strscpy(devnode, size, &colon[1]);
+        return 0;
+}
+
 /* find device node of device with highest priority */
 static const char *link_find_prioritized(struct udev_device *dev, bool add, const char *stackdir, char *buf, size_t bufsize)
 {
@@ -145,6 +175,9 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
         for (;;) {
                 struct udev_device *dev_db;
                 struct dirent *dent;
+                char devnode[UTIL_PATH_SIZE];
+                int prio;
+                int err;
 
                 dent = readdir(dir);
                 if (dent == NULL || dent->d_name[0] == '\0')
@@ -158,6 +191,21 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 if (streq(dent->d_name, udev_device_get_id_filename(dev)))
                         continue;
 
+                err = link_stack_entry_read(dirfd(dir), dent->d_name, &prio, devnode, sizeof(devnode));
+                if (err == 0) {
+                        if (target == NULL || prio > priority) {
+                                log_debug("'%s' claims priority %i for '%s'\n", dent->d_name, prio, stackdir);
+                                priority = prio;
+                                strscpy(buf, bufsize, devnode);
+                                target = buf;
+                        }
+                        continue;
+                }
+
+                /* entries created by an older version are empty files, read the database */
+                if (err != -EINVAL)
+                        continue;
+
                 dev_db = udev_device_new_from_device_id(udev, dent->d_name);
                 if (dev_db != NULL) {
                         const char *devnode;
@@ -207,19 +255,24 @@ static void link_update(struct udev_device *dev, const char *slink, bool add)
         }
 
         if (add) {
+                char filename_tmp[UTIL_PATH_SIZE * 2];
+                char data[UTIL_PATH_SIZE + DECIMAL_STR_MAX(int) + 1];
                 int err;
 
-                do {
-                        int fd;
+                /* replace the entry atomically, the hidden temporary entry is skipped by readers */
+                strscpyl(filename_tmp, sizeof(filename_tmp), dirname, "/.", udev_device_get_id_filename(dev), NULL);
+                snprintf(data, sizeof(data), "%i:%s", udev_device_get_devlink_priority(dev), udev_device_get_devnode(dev));
 
+                do {
                         err = mkdir_parents(filename, 0755);
                         if (err != 0 && err != -ENOENT)
                                 break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd >= 0)
-                                close(fd);
-                        else
+                        unlink(filename_tmp);
+                        if (symlink(data, filename_tmp) < 0 || rename(filename_tmp, filename) < 0) {
                                 err = -errno;
+                                unlink(filename_tmp);
+                        } else
+                                err = 0;
                 } while (err == -ENOENT);
         }
 }
@@ -35,9 +35,25 @@
 #include "strbuf.h"
 #include "strv.h"
 #include "util.h"
+#include "hashmap.h"
 
 #define PREALLOC_TOKEN          2048
 
+/* match keys which are used to skip rules that cannot match an event */
+enum rule_index_key {
+        RULE_INDEX_ACTION,
+        RULE_INDEX_SUBSYSTEM,
+        RULE_INDEX_DRIVER,
+        RULE_INDEX_KERNEL,
+        _RULE_INDEX_MAX,
+};
+
+/* bitmap of the rules which can match a given value of an indexed key */
+struct rule_index_value {
+        char *value;
+        uint64_t rules[];
+};
+
 struct uid_gid {
         unsigned int name_off;
         union {
@@ -60,6 +76,19 @@ struct udev_rules {
         /* all key strings are copied and de-duplicated in a single continuous string buffer */
         struct strbuf *strbuf;
 
+        /* match keys with alternatives or glob characters are split and pre-parsed into patterns */
+        struct pattern *patterns;
+        unsigned int pattern_cur;
+        unsigned int pattern_max;
+
+        /* token index of every rule, and the rules which are candidates for a given value
+         * of an indexed key; rules which do not check a key are candidates for all values */
+        unsigned int *rule_tokens;
+        unsigned int rule_count;
+        unsigned int rule_words;
+        Hashmap *index[_RULE_INDEX_MAX];
+        uint64_t *index_any[_RULE_INDEX_MAX];
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned int uids_cur;
@@ -168,7 +197,18 @@ enum token_type {
         TK_END,
 };
 
-/* we try to pack stuff in a way that we take only 12 bytes per token */
+/* one alternative of a match key value, the alternatives of a key are stored in a row */
+struct pattern {
+        unsigned int value_off;
+        unsigned short len;
+        unsigned short prefix_len;              /* literal characters before the first glob character */
+        unsigned short suffix_len;              /* literal characters after the last glob character */
+        bool glob:1;                            /* needs fnmatch() */
+        bool star:1;                            /* a single '*' between prefix and suffix */
+        bool last:1;
+};
+
+/* we try to pack stuff in a way that we take only 16 bytes per token */
 struct token {
         union {
                 unsigned char type;                /* same in rule and key */
@@ -200,6 +240,7 @@ struct token {
                                 int watch;
                                 enum udev_builtin_cmd builtin_cmd;
                         };
+                        unsigned int pattern;
                 } key;
         };
 };
@@ -464,6 +505,70 @@ static int add_token(struct udev_rules *rules, struct token *token)
         return 0;
 }
 
+static int add_pattern(struct udev_rules *rules, const char *value, size_t len, bool last)
+{
+        struct pattern *pattern;
+        char *s;
+        size_t i;
+
+        /* grow buffer if needed */
+        if (rules->pattern_cur+1 >= rules->pattern_max) {
+                struct pattern *patterns;
+                unsigned int add;
+
+                /* double the buffer size */
+                add = rules->pattern_max;
+                if (add < 8)
+                        add = 8;
+
+                patterns = realloc(rules->patterns, (rules->pattern_max + add ) * sizeof(struct pattern));
+                if (patterns == NULL)
+                        return -1;
+                rules->patterns = patterns;
+                rules->pattern_max += add;
+        }
+
+        s = strndupa(value, len);
+        pattern = &rules->patterns[rules->pattern_cur];
+        memset(pattern, 0x00, sizeof(struct pattern));
+        pattern->value_off = strbuf_add_string(rules->strbuf, s, len);
+        pattern->len = len;
+        pattern->last = last;
+
+        /* everything fnmatch() treats specially, the rest is compared verbatim */
+        pattern->prefix_len = strcspn(s, "*?[]\\");
+        if (pattern->prefix_len < len) {
+                pattern->glob = true;
+                for (i = len; i > 0 && !strchr("*?[]\\", s[i-1]); i--)
+                        pattern->suffix_len++;
+                pattern->star = (len == pattern->prefix_len + pattern->suffix_len + 1U && s[pattern->prefix_len] == '*');
+        }
+
+        rules->pattern_cur++;
+        return 0;
+}
+
+/* split the alternatives of a match key value, returns the index of the first one */
+static int add_patterns(struct udev_rules *rules, const char *value)
+{
+        unsigned int first = rules->pattern_cur;
+
+        for (;;) {
+                const char *next;
+
+                next = strchr(value, '|');
+                if (next == NULL)
+                        break;
+                if (add_pattern(rules, value, next - value, false) < 0)
+                        return -1;
+                value = &next[1];
+        }
+        if (add_pattern(rules, value, strlen(value), true) < 0)
+                return -1;
+
+        return first;
+}
+
 static uid_t add_uid(struct udev_rules *rules, const char *owner)
 {
         unsigned int i;
@@ -975,6 +1080,17 @@ static int rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
                         glob = GL_PLAIN;
                 }
                 token->key.glob = glob;
+
+                if (glob == GL_GLOB || glob == GL_SPLIT || glob == GL_SPLIT_GLOB) {
+                        int pattern;
+
+                        pattern = add_patterns(rule_tmp->rules, value);
+                        if (pattern < 0) {
+                                log_error("unable to store match patterns\n");
+                                return -1;
+                        }
+                        token->key.pattern = pattern;
+                }
         }
 
         if (value != NULL && type > TK_M_MAX) {
@@ -1604,6 +1720,223 @@ static int parse_file(struct udev_rules *rules, const char *filename)
         return 0;
 }
 
+static int rule_index_key_from_token(enum token_type type)
+{
+        switch (type) {
+        case TK_M_ACTION:
+                return RULE_INDEX_ACTION;
+        case TK_M_SUBSYSTEM:
+                return RULE_INDEX_SUBSYSTEM;
+        case TK_M_DRIVER:
+                return RULE_INDEX_DRIVER;
+        case TK_M_KERNEL:
+                return RULE_INDEX_KERNEL;
+        default:
+                return -1;
+        }
+}
+
+/* KERNEL is indexed by the first character only, most matches are globs like "sd*" */
+static bool rule_index_kernel_prefix(const char *value, size_t len, char *prefix)
+{
+        if (len == 0 || strchr("*?[", value[0]))
+                return false;
+        prefix[0] = value[0];
+        prefix[1] = '\0';
+        return true;
+}
+
+static int rule_index_add(struct udev_rules *rules, enum rule_index_key key, const char *value, unsigned int rule)
+{
+        struct rule_index_value *v;
+        int r;
+
+        v = hashmap_get(rules->index[key], value);
+        if (v == NULL) {
+                r = hashmap_ensure_allocated(&rules->index[key], string_hash_func, string_compare_func);
+                if (r < 0)
+                        return r;
+
+                v = calloc(1, offsetof(struct rule_index_value, rules) + rules->rule_words * sizeof(uint64_t));
+                if (v == NULL)
+                        return -ENOMEM;
+                v->value = strdup(value);
+                if (v->value == NULL) {
+                        free(v);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(rules->index[key], v->value, v);
+                if (r < 0) {
+                        free(v->value);
+                        free(v);
+                        return r;
+                }
+        }
+
+        v->rules[rule / 64] |= UINT64_C(1) << (rule % 64);
+        return 0;
+}
+
+/* record the values the first usable ACTION, SUBSYSTEM, DRIVER, KERNEL match of a rule can match */
+static int rule_index_add_token(struct udev_rules *rules, enum rule_index_key key, struct token *token, unsigned int rule)
+{
+        const char *value = rules_str(rules, token->key.value_off);
+        const char *s;
+        char prefix[2];
+        int r;
+
+        if (token->key.op != OP_MATCH)
+                return 0;
+
+        switch (token->key.glob) {
+        case GL_PLAIN:
+                if (key == RULE_INDEX_KERNEL) {
+                        if (!rule_index_kernel_prefix(value, strlen(value), prefix))
+                                return 0;
+                        value = prefix;
+                }
+                r = rule_index_add(rules, key, value, rule);
+                if (r < 0)
+                        return r;
+                return 1;
+        case GL_GLOB:
+                if (key != RULE_INDEX_KERNEL)
+                        return 0;
+                if (!rule_index_kernel_prefix(value, strlen(value), prefix))
+                        return 0;
+                r = rule_index_add(rules, key, prefix, rule);
+                if (r < 0)
+                        return r;
+                return 1;
+        case GL_SPLIT:
+        case GL_SPLIT_GLOB:
+                if (token->key.glob == GL_SPLIT_GLOB && key != RULE_INDEX_KERNEL)
+                        return 0;
+
+                /* all alternatives need to be indexable */
+                for (s = value;;) {
+                        size_t len = strcspn(s, "|");
+
+                        if (key == RULE_INDEX_KERNEL && !rule_index_kernel_prefix(s, len, prefix))
+                                return 0;
+                        if (s[len] == '\0')
+                                break;
+                        s += len + 1;
+                }
+
+                for (s = value;;) {
+                        size_t len = strcspn(s, "|");
+                        char *alt;
+
+                        if (key == RULE_INDEX_KERNEL) {
+                                rule_index_kernel_prefix(s, len, prefix);
+                                r = rule_index_add(rules, key, prefix, rule);
+                        } else {
+                                alt = strndup(s, len);
+                                if (alt == NULL)
+                                        return -ENOMEM;
+                                r = rule_index_add(rules, key, alt, rule);
+                                free(alt);
+                        }
+                        if (r < 0)
+                                return r;
+                        if (s[len] == '\0')
+                                break;
+                        s += len + 1;
+                }
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+static void rules_free_index(struct udev_rules *rules)
+{
+        unsigned int i;
+
+        for (i = 0; i < _RULE_INDEX_MAX; i++) {
+                struct rule_index_value *v;
+
+                while ((v = hashmap_steal_first(rules->index[i]))) {
+                        free(v->value);
+                        free(v);
+                }
+                hashmap_free(rules->index[i]);
+                rules->index[i] = NULL;
+
+                free(rules->index_any[i]);
+                rules->index_any[i] = NULL;
+        }
+
+        free(rules->rule_tokens);
+        rules->rule_tokens = NULL;
+        rules->rule_count = 0;
+        rules->rule_words = 0;
+}
+
+static int rules_build_index(struct udev_rules *rules)
+{
+        unsigned int i, rule;
+        int r;
+
+        for (i = 0; i < rules->token_cur; i++)
+                if (rules->tokens[i].type == TK_RULE)
+                        rules->rule_count++;
+        if (rules->rule_count == 0)
+                return 0;
+
+        rules->rule_words = (rules->rule_count + 63) / 64;
+        rules->rule_tokens = new(unsigned int, rules->rule_count);
+        if (rules->rule_tokens == NULL)
+                return -ENOMEM;
+
+        for (i = 0; i < _RULE_INDEX_MAX; i++) {
+                rules->index_any[i] = new0(uint64_t, rules->rule_words);
+                if (rules->index_any[i] == NULL)
+                        return -ENOMEM;
+        }
+
+        for (i = 0, rule = 0; i < rules->token_cur; i++) {
+                struct token *token = &rules->tokens[i];
+                bool indexed[_RULE_INDEX_MAX] = {};
+                unsigned int j;
+
+                if (token->type != TK_RULE)
+                        continue;
+
+                rules->rule_tokens[rule] = i;
+
+                for (j = 1; j < token->rule.token_count; j++) {
+                        int key;
+
+                        key = rule_index_key_from_token(token[j].type);
+                        if (key < 0 || indexed[key])
+                                continue;
+
+                        r = rule_index_add_token(rules, key, &token[j], rule);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                indexed[key] = true;
+                }
+
+                for (j = 0; j < _RULE_INDEX_MAX; j++)
+                        if (!indexed[j])
+                                rules->index_any[j][rule / 64] |= UINT64_C(1) << (rule % 64);
+
+                rule++;
+        }
+
+        log_debug("rules index: %u rules, %u action, %u subsystem, %u driver, %u kernel values\n",
+                  rules->rule_count,
+                  hashmap_size(rules->index[RULE_INDEX_ACTION]),
+                  hashmap_size(rules->index[RULE_INDEX_SUBSYSTEM]),
+                  hashmap_size(rules->index[RULE_INDEX_DRIVER]),
+                  hashmap_size(rules->index[RULE_INDEX_KERNEL]));
+        return 0;
+}
+
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
 {
         struct udev_rules *rules;
@@ -1675,6 +2008,13 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
                   rules->strbuf->dedup_count, rules->strbuf->dedup_len, rules->strbuf->nodes_count);
         strbuf_complete(rules->strbuf);
 
+        /* without an index, all rules are evaluated */
+        r = rules_build_index(rules);
+        if (r < 0) {
+                log_error("failed to build rules index: %s\n", strerror(-r));
+                rules_free_index(rules);
+        }
+
         /* cleanup uid/gid cache */
         free(rules->uids);
         rules->uids = NULL;
@@ -1694,6 +2034,8 @@ struct udev_rules *udev_rules_unref(struct udev_rules *rules)
         if (rules == NULL)
                 return NULL;
         free(rules->tokens);
+        free(rules->patterns);
+        rules_free_index(rules);
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
@@ -1710,10 +2052,29 @@ bool udev_rules_check_timestamp(struct udev_rules *rules)
         return paths_check_timestamp(rules->dirs, &rules->dirs_ts_usec, true);
 }
 
+static bool match_pattern(struct udev_rules *rules, const struct pattern *pattern, const char *val, size_t len)
+{
+        const char *s = rules_str(rules, pattern->value_off);
+
+        if (!pattern->glob)
+                return len == pattern->len && memcmp(s, val, len) == 0;
+
+        /* the literal parts around the glob need to match verbatim */
+        if (len < pattern->prefix_len + pattern->suffix_len)
+                return false;
+        if (memcmp(s, val, pattern->prefix_len) != 0)
+                return false;
+        if (memcmp(s + pattern->len - pattern->suffix_len, val + len - pattern->suffix_len, pattern->suffix_len) != 0)
+                return false;
+        if (pattern->star)
+                return true;
+
+        return fnmatch(s + pattern->prefix_len, val + pattern->prefix_len, 0) == 0;
+}
+
 static int match_key(struct udev_rules *rules, struct token *token, const char *val)
 {
         char *key_value = rules_str(rules, token->key.value_off);
-        char *pos;
         bool match = false;
 
         if (val == NULL)
@@ -1724,49 +2085,16 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
                 match = (streq(key_value, val));
                 break;
         case GL_GLOB:
-                match = (fnmatch(key_value, val, 0) == 0);
-                break;
         case GL_SPLIT:
-                {
-                        const char *s;
-                        size_t len;
-
-                        s = rules_str(rules, token->key.value_off);
-                        len = strlen(val);
-                        for (;;) {
-                                const char *next;
-
-                                next = strchr(s, '|');
-                                if (next != NULL) {
-                                        size_t matchlen = (size_t)(next - s);
-
-                                        match = (matchlen == len && strneq(s, val, matchlen));
-                                        if (match)
-                                                break;
-                                } else {
-                                        match = (streq(s, val));
-                                        break;
-                                }
-                                s = &next[1];
-                        }
-                        break;
-                }
         case GL_SPLIT_GLOB:
                 {
-                        char value[UTIL_PATH_SIZE];
+                        const struct pattern *pattern;
+                        size_t len = strlen(val);
 
-                        strscpy(value, sizeof(value), rules_str(rules, token->key.value_off));
-                        key_value = value;
-                        while (key_value != NULL) {
-                                pos = strchr(key_value, '|');
-                                if (pos != NULL) {
-                                        pos[0] = '\0';
-                                        pos = &pos[1];
-                                }
-                                match = (fnmatch(key_value, val, 0) == 0);
-                                if (match)
+                        for (pattern = &rules->patterns[token->key.pattern];; pattern++) {
+                                match = match_pattern(rules, pattern, val, len);
+                                if (match || pattern->last)
                                         break;
-                                key_value = pos;
                         }
                         break;
                 }
@@ -1833,6 +2161,83 @@ static int match_attr(struct udev_rules *rules, struct udev_device *dev, struct
         return match_key(rules, cur, value);
 }
 
+/* bitmap of the rules which can possibly match the event, NULL if all rules need to be checked */
+static uint64_t *rules_get_candidates(struct udev_rules *rules, struct udev_device *dev)
+{
+        const char *values[_RULE_INDEX_MAX];
+        const char *sysname;
+        char prefix[2] = {};
+        uint64_t *candidates;
+        unsigned int i, w;
+
+        if (rules->rule_tokens == NULL)
+                return NULL;
+
+        values[RULE_INDEX_ACTION] = udev_device_get_action(dev);
+        values[RULE_INDEX_SUBSYSTEM] = udev_device_get_subsystem(dev);
+        values[RULE_INDEX_DRIVER] = udev_device_get_driver(dev);
+        sysname = udev_device_get_sysname(dev);
+        if (sysname != NULL)
+                prefix[0] = sysname[0];
+        values[RULE_INDEX_KERNEL] = prefix;
+
+        candidates = new(uint64_t, rules->rule_words);
+        if (candidates == NULL)
+                return NULL;
+        memset(candidates, 0xff, rules->rule_words * sizeof(uint64_t));
+
+        for (i = 0; i < _RULE_INDEX_MAX; i++) {
+                struct rule_index_value *v;
+
+                v = hashmap_get(rules->index[i], values[i] ? values[i] : "");
+                for (w = 0; w < rules->rule_words; w++)
+                        candidates[w] &= rules->index_any[i][w] | (v ? v->rules[w] : 0);
+        }
+
+        return candidates;
+}
+
+/* find the rule number of the rule token, the next rule is usually the one following the last one */
+static unsigned int rules_find_rule(struct udev_rules *rules, unsigned int token, unsigned int hint)
+{
+        unsigned int lo = 0, hi = rules->rule_count;
+
+        if (hint < rules->rule_count && rules->rule_tokens[hint] == token)
+                return hint;
+
+        while (lo < hi) {
+                unsigned int mid = (lo + hi) / 2;
+
+                if (rules->rule_tokens[mid] < token)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        assert(lo < rules->rule_count && rules->rule_tokens[lo] == token);
+        return lo;
+}
+
+/* first candidate rule at or after the given rule number */
+static unsigned int rules_next_candidate(struct udev_rules *rules, const uint64_t *candidates, unsigned int rule)
+{
+        unsigned int w = rule / 64;
+        uint64_t bits;
+
+        if (rule >= rules->rule_count)
+                return rules->rule_count;
+
+        bits = candidates[w] & (~UINT64_C(0) << (rule % 64));
+        while (bits == 0) {
+                if (++w >= rules->rule_words)
+                        return rules->rule_count;
+                bits = candidates[w];
+        }
+
+        rule = w * 64 + __builtin_ctzll(bits);
+        return MIN(rule, rules->rule_count);
+}
+
 enum escape_type {
         ESCAPE_UNSET,
         ESCAPE_NONE,
@@ -1845,6 +2250,8 @@ int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event
         struct token *rule;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
+        _cleanup_free_ uint64_t *candidates = NULL;
+        unsigned int rule_nr = 0;
 
         if (rules->tokens == NULL)
                 return -1;
@@ -1853,6 +2260,8 @@ int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
 
+        candidates = rules_get_candidates(rules, event->dev);
+
         /* loop through token list, match, run actions or forward to next rule */
         cur = &rules->tokens[0];
         rule = cur;
@@ -1862,6 +2271,22 @@ int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event
                 case TK_RULE:
                         /* current rule */
                         rule = cur;
+                        /* skip all rules which cannot match ACTION, SUBSYSTEM, DRIVER, KERNEL */
+                        if (candidates != NULL) {
+                                unsigned int next;
+
+                                rule_nr = rules_find_rule(rules, cur - rules->tokens, rule_nr);
+                                next = rules_next_candidate(rules, candidates, rule_nr);
+                                if (next != rule_nr) {
+                                        if (next >= rules->rule_count)
+                                                cur = &rules->tokens[rules->token_cur-1];
+                                        else
+                                                cur = &rules->tokens[rules->rule_tokens[next]];
+                                        rule_nr = next;
+                                        continue;
+                                }
+                                rule_nr++;
+                        }
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
                         if (!can_set_name && rule->rule.can_set_name)
                                 goto nomatch;
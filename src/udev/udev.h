@@ -119,10 +119,13 @@ int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout);
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout);
+int udev_ctrl_send_settle(struct udev_ctrl *uctrl, const char *subsystem,
+                          unsigned long long int seqnum_start, unsigned long long int seqnum_end, int timeout);
 struct udev_ctrl_connection;
 struct udev_ctrl_connection *udev_ctrl_get_connection(struct udev_ctrl *uctrl);
 struct udev_ctrl_connection *udev_ctrl_connection_ref(struct udev_ctrl_connection *conn);
 struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connection *conn);
+int udev_ctrl_connection_send_settled(struct udev_ctrl_connection *conn);
 struct udev_ctrl_msg;
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn);
 struct udev_ctrl_msg *udev_ctrl_msg_unref(struct udev_ctrl_msg *ctrl_msg);
@@ -134,6 +137,17 @@ int udev_ctrl_get_ping(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg);
 const char *udev_ctrl_get_set_env(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_set_children_max(struct udev_ctrl_msg *ctrl_msg);
+int udev_ctrl_get_settle(struct udev_ctrl_msg *ctrl_msg, const char **subsystem,
+                         unsigned long long int *seqnum_start, unsigned long long int *seqnum_end);
+
+/* udev-event-index.c */
+struct udev_event_index;
+struct udev_event_index_entry;
+struct udev_event_index *udev_event_index_new(void);
+void udev_event_index_free(struct udev_event_index *index);
+int udev_event_index_add(struct udev_event_index *index, struct udev_device *dev, struct udev_event_index_entry **ret);
+void udev_event_index_remove(struct udev_event_index *index, struct udev_event_index_entry *entry);
+bool udev_event_index_is_busy(struct udev_event_index *index, struct udev_event_index_entry *entry);
 
 /* built-in commands */
 enum udev_builtin_cmd {
@@ -170,6 +184,7 @@ struct udev_builtin {
 };
 #ifdef HAVE_BLKID
 extern const struct udev_builtin udev_builtin_blkid;
+void udev_builtin_blkid_cache_invalidate(struct udev_device *dev);
 #endif
 extern const struct udev_builtin udev_builtin_btrfs;
 #ifdef HAVE_FIRMWARE
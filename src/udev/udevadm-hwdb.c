@@ -62,6 +62,9 @@ struct trie_node {
         /* sorted array of key/value pairs */
         struct trie_value_entry *values;
         size_t values_count;
+
+        /* offset of the on-disk node, assigned before the nodes are written */
+        uint64_t off;
 };
 
 /* children array item with char (0-255) index */
@@ -262,12 +265,19 @@ struct trie_f {
         FILE *f;
         struct trie *trie;
         uint64_t strings_off;
+        uint64_t nodes_off;
 
         uint64_t nodes_count;
         uint64_t children_count;
         uint64_t values_count;
 };
 
+static uint64_t trie_node_f_size(const struct trie_node *node) {
+        return sizeof(struct trie_node_f) +
+               node->children_count * sizeof(struct trie_child_entry_f) +
+               node->values_count * sizeof(struct trie_value_entry_f);
+}
+
 /* calculate the storage space for the nodes, children arrays, value arrays */
 static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
         uint64_t i;
@@ -275,52 +285,51 @@ static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
         for (i = 0; i < node->children_count; i++)
                 trie_store_nodes_size(trie, node->children[i].child);
 
-        trie->strings_off += sizeof(struct trie_node_f);
+        trie->strings_off += trie_node_f_size(node);
+}
+
+/*
+ * Assign the offsets of the nodes. All children of a node are stored
+ * next to each other, followed by the children of its first child, so
+ * a lookup finds the child it descends to close to the node it comes
+ * from, and chains of single children are stored in a row.
+ */
+static void trie_store_nodes_layout(struct trie_f *trie, struct trie_node *node) {
+        uint64_t i;
+
+        for (i = 0; i < node->children_count; i++) {
+                node->children[i].child->off = trie->nodes_off;
+                trie->nodes_off += trie_node_f_size(node->children[i].child);
+        }
+
         for (i = 0; i < node->children_count; i++)
-                trie->strings_off += sizeof(struct trie_child_entry_f);
-        for (i = 0; i < node->values_count; i++)
-                trie->strings_off += sizeof(struct trie_value_entry_f);
+                trie_store_nodes_layout(trie, node->children[i].child);
 }
 
-static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
+static int trie_store_node(struct trie_f *trie, struct trie_node *node) {
         uint64_t i;
         struct trie_node_f n = {
                 .prefix_off = htole64(trie->strings_off + node->prefix_off),
                 .children_count = node->children_count,
                 .values_count = htole64(node->values_count),
         };
-        struct trie_child_entry_f *children = NULL;
-        int64_t node_off;
 
-        if (node->children_count) {
-                children = new0(struct trie_child_entry_f, node->children_count);
-                if (!children)
-                        return -ENOMEM;
-        }
-
-        /* post-order recursion */
-        for (i = 0; i < node->children_count; i++) {
-                int64_t child_off;
-
-                child_off = trie_store_nodes(trie, node->children[i].child);
-                if (child_off < 0) {
-                        free(children);
-                        return child_off;
-                }
-                children[i].c = node->children[i].c;
-                children[i].child_off = htole64(child_off);
-        }
+        if ((uint64_t) ftello(trie->f) != node->off)
+                return -EIO;
 
         /* write node */
-        node_off = ftello(trie->f);
         fwrite(&n, sizeof(struct trie_node_f), 1, trie->f);
         trie->nodes_count++;
 
         /* append children array */
-        if (node->children_count) {
-                fwrite(children, sizeof(struct trie_child_entry_f), node->children_count, trie->f);
-                trie->children_count += node->children_count;
-                free(children);
+        for (i = 0; i < node->children_count; i++) {
+                struct trie_child_entry_f c = {
+                        .c = node->children[i].c,
+                        .child_off = htole64(node->children[i].child->off),
+                };
+
+                fwrite(&c, sizeof(struct trie_child_entry_f), 1, trie->f);
+                trie->children_count++;
         }
 
         /* append values array */
@@ -334,7 +343,27 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
                 trie->values_count++;
         }
 
-        return node_off;
+        return 0;
+}
+
+/* write the nodes in the order of their offsets */
+static int trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
+        uint64_t i;
+        int err;
+
+        for (i = 0; i < node->children_count; i++) {
+                err = trie_store_node(trie, node->children[i].child);
+                if (err < 0)
+                        return err;
+        }
+
+        for (i = 0; i < node->children_count; i++) {
+                err = trie_store_nodes(trie, node->children[i].child);
+                if (err < 0)
+                        return err;
+        }
+
+        return 0;
 }
 
 static int trie_store(struct trie *trie, const char *filename) {
@@ -343,7 +372,6 @@ static int trie_store(struct trie *trie, const char *filename) {
         };
         char *filename_tmp;
         int64_t pos;
-        int64_t root_off;
         int64_t size;
         struct trie_header_f h = {
                 .signature = HWDB_SIG,
@@ -359,6 +387,11 @@ static int trie_store(struct trie *trie, const char *filename) {
         t.strings_off = sizeof(struct trie_header_f);
         trie_store_nodes_size(&t, trie->root);
 
+        /* the root node comes first */
+        trie->root->off = sizeof(struct trie_header_f);
+        t.nodes_off = trie->root->off + trie_node_f_size(trie->root);
+        trie_store_nodes_layout(&t, trie->root);
+
         err = fopen_temporary(filename , &t.f, &filename_tmp);
         if (err < 0)
                 return err;
@@ -366,8 +399,15 @@ static int trie_store(struct trie *trie, const char *filename) {
 
         /* write nodes */
         fseeko(t.f, sizeof(struct trie_header_f), SEEK_SET);
-        root_off = trie_store_nodes(&t, trie->root);
-        h.nodes_root_off = htole64(root_off);
+        err = trie_store_node(&t, trie->root);
+        if (err >= 0)
+                err = trie_store_nodes(&t, trie->root);
+        if (err < 0) {
+                fclose(t.f);
+                unlink(filename_tmp);
+                goto out;
+        }
+        h.nodes_root_off = htole64(trie->root->off);
         pos = ftello(t.f);
         h.nodes_len = htole64(pos - sizeof(struct trie_header_f));
 
@@ -251,6 +251,14 @@ static void cleanup_db(struct udev *udev)
                 closedir(dir);
         }
 
+        unlink("/run/udev/subsystem.complete");
+        unlink("/run/udev/subsystem.pending");
+        dir = opendir("/run/udev/subsystem");
+        if (dir != NULL) {
+                cleanup_dir(dir, 0, 2);
+                closedir(dir);
+        }
+
         dir = opendir("/run/udev/static_node-tags");
         if (dir != NULL) {
                 cleanup_dir(dir, 0, 2);
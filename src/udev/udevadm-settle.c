@@ -37,6 +37,21 @@
 #include "udev.h"
 #include "util.h"
 
+static void print_queue(struct udev_queue *udev_queue, unsigned int timeout)
+{
+        struct udev_list_entry *list_entry;
+
+        if (udev_queue_get_queued_list_entry(udev_queue) == NULL)
+                return;
+
+        log_debug("timeout waiting for udev queue\n");
+        printf("\nudevadm settle - timeout of %i seconds reached, the event queue contains:\n", timeout);
+        udev_list_entry_foreach(list_entry, udev_queue_get_queued_list_entry(udev_queue))
+                printf("  %s (%s)\n",
+                udev_list_entry_get_name(list_entry),
+                udev_list_entry_get_value(list_entry));
+}
+
 static int adm_settle(struct udev *udev, int argc, char *argv[])
 {
         static const struct option options[] = {
@@ -44,6 +59,7 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
                 { "seq-end", required_argument, NULL, 'e' },
                 { "timeout", required_argument, NULL, 't' },
                 { "exit-if-exists", required_argument, NULL, 'E' },
+                { "subsystem-match", required_argument, NULL, 'S' },
                 { "quiet", no_argument, NULL, 'q' },
                 { "help", no_argument, NULL, 'h' },
                 {}
@@ -53,6 +69,7 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
         usec_t end = 0;
         int quiet = 0;
         const char *exists = NULL;
+        const char *subsystem = NULL;
         unsigned int timeout = 120;
         struct pollfd pfd[1] = { {.fd = -1}, };
         struct udev_queue *udev_queue = NULL;
@@ -61,7 +78,7 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
         for (;;) {
                 int option;
 
-                option = getopt_long(argc, argv, "s:e:t:E:qh", options, NULL);
+                option = getopt_long(argc, argv, "s:e:t:E:S:qh", options, NULL);
                 if (option == -1) {
                         if (optind < argc) {
                                 fprintf(stderr, "Extraneous argument: '%s'\n", argv[optind]);
@@ -94,12 +111,16 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
                 case 'E':
                         exists = optarg;
                         break;
+                case 'S':
+                        subsystem = optarg;
+                        break;
                 case 'h':
                         printf("Usage: udevadm settle OPTIONS\n"
                                "  --timeout=<seconds>     maximum time to wait for events\n"
                                "  --seq-start=<seqnum>    first seqnum to wait for\n"
                                "  --seq-end=<seqnum>      last seqnum to wait for\n"
                                "  --exit-if-exists=<file> stop waiting if file exists\n"
+                               "  --subsystem-match=<subsystem> wait only for events of a subsystem\n"
                                "  --quiet                 do not print list after timeout\n"
                                "  --help\n\n");
                         exit(EXIT_SUCCESS);
@@ -140,19 +161,42 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
                 }
         }
 
-        /* guarantee that the udev daemon isn't pre-processing */
-        if (getuid() == 0) {
+        /*
+         * Let the daemon answer when the events are handled, without
+         * polling the queue. If we need to check for a file, we only
+         * guarantee that the udev daemon isn't pre-processing. Without
+         * a timeout, we only check the queue once.
+         */
+        if (getuid() == 0 && timeout > 0) {
                 struct udev_ctrl *uctrl;
 
                 uctrl = udev_ctrl_new(udev);
                 if (uctrl != NULL) {
-                        if (udev_ctrl_send_ping(uctrl, timeout) < 0) {
+                        int r;
+
+                        if (exists == NULL)
+                                r = udev_ctrl_send_settle(uctrl, subsystem, start, end, timeout);
+                        else
+                                r = udev_ctrl_send_ping(uctrl, timeout);
+                        udev_ctrl_unref(uctrl);
+
+                        if (r == 0 && exists == NULL) {
+                                rc = EXIT_SUCCESS;
+                                goto out;
+                        }
+
+                        if (r == -ETIMEDOUT && exists == NULL) {
+                                if (!quiet)
+                                        print_queue(udev_queue, timeout);
+                                goto out;
+                        }
+
+                        /* a daemon which does not know the settle message leaves us polling the queue */
+                        if (r < 0 && r != -EOPNOTSUPP) {
                                 log_debug("no connection to daemon\n");
-                                udev_ctrl_unref(uctrl);
                                 rc = EXIT_SUCCESS;
                                 goto out;
                         }
-                        udev_ctrl_unref(uctrl);
                 }
         }
 
@@ -190,6 +234,10 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
                         }
                 }
 
+                /* only check, do not wait */
+                if (timeout == 0)
+                        break;
+
                 if (pfd[0].fd >= 0) {
                         int delay;
 
@@ -212,17 +260,8 @@ static int adm_settle(struct udev *udev, int argc, char *argv[])
 
                         age_usec = now(CLOCK_MONOTONIC) - start_usec;
                         if (age_usec / (1000 * 1000) >= timeout) {
-                                struct udev_list_entry *list_entry;
-
-                                if (!quiet && udev_queue_get_queued_list_entry(udev_queue) != NULL) {
-                                        log_debug("timeout waiting for udev queue\n");
-                                        printf("\nudevadm settle - timeout of %i seconds reached, the event queue contains:\n", timeout);
-                                        udev_list_entry_foreach(list_entry, udev_queue_get_queued_list_entry(udev_queue))
-                                                printf("  %s (%s)\n",
-                                                udev_list_entry_get_name(list_entry),
-                                                udev_list_entry_get_value(list_entry));
-                                }
-
+                                if (!quiet)
+                                        print_queue(udev_queue, timeout);
                                 break;
                         }
                 }
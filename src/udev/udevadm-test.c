@@ -31,23 +31,127 @@
 
 #include "udev.h"
 
-static int adm_test(struct udev *udev, int argc, char *argv[])
+static int test_event(struct udev *udev, struct udev_rules *rules,
+                      const char *action, const char *syspath, bool verbose)
 {
-        int resolve_names = 1;
         char filename[UTIL_PATH_SIZE];
-        const char *action = "add";
-        const char *syspath = NULL;
         struct udev_event *event = NULL;
         struct udev_device *dev = NULL;
-        struct udev_rules *rules = NULL;
         struct udev_list_entry *entry;
         sigset_t mask, sigmask_orig;
         int err;
         int rc = 0;
 
+        sigprocmask(SIG_SETMASK, NULL, &sigmask_orig);
+
+        /* add /sys if needed */
+        if (!startswith(syspath, "/sys"))
+                strscpyl(filename, sizeof(filename), "/sys", syspath, NULL);
+        else
+                strscpy(filename, sizeof(filename), syspath);
+        util_remove_trailing_chars(filename, '/');
+
+        dev = udev_device_new_from_syspath(udev, filename);
+        if (dev == NULL) {
+                fprintf(stderr, "unable to open device '%s'\n", filename);
+                rc = 4;
+                goto out;
+        }
+
+        /* skip reading of db, but read kernel parameters */
+        udev_device_set_info_loaded(dev);
+        udev_device_read_uevent_file(dev);
+
+        udev_device_set_action(dev, action);
+        event = udev_event_new(dev);
+
+        sigfillset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, &sigmask_orig);
+        event->fd_signal = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+        if (event->fd_signal < 0) {
+                fprintf(stderr, "error creating signalfd\n");
+                rc = 5;
+                goto out;
+        }
+
+        err = udev_event_execute_rules(event, rules, &sigmask_orig);
+
+        if (verbose) {
+                udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(dev))
+                        printf("%s=%s\n", udev_list_entry_get_name(entry), udev_list_entry_get_value(entry));
+
+                if (err == 0) {
+                        udev_list_entry_foreach(entry, udev_list_get_entry(&event->run_list)) {
+                                char program[UTIL_PATH_SIZE];
+
+                                udev_event_apply_format(event, udev_list_entry_get_name(entry), program, sizeof(program));
+                                printf("run: '%s'\n", program);
+                        }
+                }
+        }
+out:
+        if (event != NULL && event->fd_signal >= 0)
+                close(event->fd_signal);
+        udev_event_unref(event);
+        udev_device_unref(dev);
+        sigprocmask(SIG_SETMASK, &sigmask_orig, NULL);
+        return rc;
+}
+
+/* run recorded events, one "<action> <devpath>" per line, through the rules */
+static int replay_events(struct udev *udev, struct udev_rules *rules, const char *replay)
+{
+        _cleanup_fclose_ FILE *f = NULL;
+        char line[UTIL_LINE_SIZE];
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned int n = 0;
+        usec_t t;
+
+        f = fopen(replay, "re");
+        if (f == NULL) {
+                fprintf(stderr, "unable to open '%s': %m\n", replay);
+                return 2;
+        }
+
+        t = now(CLOCK_MONOTONIC);
+        while (fgets(line, sizeof(line), f) != NULL) {
+                char *action, *devpath;
+
+                action = line + strspn(line, WHITESPACE);
+                if (action[0] == '\0' || action[0] == '#')
+                        continue;
+                devpath = action + strcspn(action, WHITESPACE);
+                if (devpath[0] == '\0')
+                        continue;
+                devpath[0] = '\0';
+                devpath++;
+                devpath += strspn(devpath, WHITESPACE);
+                devpath[strcspn(devpath, WHITESPACE)] = '\0';
+
+                if (test_event(udev, rules, action, devpath, false) == 0)
+                        n++;
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        printf("%u events in %s, %llu usec per event\n",
+               n, format_timespan(ts, sizeof(ts), t, 0),
+               n > 0 ? (unsigned long long) (t / n) : 0ULL);
+        return 0;
+}
+
+static int adm_test(struct udev *udev, int argc, char *argv[])
+{
+        int resolve_names = 1;
+        const char *action = "add";
+        const char *syspath = NULL;
+        const char *replay = NULL;
+        struct udev_rules *rules = NULL;
+        int rc = 0;
+
         static const struct option options[] = {
                 { "action", required_argument, NULL, 'a' },
                 { "resolve-names", required_argument, NULL, 'N' },
+                { "replay", required_argument, NULL, 'r' },
                 { "help", no_argument, NULL, 'h' },
                 {}
         };
@@ -57,7 +161,7 @@ static int adm_test(struct udev *udev, int argc, char *argv[])
         for (;;) {
                 int option;
 
-                option = getopt_long(argc, argv, "a:s:N:fh", options, NULL);
+                option = getopt_long(argc, argv, "a:s:N:r:fh", options, NULL);
                 if (option == -1)
                         break;
 
@@ -78,9 +182,13 @@ static int adm_test(struct udev *udev, int argc, char *argv[])
                                 exit(EXIT_FAILURE);
                         }
                         break;
+                case 'r':
+                        replay = optarg;
+                        break;
                 case 'h':
                         printf("Usage: udevadm test OPTIONS <syspath>\n"
                                "  --action=<string>     set action string\n"
+                               "  --replay=<file>       run the events listed in the file\n"
                                "  --help\n\n");
                         exit(EXIT_SUCCESS);
                 default:
@@ -89,7 +197,7 @@ static int adm_test(struct udev *udev, int argc, char *argv[])
         }
         syspath = argv[optind];
 
-        if (syspath == NULL) {
+        if (syspath == NULL && replay == NULL) {
                 fprintf(stderr, "syspath parameter missing\n");
                 rc = 2;
                 goto out;
@@ -100,8 +208,6 @@ static int adm_test(struct udev *udev, int argc, char *argv[])
                "some values may be different, or not available at a simulation run.\n"
                "\n");
 
-        sigprocmask(SIG_SETMASK, NULL, &sigmask_orig);
-
         udev_builtin_init(udev);
 
         rules = udev_rules_new(udev, resolve_names);
@@ -111,54 +217,11 @@ static int adm_test(struct udev *udev, int argc, char *argv[])
                 goto out;
         }
 
-        /* add /sys if needed */
-        if (!startswith(syspath, "/sys"))
-                strscpyl(filename, sizeof(filename), "/sys", syspath, NULL);
+        if (replay != NULL)
+                rc = replay_events(udev, rules, replay);
         else
-                strscpy(filename, sizeof(filename), syspath);
-        util_remove_trailing_chars(filename, '/');
-
-        dev = udev_device_new_from_syspath(udev, filename);
-        if (dev == NULL) {
-                fprintf(stderr, "unable to open device '%s'\n", filename);
-                rc = 4;
-                goto out;
-        }
-
-        /* skip reading of db, but read kernel parameters */
-        udev_device_set_info_loaded(dev);
-        udev_device_read_uevent_file(dev);
-
-        udev_device_set_action(dev, action);
-        event = udev_event_new(dev);
-
-        sigfillset(&mask);
-        sigprocmask(SIG_SETMASK, &mask, &sigmask_orig);
-        event->fd_signal = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
-        if (event->fd_signal < 0) {
-                fprintf(stderr, "error creating signalfd\n");
-                rc = 5;
-                goto out;
-        }
-
-        err = udev_event_execute_rules(event, rules, &sigmask_orig);
-
-        udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(dev))
-                printf("%s=%s\n", udev_list_entry_get_name(entry), udev_list_entry_get_value(entry));
-
-        if (err == 0) {
-                udev_list_entry_foreach(entry, udev_list_get_entry(&event->run_list)) {
-                        char program[UTIL_PATH_SIZE];
-
-                        udev_event_apply_format(event, udev_list_entry_get_name(entry), program, sizeof(program));
-                        printf("run: '%s'\n", program);
-                }
-        }
+                rc = test_event(udev, rules, action, syspath, true);
 out:
-        if (event != NULL && event->fd_signal >= 0)
-                close(event->fd_signal);
-        udev_event_unref(event);
-        udev_device_unref(dev);
         udev_rules_unref(rules);
         udev_builtin_exit(udev);
         return rc;
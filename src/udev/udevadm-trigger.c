@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <syslog.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -33,30 +34,276 @@
 
 #include "udev.h"
 #include "util.h"
+#include "hashmap.h"
 
 static int verbose;
 static int dry_run;
+static unsigned int jobs = 1;
+static unsigned int rate;
+static usec_t rate_start_usec;
+static unsigned long rate_count;
+
+static void trigger_device(const char *syspath, const char *action)
+{
+        char filename[UTIL_PATH_SIZE];
+        int fd;
+
+        /* spread the events evenly, to not flood the event queue */
+        if (rate > 0) {
+                unsigned long n = __sync_fetch_and_add(&rate_count, 1);
+                usec_t when = rate_start_usec + n * USEC_PER_SEC / rate;
+                usec_t t = now(CLOCK_MONOTONIC);
+
+                if (when > t)
+                        usleep(when - t);
+        }
+
+        if (verbose)
+                printf("%s\n", syspath);
+        if (dry_run)
+                return;
+        strscpyl(filename, sizeof(filename), syspath, "/uevent", NULL);
+        fd = open(filename, O_WRONLY|O_CLOEXEC);
+        if (fd < 0)
+                return;
+        if (write(fd, action, strlen(action)) < 0)
+                log_debug("error writing '%s' to '%s': %m\n", action, filename);
+        close(fd);
+}
+
+struct trigger_entry {
+        const char *syspath;
+        unsigned int level;
+        unsigned int idx;
+};
+
+struct trigger_queue {
+        struct trigger_entry *entries;
+        unsigned int count;
+        unsigned int next;
+        const char *action;
+};
+
+static int trigger_entry_compare(const void *a, const void *b)
+{
+        const struct trigger_entry *x = a, *y = b;
+
+        if (x->level != y->level)
+                return x->level < y->level ? -1 : 1;
+        return x->idx < y->idx ? -1 : 1;
+}
+
+/*
+ * Devices are triggered in parallel in levels. A device gets a higher
+ * level than every device listed before it which is a parent or a child
+ * of it, so the order the enumeration decided for related devices is
+ * kept, while unrelated devices are triggered at the same time.
+ *
+ * The enumeration also orders devices which don't share a path: md and
+ * dm devices are moved to the end, after the disks they are built
+ * from, so each of them gets a level of its own after all others. The
+ * control device of a sound card is moved after all other devices of
+ * the card, so it gets a higher level than all of them.
+ */
+static int assign_levels(struct trigger_entry *entries, unsigned int count)
+{
+        Hashmap *levels, *below;
+        unsigned int i, max_level = 0, barrier = 0;
+        int r = 0;
+
+        levels = hashmap_new(string_hash_func, string_compare_func);
+        below = hashmap_new(string_hash_func, string_compare_func);
+        if (levels == NULL || below == NULL) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        for (i = 0; i < count; i++) {
+                char path[UTIL_PATH_SIZE];
+                unsigned int level;
+                char *pos;
+
+                strscpy(path, sizeof(path), entries[i].syspath);
+
+                /* levels are stored incremented by one, to not store NULL */
+                level = PTR_TO_UINT(hashmap_get(below, path));
+                for (pos = strrchr(path, '/'); pos != NULL && pos != path; pos = strrchr(path, '/')) {
+                        pos[0] = '\0';
+                        level = MAX(level, PTR_TO_UINT(hashmap_get(levels, path)));
+                }
+
+                level = MAX(level, barrier);
+
+                if (udev_enumerate_delay_end(entries[i].syspath)) {
+                        if (i > 0)
+                                level = MAX(level, max_level + 1);
+                        barrier = level + 1;
+                } else {
+                        size_t prefix = udev_enumerate_delay_later(entries[i].syspath);
+
+                        if (prefix > 0) {
+                                unsigned int j;
+
+                                for (j = 0; j < i; j++)
+                                        if (strneq(entries[j].syspath, entries[i].syspath, prefix))
+                                                level = MAX(level, entries[j].level + 1);
+                        }
+                }
+
+                max_level = MAX(max_level, level);
+                entries[i].level = level;
+                entries[i].idx = i;
+                r = hashmap_replace(levels, (char *) entries[i].syspath, UINT_TO_PTR(level + 1));
+                if (r < 0)
+                        goto finish;
+
+                strscpy(path, sizeof(path), entries[i].syspath);
+                for (pos = strrchr(path, '/'); pos != NULL && pos != path; pos = strrchr(path, '/')) {
+                        void *key;
+                        char *k;
+
+                        pos[0] = '\0';
+                        if (hashmap_get2(below, path, &key) != NULL) {
+                                if (PTR_TO_UINT(hashmap_get(below, path)) <= level)
+                                        hashmap_update(below, key, UINT_TO_PTR(level + 1));
+                                continue;
+                        }
+
+                        k = strdup(path);
+                        if (k == NULL) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+                        r = hashmap_put(below, k, UINT_TO_PTR(level + 1));
+                        if (r < 0) {
+                                free(k);
+                                goto finish;
+                        }
+                }
+        }
+
+        qsort(entries, count, sizeof(struct trigger_entry), trigger_entry_compare);
+        r = 0;
+finish:
+        hashmap_free(levels);
+        if (below != NULL) {
+                char *key;
+
+                while ((key = hashmap_steal_first_key(below)))
+                        free(key);
+                hashmap_free(below);
+        }
+        return r;
+}
+
+static void *trigger_thread(void *p)
+{
+        struct trigger_queue *queue = p;
+
+        for (;;) {
+                unsigned int i = __sync_fetch_and_add(&queue->next, 1);
+
+                if (i >= queue->count)
+                        break;
+                trigger_device(queue->entries[i].syspath, queue->action);
+        }
+
+        return NULL;
+}
+
+static int exec_list_parallel(struct udev_enumerate *udev_enumerate, const char *action)
+{
+        struct udev_list_entry *entry;
+        _cleanup_free_ struct trigger_entry *entries = NULL;
+        _cleanup_free_ pthread_t *threads = NULL;
+        unsigned int count = 0, start, end;
+        int r;
+
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate))
+                count++;
+        if (count == 0)
+                return 0;
+
+        entries = new(struct trigger_entry, count);
+        threads = new(pthread_t, jobs);
+        if (entries == NULL || threads == NULL)
+                return -ENOMEM;
+
+        count = 0;
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate))
+                entries[count++].syspath = udev_list_entry_get_name(entry);
+
+        r = assign_levels(entries, count);
+        if (r < 0)
+                return r;
+
+        for (start = 0; start < count; start = end) {
+                struct trigger_queue queue = {
+                        .entries = &entries[start],
+                        .action = action,
+                };
+                unsigned int n, i;
+
+                for (end = start; end < count && entries[end].level == entries[start].level; end++)
+                        ;
+                queue.count = end - start;
+
+                /* the main thread helps, and waits until the level is done */
+                n = 0;
+                while (n + 1 < MIN(jobs, queue.count)) {
+                        r = pthread_create(&threads[n], NULL, trigger_thread, &queue);
+                        if (r != 0)
+                                break;
+                        n++;
+                }
+
+                trigger_thread(&queue);
+
+                for (i = 0; i < n; i++)
+                        pthread_join(threads[i], NULL);
+        }
+
+        return 0;
+}
 
 static void exec_list(struct udev_enumerate *udev_enumerate, const char *action)
 {
         struct udev_list_entry *entry;
 
-        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate)) {
-                char filename[UTIL_PATH_SIZE];
-                int fd;
-
-                if (verbose)
-                        printf("%s\n", udev_list_entry_get_name(entry));
-                if (dry_run)
-                        continue;
-                strscpyl(filename, sizeof(filename), udev_list_entry_get_name(entry), "/uevent", NULL);
-                fd = open(filename, O_WRONLY);
-                if (fd < 0)
-                        continue;
-                if (write(fd, action, strlen(action)) < 0)
-                        log_debug("error writing '%s' to '%s': %m\n", action, filename);
-                close(fd);
+        rate_start_usec = now(CLOCK_MONOTONIC);
+        rate_count = 0;
+
+        if (jobs > 1) {
+                int r;
+
+                r = exec_list_parallel(udev_enumerate, action);
+                if (r >= 0)
+                        return;
+                log_error("unable to trigger in parallel, falling back to one by one: %s\n", strerror(-r));
         }
+
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate))
+                trigger_device(udev_list_entry_get_name(entry), action);
+}
+
+/*
+ * Events for all devices are on their way, udevd will have added every device
+ * to its subsystem index when it has handled them. Let it know, so it can mark
+ * the index as complete as soon as its queue is empty.
+ */
+static void subsystem_index_request(struct udev *udev)
+{
+        struct udev_ctrl *uctrl;
+
+        if (touch("/run/udev/subsystem.pending") < 0)
+                return;
+
+        /* wake up udevd, it checks for the request after every message */
+        uctrl = udev_ctrl_new(udev);
+        if (uctrl == NULL)
+                return;
+        udev_ctrl_send_ping(uctrl, 5);
+        udev_ctrl_unref(uctrl);
 }
 
 static const char *keyval(const char *str, const char **val, char *buf, size_t size)
@@ -88,6 +335,8 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                 { "tag-match", required_argument, NULL, 'g' },
                 { "sysname-match", required_argument, NULL, 'y' },
                 { "parent-match", required_argument, NULL, 'b' },
+                { "jobs", required_argument, NULL, 'j' },
+                { "rate", required_argument, NULL, 'r' },
                 { "help", no_argument, NULL, 'h' },
                 {}
         };
@@ -97,6 +346,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
         } device_type = TYPE_DEVICES;
         const char *action = "change";
         struct udev_enumerate *udev_enumerate;
+        bool filtered = false;
         int rc = 0;
 
         udev_enumerate = udev_enumerate_new(udev);
@@ -111,7 +361,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                 const char *val;
                 char buf[UTIL_PATH_SIZE];
 
-                option = getopt_long(argc, argv, "vng:o:t:hc:p:s:S:a:A:y:b:", options, NULL);
+                option = getopt_long(argc, argv, "vng:o:t:hc:p:s:S:a:A:y:b:j:r:", options, NULL);
                 if (option == -1) {
                         if (optind < argc) {
                                 fprintf(stderr, "Extraneous argument: '%s'\n", argv[optind]);
@@ -149,33 +399,41 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                         }
                         break;
                 case 's':
+                        filtered = true;
                         udev_enumerate_add_match_subsystem(udev_enumerate, optarg);
                         break;
                 case 'S':
+                        filtered = true;
                         udev_enumerate_add_nomatch_subsystem(udev_enumerate, optarg);
                         break;
                 case 'a':
+                        filtered = true;
                         key = keyval(optarg, &val, buf, sizeof(buf));
                         udev_enumerate_add_match_sysattr(udev_enumerate, key, val);
                         break;
                 case 'A':
+                        filtered = true;
                         key = keyval(optarg, &val, buf, sizeof(buf));
                         udev_enumerate_add_nomatch_sysattr(udev_enumerate, key, val);
                         break;
                 case 'p':
+                        filtered = true;
                         key = keyval(optarg, &val, buf, sizeof(buf));
                         udev_enumerate_add_match_property(udev_enumerate, key, val);
                         break;
                 case 'g':
+                        filtered = true;
                         udev_enumerate_add_match_tag(udev_enumerate, optarg);
                         break;
                 case 'y':
+                        filtered = true;
                         udev_enumerate_add_match_sysname(udev_enumerate, optarg);
                         break;
                 case 'b': {
                         char path[UTIL_PATH_SIZE];
                         struct udev_device *dev;
 
+                        filtered = true;
                         /* add sys dir if needed */
                         if (!startswith(optarg, "/sys"))
                                 strscpyl(path, sizeof(path), "/sys", optarg, NULL);
@@ -193,6 +451,20 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                         udev_device_unref(dev);
                         break;
                 }
+                case 'j':
+                        if (safe_atou(optarg, &jobs) < 0 || jobs == 0) {
+                                log_error("invalid number of jobs '%s'\n", optarg);
+                                rc = 2;
+                                goto exit;
+                        }
+                        break;
+                case 'r':
+                        if (safe_atou(optarg, &rate) < 0) {
+                                log_error("invalid rate '%s'\n", optarg);
+                                rc = 2;
+                                goto exit;
+                        }
+                        break;
                 case 'h':
                         printf("Usage: udevadm trigger OPTIONS\n"
                                "  --verbose                       print the list of devices while running\n"
@@ -209,6 +481,8 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                                "  --tag-match=<key>=<value>       trigger devices with a matching property\n"
                                "  --sysname-match=<name>          trigger devices with a matching name\n"
                                "  --parent-match=<name>           trigger devices with that parent device\n"
+                               "  --jobs=<number>                 trigger this many events in parallel\n"
+                               "  --rate=<events per second>      limit the rate of triggered events\n"
                                "  --help\n\n");
                         goto exit;
                 default:
@@ -225,6 +499,8 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
         case TYPE_DEVICES:
                 udev_enumerate_scan_devices(udev_enumerate);
                 exec_list(udev_enumerate, action);
+                if (!filtered && !dry_run && !streq(action, "remove"))
+                        subsystem_index_request(udev);
                 goto exit;
         default:
                 assert_not_reached("device_type");
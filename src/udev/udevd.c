@@ -71,10 +71,15 @@ static bool stop_exec_queue;
 static bool reload;
 static int children;
 static int children_max;
+static int children_preforked;
+static int children_prefork;
 static int exec_delay;
 static sigset_t sigmask_orig;
 static UDEV_LIST(event_list);
+static struct udev_event_index *event_index;
 static UDEV_LIST(worker_list);
+static UDEV_LIST(settle_list);
+static unsigned long long int seqnum_received;
 static char *udev_cgroup;
 static bool udev_exit;
 
@@ -90,17 +95,9 @@ struct event {
         struct udev_device *dev;
         enum event_state state;
         int exitcode;
-        unsigned long long int delaying_seqnum;
         unsigned long long int seqnum;
         const char *devpath;
-        size_t devpath_len;
-        const char *devpath_old;
-        dev_t devnum;
-        int ifindex;
-        bool is_block;
-#ifdef HAVE_FIRMWARE
-        bool nodelay;
-#endif
+        struct udev_event_index_entry *index_entry;
 };
 
 static inline struct event *node_to_event(struct udev_list_node *node)
@@ -109,6 +106,7 @@ static inline struct event *node_to_event(struct udev_list_node *node)
 }
 
 static void event_queue_cleanup(struct udev *udev, enum event_state type);
+static void settle_list_cleanup(void);
 
 enum worker_state {
         WORKER_UNDEF,
@@ -126,6 +124,7 @@ struct worker {
         enum worker_state state;
         struct event *event;
         usec_t event_start_usec;
+        bool preforked;
 };
 
 /* passed from worker to main process */
@@ -139,9 +138,24 @@ static inline struct worker *node_to_worker(struct udev_list_node *node)
         return container_of(node, struct worker, node);
 }
 
+/* client waiting for the events of a range of sequence numbers */
+struct settle {
+        struct udev_list_node node;
+        struct udev_ctrl_connection *conn;
+        char *subsystem;
+        unsigned long long int seqnum_start;
+        unsigned long long int seqnum_end;
+};
+
+static inline struct settle *node_to_settle(struct udev_list_node *node)
+{
+        return container_of(node, struct settle, node);
+}
+
 static void event_queue_delete(struct event *event, bool export)
 {
         udev_list_node_remove(&event->node);
+        udev_event_index_remove(event_index, event->index_entry);
 
         if (export) {
                 udev_queue_export_device_finished(udev_queue_export, event->dev);
@@ -159,6 +173,8 @@ static struct worker *worker_ref(struct worker *worker)
 
 static void worker_cleanup(struct worker *worker)
 {
+        if (worker->preforked)
+                children_preforked--;
         udev_list_node_remove(&worker->node);
         udev_monitor_unref(worker->monitor);
         children--;
@@ -185,9 +201,9 @@ static void worker_list_cleanup(struct udev *udev)
         }
 }
 
-static void worker_new(struct event *event)
+/* start a new worker, without an event it waits idle for the first one */
+static void worker_new(struct udev *udev, struct event *event)
 {
-        struct udev *udev = event->udev;
         struct worker *worker;
         struct udev_monitor *worker_monitor;
         pid_t pid;
@@ -206,7 +222,7 @@ static void worker_new(struct event *event)
                 return;
         }
         /* worker + event reference */
-        worker->refcount = 2;
+        worker->refcount = event ? 2 : 1;
         worker->udev = udev;
 
         pid = fork();
@@ -219,12 +235,16 @@ static void worker_new(struct event *event)
                 int rc = EXIT_SUCCESS;
 
                 /* take initial device from queue */
-                dev = event->dev;
-                event->dev = NULL;
+                if (event != NULL) {
+                        dev = event->dev;
+                        event->dev = NULL;
+                }
 
                 free(worker);
                 worker_list_cleanup(udev);
                 event_queue_cleanup(udev, EVENT_UNDEF);
+                udev_event_index_free(event_index);
+                settle_list_cleanup();
                 udev_queue_export_unref(udev_queue_export);
                 udev_monitor_unref(monitor);
                 udev_ctrl_unref(udev_ctrl);
@@ -274,6 +294,39 @@ static void worker_new(struct event *event)
                         struct worker_message msg;
                         int err;
 
+                        /* wait for the next device message from main udevd, or term signal */
+                        while (dev == NULL) {
+                                struct epoll_event ev[4];
+                                int fdcount;
+                                int i;
+
+                                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
+                                if (fdcount < 0) {
+                                        if (errno == EINTR)
+                                                continue;
+                                        log_error("failed to poll: %m\n");
+                                        goto out;
+                                }
+
+                                for (i = 0; i < fdcount; i++) {
+                                        if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
+                                                dev = udev_monitor_receive_device(worker_monitor);
+                                                break;
+                                        } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
+                                                struct signalfd_siginfo fdsi;
+                                                ssize_t size;
+
+                                                size = read(fd_signal, &fdsi, sizeof(struct signalfd_siginfo));
+                                                if (size != sizeof(struct signalfd_siginfo))
+                                                        continue;
+                                                switch (fdsi.ssi_signo) {
+                                                case SIGTERM:
+                                                        goto out;
+                                                }
+                                        }
+                                }
+                        }
+
                         log_debug("seq %llu running\n", udev_device_get_seqnum(dev));
                         udev_event = udev_event_new(dev);
                         if (udev_event == NULL) {
@@ -320,39 +373,6 @@ static void worker_new(struct event *event)
                         }
 
                         udev_event_unref(udev_event);
-
-                        /* wait for more device messages from main udevd, or term signal */
-                        while (dev == NULL) {
-                                struct epoll_event ev[4];
-                                int fdcount;
-                                int i;
-
-                                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
-                                if (fdcount < 0) {
-                                        if (errno == EINTR)
-                                                continue;
-                                        log_error("failed to poll: %m\n");
-                                        goto out;
-                                }
-
-                                for (i = 0; i < fdcount; i++) {
-                                        if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
-                                                dev = udev_monitor_receive_device(worker_monitor);
-                                                break;
-                                        } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
-                                                struct signalfd_siginfo fdsi;
-                                                ssize_t size;
-
-                                                size = read(fd_signal, &fdsi, sizeof(struct signalfd_siginfo));
-                                                if (size != sizeof(struct signalfd_siginfo))
-                                                        continue;
-                                                switch (fdsi.ssi_signo) {
-                                                case SIGTERM:
-                                                        goto out;
-                                                }
-                                        }
-                                }
-                        }
                 }
 out:
                 udev_device_unref(dev);
@@ -371,7 +391,8 @@ out:
         }
         case -1:
                 udev_monitor_unref(worker_monitor);
-                event->state = EVENT_QUEUED;
+                if (event != NULL)
+                        event->state = EVENT_QUEUED;
                 free(worker);
                 log_error("fork of child failed: %m\n");
                 break;
@@ -380,12 +401,19 @@ out:
                 udev_monitor_disconnect(worker_monitor);
                 worker->monitor = worker_monitor;
                 worker->pid = pid;
+                udev_list_node_append(&worker->node, &worker_list);
+                children++;
+                if (event == NULL) {
+                        worker->state = WORKER_IDLE;
+                        worker->preforked = true;
+                        children_preforked++;
+                        log_debug("pre-forked new worker [%u]\n", pid);
+                        break;
+                }
                 worker->state = WORKER_RUNNING;
                 worker->event_start_usec = now(CLOCK_MONOTONIC);
                 worker->event = event;
                 event->state = EVENT_RUNNING;
-                udev_list_node_append(&worker->node, &worker_list);
-                children++;
                 log_debug("seq %llu forked new worker [%u]\n", udev_device_get_seqnum(event->dev), pid);
                 break;
         }
@@ -410,6 +438,10 @@ static void event_run(struct event *event)
                         continue;
                 }
                 worker_ref(worker);
+                if (worker->preforked) {
+                        worker->preforked = false;
+                        children_preforked--;
+                }
                 worker->event = event;
                 worker->state = WORKER_RUNNING;
                 worker->event_start_usec = now(CLOCK_MONOTONIC);
@@ -424,7 +456,7 @@ static void event_run(struct event *event)
         }
 
         /* start new worker and pass initial device */
-        worker_new(event);
+        worker_new(event->udev, event);
 }
 
 static int event_queue_insert(struct udev_device *dev)
@@ -439,15 +471,13 @@ static int event_queue_insert(struct udev_device *dev)
         event->dev = dev;
         event->seqnum = udev_device_get_seqnum(dev);
         event->devpath = udev_device_get_devpath(dev);
-        event->devpath_len = strlen(event->devpath);
-        event->devpath_old = udev_device_get_devpath_old(dev);
-        event->devnum = udev_device_get_devnum(dev);
-        event->is_block = streq("block", udev_device_get_subsystem(dev));
-        event->ifindex = udev_device_get_ifindex(dev);
-#ifdef HAVE_FIRMWARE
-        if (streq(udev_device_get_subsystem(dev), "firmware"))
-                event->nodelay = true;
-#endif
+        if (event->seqnum > seqnum_received)
+                seqnum_received = event->seqnum;
+
+        if (udev_event_index_add(event_index, dev, &event->index_entry) < 0) {
+                free(event);
+                return -1;
+        }
 
         udev_queue_export_device_queued(udev_queue_export, dev);
         log_debug("seq %llu queued, '%s' '%s'\n", udev_device_get_seqnum(dev),
@@ -458,7 +488,19 @@ static int event_queue_insert(struct udev_device *dev)
         return 0;
 }
 
-static void worker_kill(struct udev *udev)
+/* start workers ahead of the first events, so they do not wait for a fork */
+static void worker_prefork(struct udev *udev, int count)
+{
+        while (children < count) {
+                int n = children;
+
+                worker_new(udev, NULL);
+                if (children == n)
+                        break;
+        }
+}
+
+static void worker_kill(struct udev *udev, bool keep_preforked)
 {
         struct udev_list_node *loop;
 
@@ -468,88 +510,32 @@ static void worker_kill(struct udev *udev)
                 if (worker->state == WORKER_KILLED)
                         continue;
 
+                if (keep_preforked && worker->preforked)
+                        continue;
+
                 worker->state = WORKER_KILLED;
                 kill(worker->pid, SIGTERM);
         }
 }
 
-/* lookup event for identical, parent, child device */
-static bool is_devpath_busy(struct event *event)
+/* kill possible left-over processes in our cgroup, like background RUN+= programs, but not our workers */
+static void cgroup_kill_leftovers(void)
 {
+        _cleanup_set_free_ Set *workers = NULL;
         struct udev_list_node *loop;
-        size_t common;
 
-        /* check if queue contains events we depend on */
-        udev_list_node_foreach(loop, &event_list) {
-                struct event *loop_event = node_to_event(loop);
-
-                /* we already found a later event, earlier can not block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
-
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
-
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
-                        return true;
-
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
-                        return true;
-
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
-
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
-                        continue;
-
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-
-#ifdef HAVE_FIRMWARE
-                /* allow to bypass the dependency tracking */
-                if (event->nodelay)
-                        continue;
-#endif
-
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        workers = set_new(trivial_hash_func, trivial_compare_func);
+        if (workers == NULL)
+                return;
 
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        udev_list_node_foreach(loop, &worker_list) {
+                struct worker *worker = node_to_worker(loop);
 
-                /* no matching device */
-                continue;
+                if (set_put(workers, LONG_TO_PTR(worker->pid)) < 0)
+                        return;
         }
 
-        return false;
+        cg_kill(SYSTEMD_CGROUP_CONTROLLER, udev_cgroup, SIGKILL, false, true, workers);
 }
 
 static void event_queue_start(struct udev *udev)
@@ -563,7 +549,7 @@ static void event_queue_start(struct udev *udev)
                         continue;
 
                 /* do not start event if parent or child event is still running */
-                if (is_devpath_busy(event))
+                if (udev_event_index_is_busy(event_index, event->index_entry))
                         continue;
 
                 event_run(event);
@@ -616,6 +602,121 @@ static void worker_returned(int fd_worker)
         }
 }
 
+static void settle_free(struct settle *settle)
+{
+        udev_list_node_remove(&settle->node);
+        udev_ctrl_connection_unref(settle->conn);
+        free(settle->subsystem);
+        free(settle);
+}
+
+static void settle_list_cleanup(void)
+{
+        struct udev_list_node *loop, *tmp;
+
+        udev_list_node_foreach_safe(loop, tmp, &settle_list)
+                settle_free(node_to_settle(loop));
+}
+
+static void settle_add(struct udev *udev, struct udev_ctrl_connection *conn, const char *subsystem,
+                       unsigned long long int seqnum_start, unsigned long long int seqnum_end)
+{
+        struct settle *settle;
+
+        settle = calloc(1, sizeof(struct settle));
+        if (settle == NULL)
+                return;
+
+        if (subsystem != NULL) {
+                settle->subsystem = strdup(subsystem);
+                if (settle->subsystem == NULL) {
+                        free(settle);
+                        return;
+                }
+        }
+
+        /* wait for everything the kernel has sent up to now */
+        if (seqnum_end == 0)
+                seqnum_end = udev_get_kernel_seqnum(udev);
+
+        settle->seqnum_start = seqnum_start;
+        settle->seqnum_end = seqnum_end;
+        /* keep reference to block the client until the events are handled */
+        settle->conn = udev_ctrl_connection_ref(conn);
+        udev_list_node_append(&settle->node, &settle_list);
+}
+
+static bool settle_is_busy(struct settle *settle)
+{
+        struct udev_list_node *loop;
+
+        udev_list_node_foreach(loop, &event_list) {
+                struct event *event = node_to_event(loop);
+
+                /* the queue is ordered by sequence number */
+                if (event->seqnum > settle->seqnum_end)
+                        break;
+                if (event->seqnum < settle->seqnum_start)
+                        continue;
+                if (settle->subsystem != NULL &&
+                    !streq_ptr(udev_device_get_subsystem(event->dev), settle->subsystem))
+                        continue;
+                return true;
+        }
+
+        return false;
+}
+
+/* answer the clients whose events are all handled */
+static void settle_check(int fd_netlink)
+{
+        struct udev_list_node *loop, *tmp;
+        struct pollfd pfd[1];
+        bool drained;
+
+        if (udev_list_node_is_empty(&settle_list))
+                return;
+
+        /* nothing left to read, every event the kernel has sent is queued */
+        pfd[0].fd = fd_netlink;
+        pfd[0].events = POLLIN;
+        drained = poll(pfd, 1, 0) == 0;
+
+        udev_list_node_foreach_safe(loop, tmp, &settle_list) {
+                struct settle *settle = node_to_settle(loop);
+
+                if (!drained && seqnum_received < settle->seqnum_end)
+                        continue;
+                if (settle_is_busy(settle))
+                        continue;
+
+                log_debug("settled seq %llu-%llu %s\n", settle->seqnum_start, settle->seqnum_end,
+                          settle->subsystem ? settle->subsystem : "");
+                udev_ctrl_connection_send_settled(settle->conn);
+                settle_free(settle);
+        }
+}
+
+/* a full trigger has been requested, mark the subsystem index complete when all its events are handled */
+static void subsystem_index_check(int fd_netlink)
+{
+        struct pollfd pfd[1];
+
+        if (!udev_list_node_is_empty(&event_list))
+                return;
+        if (access("/run/udev/subsystem.pending", F_OK) < 0)
+                return;
+
+        /* the events were sent before the request, they must not be left in the socket */
+        pfd[0].fd = fd_netlink;
+        pfd[0].events = POLLIN;
+        if (poll(pfd, 1, 0) != 0)
+                return;
+
+        if (rename("/run/udev/subsystem.pending", "/run/udev/subsystem.complete") < 0)
+                log_error("unable to mark subsystem index complete: %m\n");
+}
+
 /* receive the udevd message from userspace */
 static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
 {
@@ -623,6 +724,7 @@ static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
         struct udev_ctrl_connection *ctrl_conn;
         struct udev_ctrl_msg *ctrl_msg = NULL;
         const char *str;
+        unsigned long long int seqnum_start, seqnum_end;
         int i;
 
         ctrl_conn = udev_ctrl_get_connection(uctrl);
@@ -638,7 +740,7 @@ static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
                 log_debug("udevd message (SET_LOG_PRIORITY) received, log_priority=%i\n", i);
                 log_set_max_level(i);
                 udev_set_log_priority(udev, i);
-                worker_kill(udev);
+                worker_kill(udev, false);
         }
 
         if (udev_ctrl_get_stop_exec_queue(ctrl_msg) > 0) {
@@ -680,7 +782,7 @@ static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
                         }
                         free(key);
                 }
-                worker_kill(udev);
+                worker_kill(udev, false);
         }
 
         i = udev_ctrl_get_set_children_max(ctrl_msg);
@@ -692,6 +794,12 @@ static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
         if (udev_ctrl_get_ping(ctrl_msg) > 0)
                 log_debug("udevd message (SYNC) received\n");
 
+        if (udev_ctrl_get_settle(ctrl_msg, &str, &seqnum_start, &seqnum_end) > 0) {
+                log_debug("udevd message (SETTLE) received, seq %llu-%llu %s\n",
+                          seqnum_start, seqnum_end, str ? str : "");
+                settle_add(udev, ctrl_conn, str, seqnum_start, seqnum_end);
+        }
+
         if (udev_ctrl_get_exit(ctrl_msg) > 0) {
                 log_debug("udevd message (EXIT) received\n");
                 udev_exit = true;
@@ -733,6 +841,10 @@ static int handle_inotify(struct udev *udev)
                                 int fd;
 
                                 log_debug("device %s closed, synthesising 'change'\n", udev_device_get_devnode(dev));
+#ifdef HAVE_BLKID
+                                /* the content might have changed, probe it again */
+                                udev_builtin_blkid_cache_invalidate(dev);
+#endif
                                 strscpyl(filename, sizeof(filename), udev_device_get_syspath(dev), "/uevent", NULL);
                                 fd = open(filename, O_WRONLY);
                                 if (fd >= 0) {
@@ -1002,6 +1114,10 @@ int main(int argc, char *argv[])
 
         mkdir("/run/udev", 0755);
 
+        /* we might have missed events, the subsystem index needs a full trigger to be complete again */
+        unlink("/run/udev/subsystem.complete");
+        unlink("/run/udev/subsystem.pending");
+
         dev_setup(NULL);
 
         /* before opening new files, make sure std{in,out,err} fds are in a sane state */
@@ -1204,12 +1320,33 @@ int main(int argc, char *argv[])
         }
         log_debug("set children_max to %u\n", children_max);
 
+        /* one warm worker per CPU, with rules and builtins loaded, for the coldplug events */
+        if (children_prefork <= 0) {
+                cpu_set_t cpu_set;
+
+                children_prefork = 1;
+
+                if (sched_getaffinity(0, sizeof (cpu_set), &cpu_set) == 0)
+                        children_prefork = CPU_COUNT(&cpu_set);
+        }
+        children_prefork = MIN(children_prefork, children_max);
+        log_debug("set children_prefork to %u\n", children_prefork);
+
         rc = udev_rules_apply_static_dev_perms(rules);
         if (rc < 0)
                 log_error("failed to apply permissions on static device nodes - %s\n", strerror(-rc));
 
         udev_list_node_init(&event_list);
         udev_list_node_init(&worker_list);
+        udev_list_node_init(&settle_list);
+
+        event_index = udev_event_index_new();
+        if (event_index == NULL) {
+                log_error("error creating event index\n");
+                goto exit;
+        }
+
+        worker_prefork(udev, children_prefork);
 
         for (;;) {
                 static usec_t last_usec;
@@ -1238,7 +1375,7 @@ int main(int argc, char *argv[])
 
                         /* discard queued events and kill workers */
                         event_queue_cleanup(udev, EVENT_QUEUED);
-                        worker_kill(udev);
+                        worker_kill(udev, false);
 
                         /* exit after all has cleaned up */
                         if (udev_list_node_is_empty(&event_list) && udev_list_node_is_empty(&worker_list))
@@ -1246,13 +1383,13 @@ int main(int argc, char *argv[])
 
                         /* timeout at exit for workers to finish */
                         timeout = 30 * 1000;
-                } else if (udev_list_node_is_empty(&event_list) && !children) {
-                        /* we are idle */
+                } else if (udev_list_node_is_empty(&event_list) && children == children_preforked) {
+                        /* we are idle, pre-forked workers wait for their first event */
                         timeout = -1;
 
                         /* cleanup possible left-over processes in our cgroup */
                         if (udev_cgroup)
-                                cg_kill(SYSTEMD_CGROUP_CONTROLLER, udev_cgroup, SIGKILL, false, true, NULL);
+                                cgroup_kill_leftovers();
                 } else {
                         /* kill idle or hanging workers */
                         timeout = 3 * 1000;
@@ -1273,7 +1410,7 @@ int main(int argc, char *argv[])
                         /* kill idle workers */
                         if (udev_list_node_is_empty(&event_list)) {
                                 log_debug("cleanup idle workers\n");
-                                worker_kill(udev);
+                                worker_kill(udev, true);
                         }
 
                         /* check for hanging events */
@@ -1328,7 +1465,7 @@ int main(int argc, char *argv[])
 
                 /* reload requested, HUP signal received, rules changed, builtin changed */
                 if (reload) {
-                        worker_kill(udev);
+                        worker_kill(udev, false);
                         rules = udev_rules_unref(rules);
                         udev_builtin_exit(udev);
                         reload = false;
@@ -1386,6 +1523,11 @@ int main(int argc, char *argv[])
                  */
                 if (is_ctrl)
                         ctrl_conn = handle_ctrl_msg(udev_ctrl);
+
+                /* unblock settle clients whose events are handled */
+                settle_check(fd_netlink);
+
+                subsystem_index_check(fd_netlink);
         }
 
         rc = EXIT_SUCCESS;
@@ -1397,6 +1539,8 @@ exit_daemonize:
                 close(fd_ep);
         worker_list_cleanup(udev);
         event_queue_cleanup(udev, EVENT_UNDEF);
+        settle_list_cleanup();
+        udev_event_index_free(event_index);
         udev_rules_unref(rules);
         udev_builtin_exit(udev);
         if (fd_signal >= 0)